@@ -4,54 +4,38 @@
 
 #include <iostream>
 
-#ifdef _WIN32
-
+#include "frame_scheduler.h"
+#include "framebuffer.h"
+#include "renderer.h"
 #include "sphere.h"
-#include "window.h"
 
 #include <bardrix/ray.h>
 #include <bardrix/light.h>
 #include <bardrix/camera.h>
-#include <bardrix/quaternion.h> // Ensure this header is included for bardrix::quaternion
-
-
-/// \brief Calculates the light intensity at a given intersection point
-/// \param shape The shape that was intersected
-/// \param light The light source
-/// \param camera The camera
-/// \param intersection_point The intersection point of an object
-/// \return The light intensity at the intersection point
-/// \example double intensity = calculate_light_intensity(shape, light, camera, intersection_point);
-double calculate_light_intensity(const bardrix::shape& shape, const bardrix::light& light, const bardrix::camera& camera,
-const bardrix::point3& intersection_point) {
-const bardrix::vector3 light_intersection_vector = intersection_point.vector_to(light.position).normalized();
-
-// Angle between the normal and the light intersection vector
-const double angle = shape.normal_at(intersection_point).dot(light_intersection_vector);
-
-if (angle < 0) // This means the light is behind the intersection_point
-return 0;
-
-// Specular reflection
-bardrix::vector3 reflection = bardrix::quaternion::mirror(light_intersection_vector,
-shape.normal_at(intersection_point));
-double specular_angle = reflection.dot(camera.position.vector_to(intersection_point).normalized());
-double specular = std::pow(specular_angle, shape.get_material().get_shininess());
-
-// We're calculating phong shading (ambient + diffuse + specular)
-double intensity = shape.get_material().get_ambient();
-intensity += shape.get_material().get_diffuse() * angle;
-intensity += shape.get_material().get_specular() * specular;
-
-// Max intensity is 1
-return min(1.0, intensity * light.inverse_square_law(intersection_point));
-}
 
-int main() {
+#ifdef _WIN32
+
+#include "render_thread.h"
+#include "window.h"
+
+#else // _WIN32
+
+#include "bvh.h"
+#include "bvh8.h"
+#include "image.h"
+#include "uniform_grid.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+
+#endif // _WIN32
+
+int main(int argc, char* argv[]) {
     int width = 600;
     int height = 600;
-    // Create a window
-    bardrix::window window("Raytracing", width, height);
 
     // Create a camera
     bardrix::camera camera = bardrix::camera({ 0,0,0 }, { 0,0,1 }, width, height, 60);
@@ -71,50 +55,45 @@ int main() {
 
     };
 
-    // [&camera, &sphere] is a capture list, this means we can access those objects outside the lambda
-    // If you'd want to add a light you'd have to add this to the capture list too.
-    window.on_paint = [&camera, &spheres, &lights](bardrix::window* window, std::vector<uint32_t>& buffer) {
-        // Go through all the pixels
-        for (int y = 0; y < window->get_height(); y++) {
-            for (int x = 0; x < window->get_width(); x++) {
-
-                // Shoot a ray from the camera to the pixel
-                bardrix::ray ray = *camera.shoot_ray(x, y, 10);
-
-                // Optional means that we can or cannot have a value
-                // In order to check if the optional has a value, we use the has_value() method
-                // If the optional has a value, we can access it using the value() method
-                // E.g. intersection.value() -> bardrix::point3
-
-
-                    // Default color is black
-                    bardrix::color color = bardrix::color::green();
-                for (sphere& s : spheres) {
-
-
-                    std::optional<bardrix::point3> intersection = s.intersection(ray);
-
-                    // If the ray intersects the sphere, paint the pixel white
-                    if (intersection.has_value()) {
-                        double intensity = 0;
-                        for (bardrix::light& l : lights) {
-                            intensity += calculate_light_intensity(s, l, camera, intersection.value());
-                            color = l.color.blended(s.get_material().color) * intensity;
-                        }
-                    }
-                }
-                // Set the pixel
-                buffer[y * window->get_width() + x] = color.argb(); // ARGB is the format used by Windows API
-            }
-        }
-        };
+#ifdef _WIN32
 
-    window.on_resize = [&camera](bardrix::window* window, int width, int height) {
-        // Resize the camera
-        camera.set_width(width);
-        camera.set_height(height);
+    // Create a window
+    bardrix::window window("Raytracing", width, height);
 
-        window->redraw(); // Redraw the window (calls on_paint)
+    renderer renderer(camera, spheres, lights);
+
+    // Frames are rendered on a thread of their own, so a slow frame never freezes the window
+    // The renderer references the camera, spheres and lights, change those inside the render function only
+    // The first image of a size is scaled to fit 16 ms at the time per pixel of the last frames (never below a
+    // quarter of the width and height), the full resolution follows as long as the size holds
+    frame_scheduler scheduler(renderer, camera, 0.016);
+    render_thread rendering(
+        [&renderer, &camera, &scheduler, &rendering](framebuffer& buffer, int width, int height,
+                                                     const cancel_token& token) {
+            // Resize the camera
+            camera.set_width(width);
+            camera.set_height(height);
+
+            const render_stats fast = scheduler.render(buffer, width, height, token);
+            if (fast.cancelled || fast.resolution_scale >= 1)
+                return;
+            rendering.present(buffer, width, height);
+
+            // Refine to the full resolution, only the passes that are sharper than the first image are shown
+            // Stops within a row once the window is resized again
+            renderer.render_progressive(buffer, width, height, [&](const framebuffer& pixels, int pass) {
+                if (pass + 1 < renderer::progressive_passes &&
+                    renderer::progressive_scale(pass) > fast.resolution_scale)
+                    rendering.present(pixels, width, height);
+                }, token);
+        },
+        [&window] { window.redraw(); }); // Show the new frame (calls on_paint)
+
+    // [&rendering] is a capture list, this means we can access the render thread outside the lambda
+    window.on_paint = [&rendering](bardrix::window* window) { return rendering.latest(); };
+
+    window.on_resize = [&rendering](bardrix::window* window, int width, int height) {
+        rendering.request(width, height); // The window repaints once the frame is complete
         };
 
     // Get width and height of the screen
@@ -127,14 +106,234 @@ int main() {
         return -1;
     }
 
+    rendering.request(window.get_width(), window.get_height());
     bardrix::window::run();
-}
 
 #else // _WIN32
 
-int main() {
-    std::cout << "This example is only available on Windows." << std::endl;
+    // Without a window we render headless, straight to disk
+    int frames = 1;
+    int random_spheres = 0;
+    int random_lights = 0;
+    int moving_spheres = 0;
+    bool dirty_rectangles = false;
+    bool progressive = false;
+    double frame_budget = 0;
+    render_options options;
+    std::string output = "frame";
+
+    for (int i = 1; i < argc; i++) {
+        const bool has_value = i + 1 < argc;
+        if (has_value && std::strcmp(argv[i], "--width") == 0)
+            width = std::atoi(argv[++i]);
+        else if (has_value && std::strcmp(argv[i], "--height") == 0)
+            height = std::atoi(argv[++i]);
+        else if (has_value && std::strcmp(argv[i], "--frames") == 0)
+            frames = std::atoi(argv[++i]);
+        else if (has_value && std::strcmp(argv[i], "--threads") == 0)
+            options.threads = static_cast<unsigned int>(std::atoi(argv[++i]));
+        else if (has_value && std::strcmp(argv[i], "--tile-size") == 0)
+            options.tile_size = std::atoi(argv[++i]);
+        else if (has_value && std::strcmp(argv[i], "--output") == 0)
+            output = argv[++i];
+        else if (has_value && std::strcmp(argv[i], "--random-spheres") == 0)
+            random_spheres = std::atoi(argv[++i]);
+        else if (has_value && std::strcmp(argv[i], "--moving-spheres") == 0)
+            moving_spheres = std::atoi(argv[++i]);
+        else if (has_value && std::strcmp(argv[i], "--random-lights") == 0)
+            random_lights = std::atoi(argv[++i]);
+        else if (has_value && std::strcmp(argv[i], "--light-cutoff") == 0)
+            options.light_cutoff = std::atof(argv[++i]);
+        else if (has_value && std::strcmp(argv[i], "--frame-budget") == 0)
+            frame_budget = std::atof(argv[++i]) / 1000;
+        else if (has_value && std::strcmp(argv[i], "--light-samples") == 0)
+            options.light_samples = std::atoi(argv[++i]);
+        else if (has_value && std::strcmp(argv[i], "--acceleration") == 0) {
+            const std::string name = argv[++i];
+            if (name == "linear")
+                options.acceleration = acceleration_structure::linear;
+            else if (name == "bvh")
+                options.acceleration = acceleration_structure::bvh;
+            else if (name == "lbvh")
+                options.acceleration = acceleration_structure::lbvh;
+            else if (name == "bvh8")
+                options.acceleration = acceleration_structure::bvh8;
+            else if (name == "grid")
+                options.acceleration = acceleration_structure::grid;
+            else {
+                std::cout << "Unknown acceleration structure " << name << std::endl;
+                return 1;
+            }
+        }
+        else if (has_value && std::strcmp(argv[i], "--packets") == 0) {
+            const std::string name = argv[++i];
+            if (name == "single")
+                options.packets = packet_shape::single;
+            else if (name == "8x1")
+                options.packets = packet_shape::row;
+            else if (name == "4x2")
+                options.packets = packet_shape::block;
+            else {
+                std::cout << "Unknown packet shape " << name << std::endl;
+                return 1;
+            }
+        }
+        else if (has_value && std::strcmp(argv[i], "--morton-bits") == 0)
+            options.morton_bits = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "--tile-culling") == 0)
+            options.tile_culling = true;
+        else if (std::strcmp(argv[i], "--shadows") == 0)
+            options.shadows = true;
+        else if (std::strcmp(argv[i], "--wavefront") == 0)
+            options.wavefront = true;
+        else if (std::strcmp(argv[i], "--scalar-shading") == 0)
+            options.vectorized_shading = false;
+        else if (std::strcmp(argv[i], "--g-buffer") == 0)
+            options.g_buffer = true;
+        else if (std::strcmp(argv[i], "--dirty-rectangles") == 0)
+            dirty_rectangles = true;
+        else if (std::strcmp(argv[i], "--progressive") == 0)
+            progressive = true;
+        else if (std::strcmp(argv[i], "--stats") == 0)
+            options.collect_statistics = true;
+        else {
+            std::cout << "Usage: " << argv[0]
+                      << " [--width n] [--height n] [--frames n] [--threads n] [--tile-size n] [--output prefix]"
+                      << " [--random-spheres n] [--moving-spheres n] [--random-lights n] [--light-cutoff x]"
+                      << " [--light-samples n] [--acceleration linear|bvh|lbvh|bvh8|grid] [--morton-bits 30|63]"
+                      << " [--packets single|8x1|4x2] [--tile-culling] [--shadows] [--wavefront] [--scalar-shading]"
+                      << " [--g-buffer] [--dirty-rectangles] [--progressive] [--frame-budget ms]"
+                      << " [--stats]" << std::endl;
+            return 1;
+        }
+    }
+
+    if (width <= 0 || height <= 0 || frames <= 0) {
+        std::cout << "Width, height and frames must be positive." << std::endl;
+        return 1;
+    }
+
+    camera.set_width(width);
+    camera.set_height(height);
+
+    // Replace the example scene by a box of random particles, e.g. to benchmark the acceleration structures
+    if (random_spheres > 0) {
+        std::mt19937 random(1);
+        std::uniform_real_distribution<double> x(-3, 3), y(-3, 3), z(3, 9);
+        const double radius = 0.4 * std::cbrt(6.0 * 6.0 * 6.0 / random_spheres);
+
+        spheres.clear();
+        spheres.reserve(random_spheres);
+        for (int i = 0; i < random_spheres; i++)
+            spheres.emplace_back(radius, bardrix::point3(x(random), y(random), z(random)),
+                                 bardrix::material(0.1, 1, 0.5, 50));
+    }
+
+    // Replace the lights by many small lights spread through the same box
+    if (random_lights > 0) {
+        std::mt19937 random(3);
+        std::uniform_real_distribution<double> x(-3, 3), y(-3, 3), z(3, 9), intensity(0.01, 0.1);
+
+        lights.clear();
+        lights.reserve(random_lights);
+        for (int i = 0; i < random_lights; i++)
+            lights.emplace_back(bardrix::point3(x(random), y(random), z(random)), intensity(random),
+                                bardrix::color::cyan());
+    }
+
+    const auto build_start = std::chrono::steady_clock::now();
+    renderer renderer(camera, spheres, lights, options);
+    const double build_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - build_start).count();
+
+    const auto* hierarchy = dynamic_cast<const bvh*>(&renderer.get_accelerator());
+    if (hierarchy != nullptr && options.collect_statistics)
+        std::cout << "BVH: " << hierarchy->get_nodes().size() << " nodes, depth " << hierarchy->get_depth()
+                  << ", SAH cost " << hierarchy->sah_cost() << ", built in " << build_seconds * 1000 << " ms"
+                  << std::endl;
+
+    const auto* wide = dynamic_cast<const bvh8*>(&renderer.get_accelerator());
+    if (wide != nullptr && options.collect_statistics)
+        std::cout << "BVH8: " << wide->get_nodes().size() << " nodes, built in " << build_seconds * 1000 << " ms"
+                  << std::endl;
+
+    const auto* grid = dynamic_cast<const uniform_grid*>(&renderer.get_accelerator());
+    if (grid != nullptr && options.collect_statistics)
+        std::cout << "Grid: " << grid->get_resolution(0) << "x" << grid->get_resolution(1) << "x"
+                  << grid->get_resolution(2) << " cells, " << grid->get_reference_count() << " references, built in "
+                  << build_seconds * 1000 << " ms" << std::endl;
+
+    framebuffer buffer;
+    render_stats total;
+    frame_scheduler scheduler(renderer, camera, frame_budget);
+    std::mt19937 motion(2);
+
+    for (int frame = 0; frame < frames; frame++) {
+        // Nudge a few spheres every frame after the first, the acceleration structure is refit instead of rebuilt
+        if (frame > 0 && moving_spheres > 0 && !spheres.empty()) {
+            std::uniform_int_distribution<std::size_t> pick(0, spheres.size() - 1);
+            std::uniform_real_distribution<double> offset(-0.05, 0.05);
+            std::vector<std::uint32_t> changed;
+            for (int i = 0; i < moving_spheres; i++) {
+                const std::size_t index = pick(motion);
+                const bardrix::point3 position = spheres[index].get_position();
+                spheres[index].set_position(position + bardrix::vector3(offset(motion), offset(motion), offset(motion)));
+                changed.push_back(static_cast<std::uint32_t>(index));
+            }
+
+            const auto refit_start = std::chrono::steady_clock::now();
+            const bool rebuilt = renderer.refit(changed);
+            const double refit_seconds =
+                std::chrono::duration<double>(std::chrono::steady_clock::now() - refit_start).count();
+            if (options.collect_statistics)
+                std::cout << (rebuilt ? "Rebuilt" : "Refit") << " in " << refit_seconds * 1000 << " ms, degradation "
+                          << renderer.get_accelerator().get_degradation() << std::endl;
+        }
+
+        // Write every coarse pass of a progressive frame next to the frame
+        const auto frame_start = std::chrono::steady_clock::now();
+        auto write_pass = [&](const framebuffer& pixels, int pass) {
+            if (pass + 1 == renderer::progressive_passes)
+                return;
+
+            const std::string path = output + "_" + std::to_string(frame) + "_pass" + std::to_string(pass) + ".ppm";
+            const double seconds =
+                std::chrono::duration<double>(std::chrono::steady_clock::now() - frame_start).count();
+            if (write_ppm(path, pixels, width, height))
+                std::cout << path << ": after " << seconds * 1000 << " ms" << std::endl;
+        };
+
+        // Frames after the first only redraw around the moved spheres when asked to
+        render_stats stats = frame_budget > 0   ? scheduler.render(buffer, width, height)
+                             : progressive      ? renderer.render_progressive(buffer, width, height, write_pass)
+                             : dirty_rectangles ? renderer.render_dirty(buffer, width, height)
+                                                : renderer.render(buffer, width, height);
+        total.rays += stats.rays;
+        total.seconds += stats.seconds;
+
+        const std::string path = output + "_" + std::to_string(frame) + ".ppm";
+        if (!write_ppm(path, buffer, width, height)) {
+            std::cout << "Could not write " << path << std::endl;
+            return 1;
+        }
+
+        std::cout << path << ": " << stats.seconds * 1000 << " ms, "
+                  << stats.rays_per_second() / 1e6 << " Mrays/s";
+        if (frame_budget > 0)
+            std::cout << ", scale " << stats.resolution_scale;
+        std::cout << std::endl;
+
+        if (options.collect_statistics)
+            std::cout << "  " << stats.traversal.nodes_per_ray() << " nodes/ray, "
+                      << stats.traversal.primitives_per_ray() << " spheres/ray" << std::endl;
+    }
+
+    std::cout << "Total: " << total.rays << " rays in " << total.seconds << " s, "
+              << total.rays_per_second() / 1e6 << " Mrays/s" << std::endl;
+    if (options.collect_statistics)
+        std::cout << "Frame buffers: " << page_pool::instance().get_allocations() << " allocations, "
+                  << page_pool::instance().get_reserved() / 1024 << " KiB" << std::endl;
+
+#endif // _WIN32
+
     return 0;
 }
-
-#endif // _WIN32
\ No newline at end of file
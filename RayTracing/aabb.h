@@ -0,0 +1,90 @@
+#pragma once
+
+#include <bardrix/bardrix.h>
+
+#include <algorithm>
+#include <limits>
+
+/// \brief Axis aligned bounding box
+struct aabb {
+    /// \brief The minimum corner
+    bardrix::point3 min = { std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity(),
+                            std::numeric_limits<double>::infinity() };
+
+    /// \brief The maximum corner
+    bardrix::point3 max = { -std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity(),
+                            -std::numeric_limits<double>::infinity() };
+
+    /// \brief Creates the bounding box of a sphere
+    /// \param center The center of the sphere
+    /// \param radius The radius of the sphere
+    /// \return The bounding box of the sphere
+    static aabb of_sphere(const bardrix::point3& center, double radius) {
+        return { { center.x - radius, center.y - radius, center.z - radius },
+                 { center.x + radius, center.y + radius, center.z + radius } };
+    }
+
+    /// \brief Checks if nothing was added to the box yet
+    NODISCARD bool empty() const { return min.x > max.x; }
+
+    /// \brief Grows the box so it contains a point
+    void grow(const bardrix::point3& point) {
+        min = { std::min(min.x, point.x), std::min(min.y, point.y), std::min(min.z, point.z) };
+        max = { std::max(max.x, point.x), std::max(max.y, point.y), std::max(max.z, point.z) };
+    }
+
+    /// \brief Grows the box so it contains another box
+    void grow(const aabb& other) {
+        min = { std::min(min.x, other.min.x), std::min(min.y, other.min.y), std::min(min.z, other.min.z) };
+        max = { std::max(max.x, other.max.x), std::max(max.y, other.max.y), std::max(max.z, other.max.z) };
+    }
+
+    /// \brief Gets the center of the box
+    NODISCARD bardrix::point3 center() const {
+        return { (min.x + max.x) * 0.5, (min.y + max.y) * 0.5, (min.z + max.z) * 0.5 };
+    }
+
+    /// \brief Gets the size of the box along an axis
+    /// \param axis 0 for x, 1 for y, 2 for z
+    NODISCARD double extent(int axis) const { return axis_of(max, axis) - axis_of(min, axis); }
+
+    /// \brief Gets the surface area of the box, 0 for an empty box
+    NODISCARD double surface_area() const {
+        if (empty())
+            return 0;
+
+        const double x = max.x - min.x, y = max.y - min.y, z = max.z - min.z;
+        return 2 * (x * y + y * z + z * x);
+    }
+
+    /// \brief Checks if the box overlaps another box
+    NODISCARD bool overlaps(const aabb& other) const {
+        return min.x <= other.max.x && max.x >= other.min.x && min.y <= other.max.y && max.y >= other.min.y &&
+               min.z <= other.max.z && max.z >= other.min.z;
+    }
+
+    /// \brief Intersects a ray with the box (slab test)
+    /// \param origin The origin of the ray
+    /// \param inverse_direction 1 / direction of the ray per component
+    /// \param t_min The minimum distance along the ray
+    /// \param t_max The maximum distance along the ray
+    /// \param entry The distance at which the ray enters the box, clamped to t_min
+    /// \return If the ray hits the box within [t_min, t_max]
+    bool intersect(const bardrix::point3& origin, const bardrix::vector3& inverse_direction, double t_min,
+                   double t_max, double& entry) const {
+        const double x0 = (min.x - origin.x) * inverse_direction.x, x1 = (max.x - origin.x) * inverse_direction.x;
+        const double y0 = (min.y - origin.y) * inverse_direction.y, y1 = (max.y - origin.y) * inverse_direction.y;
+        const double z0 = (min.z - origin.z) * inverse_direction.z, z1 = (max.z - origin.z) * inverse_direction.z;
+
+        entry = std::max({ t_min, std::min(x0, x1), std::min(y0, y1), std::min(z0, z1) });
+        const double exit = std::min({ t_max, std::max(x0, x1), std::max(y0, y1), std::max(z0, z1) });
+        return entry <= exit;
+    }
+
+    /// \brief Gets a component of a point by axis
+    /// \param point The point
+    /// \param axis 0 for x, 1 for y, 2 for z
+    static double axis_of(const bardrix::point3& point, int axis) {
+        return axis == 0 ? point.x : axis == 1 ? point.y : point.z;
+    }
+};
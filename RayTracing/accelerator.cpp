@@ -0,0 +1,70 @@
+#include "accelerator.h"
+
+#include <algorithm>
+
+double traversal_stats::nodes_per_ray() const {
+    return rays > 0 ? static_cast<double>(nodes) / static_cast<double>(rays) : 0;
+}
+
+double traversal_stats::primitives_per_ray() const {
+    return rays > 0 ? static_cast<double>(primitives) / static_cast<double>(rays) : 0;
+}
+
+void accelerator::set_collect_statistics(bool collect) { this->collect_statistics_ = collect; }
+
+traversal_stats accelerator::get_statistics() const {
+    traversal_stats stats;
+    stats.rays = rays_.load(std::memory_order_relaxed);
+    stats.nodes = nodes_.load(std::memory_order_relaxed);
+    stats.primitives = primitives_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void accelerator::reset_statistics() {
+    rays_ = 0;
+    nodes_ = 0;
+    primitives_ = 0;
+}
+
+void accelerator::closest_hits(const ray_packet& packet, packet_hits& hits) const {
+    for (int i = 0; i < packet.size; i++)
+        hits[i] = closest_hit(bardrix::ray(packet.origins[i], packet.directions[i], packet.t_max[i]), packet.t_min,
+                              packet.t_max[i]);
+}
+
+void accelerator::closest_hits(const ray_queue& rays, hit_queue& hits) const {
+    for (std::size_t first = 0; first < rays.size(); first += ray_packet::max_size) {
+        ray_packet packet;
+        const std::size_t last = std::min(first + ray_packet::max_size, rays.size());
+        for (std::size_t i = first; i < last; i++)
+            packet.add(rays.origin(i), rays.direction(i), rays.t_max[i]);
+
+        packet_hits results;
+        closest_hits(packet, results);
+        for (int lane = 0; lane < packet.size; lane++) {
+            const std::optional<hit_record>& hit = results[lane];
+            if (hit.has_value())
+                hits.push(packet.origins[lane] + packet.directions[lane] * hit->t, hit->normal,
+                          static_cast<std::uint32_t>(hit->id), rays, first + lane);
+        }
+    }
+}
+
+std::uint32_t accelerator::any_hits(const ray_packet& packet) const {
+    std::uint32_t blocked = 0;
+    for (int i = 0; i < packet.size; i++)
+        if (any_hit(bardrix::ray(packet.origins[i], packet.directions[i], packet.t_max[i]), packet.t_min,
+                    packet.t_max[i]))
+            blocked |= 1u << i;
+
+    return blocked;
+}
+
+void accelerator::count_traversal(std::uint64_t nodes, std::uint64_t primitives, std::uint64_t rays) const {
+    if (!collect_statistics_)
+        return;
+
+    rays_.fetch_add(rays, std::memory_order_relaxed);
+    nodes_.fetch_add(nodes, std::memory_order_relaxed);
+    primitives_.fetch_add(primitives, std::memory_order_relaxed);
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "hit_record.h"
+#include "ray_packet.h"
+#include "ray_queue.h"
+#include "sphere.h"
+
+#include <bardrix/ray.h>
+
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+/// \brief Counters of the work done by an accelerator, used to check the quality of the structure
+struct traversal_stats {
+    /// \brief The amount of rays that were traced
+    std::uint64_t rays = 0;
+
+    /// \brief The amount of nodes (or cells) that were visited
+    std::uint64_t nodes = 0;
+
+    /// \brief The amount of ray-sphere tests that were done
+    std::uint64_t primitives = 0;
+
+    /// \brief Gets the average amount of visited nodes per ray
+    NODISCARD double nodes_per_ray() const;
+
+    /// \brief Gets the average amount of ray-sphere tests per ray
+    NODISCARD double primitives_per_ray() const;
+};
+
+/// \brief Base class of the structures that find the nearest sphere along a ray
+class accelerator {
+protected:
+    /// \brief If the traversal counters are updated, off by default as the counters are shared by all threads
+    bool collect_statistics_ = false;
+
+    /// \brief The traversal counters
+    mutable std::atomic<std::uint64_t> rays_ = 0, nodes_ = 0, primitives_ = 0;
+
+public:
+    virtual ~accelerator() = default;
+
+    // STATISTICS
+
+    /// \brief Turns the traversal counters on or off
+    /// \param collect If the counters should be updated
+    void set_collect_statistics(bool collect);
+
+    /// \brief Gets the traversal counters since the last reset
+    NODISCARD traversal_stats get_statistics() const;
+
+    /// \brief Resets the traversal counters to 0
+    void reset_statistics();
+
+    // UPDATING
+
+    /// \brief Updates the structure after spheres moved or changed radius, without adding or removing spheres
+    /// \param spheres The spheres the structure was built over, in their new state
+    /// \param changed The indices of the spheres that changed
+    virtual void refit(const std::vector<sphere>& spheres, const std::vector<std::uint32_t>& changed) = 0;
+
+    /// \brief Gets how much slower the structure is expected to be than right after it was built
+    /// \return The ratio of the current and the original cost, 1 for structures that don't degrade
+    NODISCARD virtual double get_degradation() const { return 1; }
+
+    // RAYTRACING
+
+    /// \brief Finds the nearest intersection of a ray with the spheres
+    /// \param ray The ray to check for intersection
+    /// \param t_min The minimum distance along the ray
+    /// \param t_max The maximum distance along the ray
+    /// \return The nearest hit with the index of the sphere as id, otherwise std::nullopt
+    /// \example std::optional<hit_record> hit = accelerator.closest_hit(ray, 0, ray.get_length());
+    NODISCARD virtual std::optional<hit_record> closest_hit(const bardrix::ray& ray, double t_min,
+                                                            double t_max) const = 0;
+
+    /// \brief Finds the nearest intersections of a packet of rays, by default one ray at a time
+    /// \param packet The rays to check for intersection
+    /// \param hits The nearest hit of every ray, std::nullopt for a miss
+    /// \example packet_hits hits; accelerator.closest_hits(packet, hits);
+    virtual void closest_hits(const ray_packet& packet, packet_hits& hits) const;
+
+    /// \brief Finds the nearest intersections of a queue of rays, by default in packets of consecutive rays
+    /// \details The entry point of the wavefront renderer, the structures read the rays straight from the arrays
+    /// \param rays The rays to check for intersection, starting at distance 0
+    /// \param hits The queue the hits are appended to in the order of the rays, misses are left out
+    /// \example accelerator.closest_hits(queues.primary, queues.hits);
+    virtual void closest_hits(const ray_queue& rays, hit_queue& hits) const;
+
+    /// \brief Checks if any sphere blocks a ray, stops at the first blocker and builds no hit record
+    /// \param ray The ray to check, e.g. from a surface point to a light
+    /// \param t_min The minimum distance along the ray, a small epsilon to not block on the surface itself
+    /// \param t_max The maximum distance along the ray, e.g. the distance to the light
+    /// \return If a sphere overlaps the ray within [t_min, t_max]
+    /// \example bool shadowed = accelerator.any_hit(shadow_ray, 1e-4, distance_to_light);
+    NODISCARD virtual bool any_hit(const bardrix::ray& ray, double t_min, double t_max) const = 0;
+
+    /// \brief Checks a packet of rays for blockers, by default one ray at a time
+    /// \param packet The rays to check, e.g. the shadow rays of a point towards several lights
+    /// \return Bit i is set when ray i is blocked
+    NODISCARD virtual std::uint32_t any_hits(const ray_packet& packet) const;
+
+protected:
+    /// \brief Adds the work of a ray or packet to the counters when statistics are collected
+    /// \param nodes The amount of visited nodes
+    /// \param primitives The amount of ray-sphere tests
+    /// \param rays The amount of rays that did this work together
+    void count_traversal(std::uint64_t nodes, std::uint64_t primitives, std::uint64_t rays = 1) const;
+}; // class accelerator
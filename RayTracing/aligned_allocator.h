@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+/// \brief Allocator that aligns every allocation, used to keep SIMD arrays on cache line boundaries
+/// \tparam T The type to allocate
+/// \tparam Alignment The alignment in bytes, must be a power of two
+/// \example std::vector<float, aligned_allocator<float, 64>> lanes;
+template<typename T, std::size_t Alignment = 64>
+struct aligned_allocator {
+    using value_type = T;
+
+    template<typename U>
+    struct rebind {
+        using other = aligned_allocator<U, Alignment>;
+    };
+
+    aligned_allocator() noexcept = default;
+
+    template<typename U>
+    aligned_allocator(const aligned_allocator<U, Alignment>&) noexcept {}
+
+    T* allocate(std::size_t count) {
+        return static_cast<T*>(::operator new(count * sizeof(T), std::align_val_t(Alignment)));
+    }
+
+    void deallocate(T* pointer, std::size_t) noexcept { ::operator delete(pointer, std::align_val_t(Alignment)); }
+
+    template<typename U>
+    bool operator==(const aligned_allocator<U, Alignment>&) const noexcept { return true; }
+
+    template<typename U>
+    bool operator!=(const aligned_allocator<U, Alignment>&) const noexcept { return false; }
+};
+
+/// \brief A vector whose data starts on a cache line
+template<typename T>
+using aligned_vector = std::vector<T, aligned_allocator<T, 64>>;
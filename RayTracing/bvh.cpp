@@ -0,0 +1,993 @@
+#include "bvh.h"
+
+#include "morton.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+
+bvh::bvh(const std::vector<sphere>& spheres, thread_pool* pool, bvh_builder builder) {
+    build(spheres, pool, builder);
+}
+
+const std::vector<bvh_node>& bvh::get_nodes() const { return nodes_; }
+
+const std::vector<bvh_primitive>& bvh::get_primitives() const { return primitives_; }
+
+std::uint32_t bvh::get_depth() const {
+    if (nodes_.empty())
+        return 0;
+
+    std::uint32_t depth = 0;
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> stack = { { 0, 1 } };
+    while (!stack.empty()) {
+        const auto [index, node_depth] = stack.back();
+        stack.pop_back();
+
+        depth = std::max(depth, node_depth);
+        if (!nodes_[index].is_leaf()) {
+            stack.emplace_back(nodes_[index].left, node_depth + 1);
+            stack.emplace_back(nodes_[index].right, node_depth + 1);
+        }
+    }
+
+    return depth;
+}
+
+double bvh::sah_cost() const {
+    if (nodes_.empty())
+        return 0;
+
+    const double root_area = nodes_[0].bounds.surface_area();
+    if (root_area <= 0)
+        return intersection_cost * nodes_[0].count;
+
+    // Every node is visited with a probability of its area relative to the root
+    double cost = 0;
+    for (const bvh_node& node : nodes_)
+        cost += weighted_area(node);
+
+    return cost / root_area;
+}
+
+void bvh::build(const std::vector<sphere>& spheres, thread_pool* pool, bvh_builder builder) {
+    nodes_.clear();
+    primitives_.clear();
+    leaf_of_.clear();
+    built_weighted_area_ = weighted_area_ = 0;
+
+    if (spheres.empty())
+        return;
+
+    if (builder != bvh_builder::sah) {
+        build_linear(spheres, pool, builder == bvh_builder::morton30 ? 30 : 63);
+        index_leaves();
+        return;
+    }
+
+    std::vector<build_reference> references = make_references(spheres, pool);
+    std::vector<build_reference> scratch(references.size());
+    const build_context context{ references, scratch, pool };
+
+    // A subtree over n spheres has at most 2n - 1 nodes, so every subtree gets that many slots up front
+    nodes_.resize(2 * references.size() - 1);
+    build_node(context, 0, 0, static_cast<std::uint32_t>(references.size()), 1);
+    compact();
+
+    store_primitives(spheres, references, pool);
+    index_leaves();
+}
+
+void bvh::refit(const std::vector<sphere>& spheres, const std::vector<std::uint32_t>& changed) {
+    for (std::uint32_t id : changed) {
+        std::uint32_t index = leaf_of_[id];
+        bvh_node& leaf = nodes_[index];
+
+        aabb bounds;
+        for (std::uint32_t i = leaf.left; i < leaf.left + leaf.count; i++) {
+            bvh_primitive& primitive = primitives_[i];
+            if (primitive.id == id) {
+                primitive.center = spheres[id].get_position();
+                primitive.radius = spheres[id].get_radius();
+            }
+            bounds.grow(aabb::of_sphere(primitive.center, primitive.radius));
+        }
+
+        // Walk up until a node keeps its bounds, everything above it is still up to date
+        while (true) {
+            bvh_node& node = nodes_[index];
+            if (bounds.min == node.bounds.min && bounds.max == node.bounds.max)
+                break;
+
+            weighted_area_ -= weighted_area(node);
+            node.bounds = bounds;
+            weighted_area_ += weighted_area(node);
+
+            index = node.parent;
+            if (index == invalid)
+                break;
+
+            bounds = nodes_[nodes_[index].left].bounds;
+            bounds.grow(nodes_[nodes_[index].right].bounds);
+        }
+    }
+}
+
+double bvh::get_degradation() const {
+    return built_weighted_area_ > 0 ? weighted_area_ / built_weighted_area_ : 1;
+}
+
+std::optional<hit_record> bvh::closest_hit(const bardrix::ray& ray, double t_min, double t_max) const {
+    if (nodes_.empty())
+        return std::nullopt;
+
+    const bardrix::point3& origin = ray.position;
+    const bardrix::vector3& direction = ray.get_direction();
+    const bardrix::vector3 inverse_direction(1 / direction.x, 1 / direction.y, 1 / direction.z);
+
+    struct entry {
+        std::uint32_t node;
+        double t;
+    };
+    entry stack[stack_size];
+    std::uint32_t stack_top = 0;
+
+    std::uint64_t visited = 0, tested = 0;
+    std::uint32_t closest = invalid;
+
+    double root_t;
+    if (nodes_[0].bounds.intersect(origin, inverse_direction, t_min, t_max, root_t))
+        stack[stack_top++] = { 0, root_t };
+
+    while (stack_top > 0) {
+        const entry current = stack[--stack_top];
+        if (current.t > t_max)
+            continue; // A nearer hit was found after this node was pushed
+
+        const bvh_node& node = nodes_[current.node];
+        visited++;
+
+        if (node.is_leaf()) {
+            for (std::uint32_t i = node.left; i < node.left + node.count; i++) {
+                double t;
+                tested++;
+                if (primitives_[i].intersect(origin, direction, t_min, t_max, t)) {
+                    t_max = t;
+                    closest = i;
+                }
+            }
+            continue;
+        }
+
+        double left_t, right_t;
+        const bool left_hit = nodes_[node.left].bounds.intersect(origin, inverse_direction, t_min, t_max, left_t);
+        const bool right_hit = nodes_[node.right].bounds.intersect(origin, inverse_direction, t_min, t_max, right_t);
+
+        // Push the far child first so the near child is visited first
+        if (left_hit && right_hit) {
+            if (left_t <= right_t) {
+                stack[stack_top++] = { node.right, right_t };
+                stack[stack_top++] = { node.left, left_t };
+            }
+            else {
+                stack[stack_top++] = { node.left, left_t };
+                stack[stack_top++] = { node.right, right_t };
+            }
+        }
+        else if (left_hit)
+            stack[stack_top++] = { node.left, left_t };
+        else if (right_hit)
+            stack[stack_top++] = { node.right, right_t };
+    }
+
+    count_traversal(visited, tested);
+
+    if (closest == invalid)
+        return std::nullopt;
+
+    return make_hit(closest, origin, direction, t_max);
+}
+
+namespace {
+
+    /// \brief The rays of a ray_packet, a source of packet_lanes and bvh::trace_closest
+    class packet_rays {
+    public:
+        explicit packet_rays(const ray_packet& packet) : packet_(packet) {}
+
+        NODISCARD int size() const { return packet_.size; }
+        NODISCARD double t_min() const { return packet_.t_min; }
+        NODISCARD const bardrix::point3& origin(int i) const { return packet_.origins[i]; }
+        NODISCARD const bardrix::vector3& direction(int i) const { return packet_.directions[i]; }
+        NODISCARD double t_max(int i) const { return packet_.t_max[i]; }
+
+    protected:
+        const ray_packet& packet_;
+    };
+
+    /// \brief Up to ray_packet::max_size consecutive rays of a ray_queue, read straight from its arrays
+    class queue_rays {
+    public:
+        queue_rays(const ray_queue& rays, std::size_t first)
+            : rays_(rays), first_(first),
+              size_(static_cast<int>(std::min<std::size_t>(ray_packet::max_size, rays.size() - first))) {}
+
+        NODISCARD int size() const { return size_; }
+        NODISCARD double t_min() const { return 0; }
+        NODISCARD bardrix::point3 origin(int i) const { return rays_.origin(first_ + i); }
+        NODISCARD bardrix::vector3 direction(int i) const { return rays_.direction(first_ + i); }
+        NODISCARD double t_max(int i) const { return rays_.t_max[first_ + i]; }
+
+    protected:
+        const ray_queue& rays_;
+        std::size_t first_;
+        int size_;
+    };
+
+    /// \brief The rays of a packet as 8 float lanes, with the interval frustum of the packet
+    class packet_lanes {
+    public:
+        using lane = simd::vfloat<ray_packet::max_size>;
+
+        /// \brief Bit i is set for every ray of the packet
+        std::uint32_t active;
+
+        /// \brief Sets up the lanes, lanes without a ray copy the first one and are left out of active
+        /// \param source The rays, packet_rays or queue_rays
+        template<typename rays>
+        explicit packet_lanes(const rays& source) : t_min_(source.t_min()) {
+            float lanes[10][ray_packet::max_size];
+            for (int i = 0; i < ray_packet::max_size; i++) {
+                const int ray = i < source.size() ? i : 0;
+                const bardrix::point3 origin = source.origin(ray);
+                const bardrix::vector3 direction = source.direction(ray);
+                lanes[0][i] = static_cast<float>(origin.x);
+                lanes[1][i] = static_cast<float>(origin.y);
+                lanes[2][i] = static_cast<float>(origin.z);
+                lanes[3][i] = static_cast<float>(1 / direction.x);
+                lanes[4][i] = static_cast<float>(1 / direction.y);
+                lanes[5][i] = static_cast<float>(1 / direction.z);
+                lanes[6][i] = static_cast<float>(direction.x);
+                lanes[7][i] = static_cast<float>(direction.y);
+                lanes[8][i] = static_cast<float>(direction.z);
+                maximum_[i] = static_cast<float>(source.t_max(ray));
+            }
+
+            origin_x_ = lane::loadu(lanes[0]), origin_y_ = lane::loadu(lanes[1]), origin_z_ = lane::loadu(lanes[2]);
+            inverse_x_ = lane::loadu(lanes[3]), inverse_y_ = lane::loadu(lanes[4]), inverse_z_ = lane::loadu(lanes[5]);
+            direction_x_ = lane::loadu(lanes[6]), direction_y_ = lane::loadu(lanes[7]);
+            direction_z_ = lane::loadu(lanes[8]);
+            minimum_ = lane(static_cast<float>(t_min_));
+            active = (1u << source.size()) - 1;
+
+            // The frustum, only when every axis has a single direction sign over all rays
+            coherent_ = true;
+            for (int axis = 0; axis < 3; axis++) {
+                origin_low_[axis] = inverse_low_[axis] = std::numeric_limits<double>::infinity();
+                origin_high_[axis] = inverse_high_[axis] = -std::numeric_limits<double>::infinity();
+                for (int i = 0; i < source.size(); i++) {
+                    const bardrix::vector3 d = source.direction(i);
+                    const double inverse = 1 / (axis == 0 ? d.x : axis == 1 ? d.y : d.z);
+                    const double origin = aabb::axis_of(source.origin(i), axis);
+                    origin_low_[axis] = std::min(origin_low_[axis], origin);
+                    origin_high_[axis] = std::max(origin_high_[axis], origin);
+                    inverse_low_[axis] = std::min(inverse_low_[axis], inverse);
+                    inverse_high_[axis] = std::max(inverse_high_[axis], inverse);
+                }
+                coherent_ = coherent_ && std::isfinite(inverse_low_[axis]) && std::isfinite(inverse_high_[axis]) &&
+                            (inverse_low_[axis] > 0 || inverse_high_[axis] < 0);
+            }
+            t_max_ = source.t_max(0);
+            for (int i = 1; i < source.size(); i++)
+                t_max_ = std::max(t_max_, source.t_max(i));
+        }
+
+        /// \brief Shortens a ray after a hit, so the slab test skips boxes behind the hit
+        void shorten(int ray, double t) { maximum_[ray] = static_cast<float>(t); }
+
+        /// \brief Tests a box against all active rays
+        /// \return Bit i is set when ray i may hit the box
+        NODISCARD std::uint32_t slab(const aabb& bounds) const {
+            if (coherent_ && frustum_misses(bounds))
+                return 0;
+
+            // A little slack for the single precision, the spheres are tested exactly
+            const lane x0 = (lane(static_cast<float>(bounds.min.x)) - origin_x_) * inverse_x_;
+            const lane x1 = (lane(static_cast<float>(bounds.max.x)) - origin_x_) * inverse_x_;
+            const lane y0 = (lane(static_cast<float>(bounds.min.y)) - origin_y_) * inverse_y_;
+            const lane y1 = (lane(static_cast<float>(bounds.max.y)) - origin_y_) * inverse_y_;
+            const lane z0 = (lane(static_cast<float>(bounds.min.z)) - origin_z_) * inverse_z_;
+            const lane z1 = (lane(static_cast<float>(bounds.max.z)) - origin_z_) * inverse_z_;
+            const lane entry = simd::max(simd::max(minimum_, simd::min(x0, x1)),
+                                         simd::max(simd::min(y0, y1), simd::min(z0, z1)));
+            const lane exit = simd::min(simd::min(lane::loadu(maximum_), simd::max(x0, x1)),
+                                        simd::min(simd::max(y0, y1), simd::max(z0, z1)));
+            return (entry <= exit * lane(1 + 1e-6f) + lane(1e-6f)).bits() & active;
+        }
+
+        /// \brief Tests a sphere against the rays of a mask in single precision
+        /// \return Bit i is set when ray i may hit the sphere before its current hit, every ray that hits it in
+        ///         double precision is included, the others are mostly grazing rays
+        NODISCARD std::uint32_t sphere(const bvh_primitive& primitive, std::uint32_t mask) const {
+            const lane to_x = lane(static_cast<float>(primitive.center.x)) - origin_x_;
+            const lane to_y = lane(static_cast<float>(primitive.center.y)) - origin_y_;
+            const lane to_z = lane(static_cast<float>(primitive.center.z)) - origin_z_;
+            const lane b = to_x * direction_x_ + to_y * direction_y_ + to_z * direction_z_;
+
+            // The squared distance of the center to the ray, unlike b^2 - |to|^2 it keeps its precision in floats
+            const lane off_x = to_x - b * direction_x_;
+            const lane off_y = to_y - b * direction_y_;
+            const lane off_z = to_z - b * direction_z_;
+            const lane radius_squared(static_cast<float>(primitive.radius * primitive.radius));
+            const lane discriminant = radius_squared - (off_x * off_x + off_y * off_y + off_z * off_z);
+
+            // Widen the discriminant and the interval by the rounding, so the root is never too short
+            const lane slack = radius_squared * lane(1e-3f) + lane(1e-5f);
+            const lane root = simd::sqrt(simd::max(discriminant + slack, lane(0.0f)));
+            const lane maximum = lane::loadu(maximum_);
+            const auto hits = (discriminant + slack >= lane(0.0f)) &
+                              (b - root <= maximum * lane(1 + 1e-5f) + lane(1e-4f)) &
+                              (b + root >= minimum_ - lane(1e-4f));
+            return hits.bits() & mask;
+        }
+
+    protected:
+        /// \brief If no ray of the packet can hit the box, with interval arithmetic over all rays at once
+        NODISCARD bool frustum_misses(const aabb& bounds) const {
+            double entry = t_min_, exit = t_max_;
+            for (int axis = 0; axis < 3; axis++) {
+                const bool positive = inverse_low_[axis] > 0;
+                const double near = aabb::axis_of(positive ? bounds.min : bounds.max, axis);
+                const double far = aabb::axis_of(positive ? bounds.max : bounds.min, axis);
+
+                // (plane - origin) * inverse over the intervals, the extremes are at the corners
+                const double near_products[4] = {
+                    (near - origin_low_[axis]) * inverse_low_[axis], (near - origin_low_[axis]) * inverse_high_[axis],
+                    (near - origin_high_[axis]) * inverse_low_[axis], (near - origin_high_[axis]) * inverse_high_[axis] };
+                const double far_products[4] = {
+                    (far - origin_low_[axis]) * inverse_low_[axis], (far - origin_low_[axis]) * inverse_high_[axis],
+                    (far - origin_high_[axis]) * inverse_low_[axis], (far - origin_high_[axis]) * inverse_high_[axis] };
+                entry = std::max(entry, *std::min_element(near_products, near_products + 4));
+                exit = std::min(exit, *std::max_element(far_products, far_products + 4));
+            }
+            return entry > exit;
+        }
+
+        double t_min_;
+        lane origin_x_, origin_y_, origin_z_, inverse_x_, inverse_y_, inverse_z_, minimum_;
+        lane direction_x_, direction_y_, direction_z_;
+        float maximum_[ray_packet::max_size];
+        bool coherent_;
+        double origin_low_[3], origin_high_[3], inverse_low_[3], inverse_high_[3], t_max_;
+    };
+
+} // namespace
+
+template<typename rays>
+void bvh::trace_closest(const rays& source, double* t_max, std::uint32_t* closest) const {
+    packet_lanes lanes(source);
+    for (int i = 0; i < source.size(); i++)
+        t_max[i] = source.t_max(i);
+    std::fill(closest, closest + ray_packet::max_size, invalid);
+
+    std::uint32_t stack[stack_size];
+    std::uint32_t stack_top = 0;
+    stack[stack_top++] = 0;
+
+    std::uint64_t visited = 0, tested = 0;
+    const bardrix::vector3 lead = source.direction(0);
+
+    while (stack_top > 0) {
+        const bvh_node& node = nodes_[stack[--stack_top]];
+        visited++;
+
+        const std::uint32_t mask = lanes.slab(node.bounds);
+        if (mask == 0)
+            continue;
+
+        if (node.is_leaf()) {
+            for (std::uint32_t p = node.left; p < node.left + node.count; p++) {
+                // All rays at once in single precision, the candidates are refined in double precision
+                tested += std::popcount(mask);
+                for (std::uint32_t bits = lanes.sphere(primitives_[p], mask); bits != 0; bits &= bits - 1) {
+                    const int i = simd::first_bit(bits);
+                    double t;
+                    if (primitives_[p].intersect(source.origin(i), source.direction(i), source.t_min(), t_max[i], t)) {
+                        t_max[i] = t;
+                        closest[i] = p;
+                        lanes.shorten(i, t);
+                    }
+                }
+            }
+            continue;
+        }
+
+        // Visit the child nearest along the first ray first
+        const bardrix::point3 left = nodes_[node.left].bounds.center(), right = nodes_[node.right].bounds.center();
+        const bool left_first = left.vector_to(right).dot(lead) >= 0;
+        stack[stack_top++] = left_first ? node.right : node.left;
+        stack[stack_top++] = left_first ? node.left : node.right;
+    }
+
+    count_traversal(visited, tested, static_cast<std::uint64_t>(source.size()));
+}
+
+void bvh::closest_hits(const ray_packet& packet, packet_hits& hits) const {
+    hits.fill(std::nullopt);
+    if (nodes_.empty() || packet.size == 0)
+        return;
+
+    double t_max[ray_packet::max_size];
+    std::uint32_t closest[ray_packet::max_size];
+    trace_closest(packet_rays(packet), t_max, closest);
+
+    for (int i = 0; i < packet.size; i++)
+        if (closest[i] != invalid)
+            hits[i] = make_hit(closest[i], packet.origins[i], packet.directions[i], t_max[i]);
+}
+
+void bvh::closest_hits(const ray_queue& rays, hit_queue& hits) const {
+    if (nodes_.empty())
+        return;
+
+    double t_max[ray_packet::max_size];
+    std::uint32_t closest[ray_packet::max_size];
+    for (std::size_t first = 0; first < rays.size(); first += ray_packet::max_size) {
+        const queue_rays source(rays, first);
+        trace_closest(source, t_max, closest);
+
+        for (int i = 0; i < source.size(); i++) {
+            if (closest[i] == invalid)
+                continue;
+
+            const bvh_primitive& primitive = primitives_[closest[i]];
+            const bardrix::point3 point = source.origin(i) + source.direction(i) * t_max[i];
+            hits.push(point, primitive.center.vector_to(point) * (1 / primitive.radius), primitive.id, rays,
+                      first + i);
+        }
+    }
+}
+
+bool bvh::any_hit(const bardrix::ray& ray, double t_min, double t_max) const {
+    if (nodes_.empty())
+        return false;
+
+    const bardrix::point3& origin = ray.position;
+    const bardrix::vector3& direction = ray.get_direction();
+    const bardrix::vector3 inverse_direction(1 / direction.x, 1 / direction.y, 1 / direction.z);
+
+    std::uint32_t stack[stack_size];
+    std::uint32_t stack_top = 0;
+    stack[stack_top++] = 0;
+
+    std::uint64_t visited = 0, tested = 0;
+    bool blocked = false;
+
+    // Any blocker will do, so the children are visited in any order
+    while (stack_top > 0 && !blocked) {
+        const bvh_node& node = nodes_[stack[--stack_top]];
+        visited++;
+
+        double entry;
+        if (!node.bounds.intersect(origin, inverse_direction, t_min, t_max, entry))
+            continue;
+
+        if (!node.is_leaf()) {
+            stack[stack_top++] = node.right;
+            stack[stack_top++] = node.left;
+            continue;
+        }
+
+        for (std::uint32_t i = node.left; i < node.left + node.count && !blocked; i++) {
+            tested++;
+            blocked = primitives_[i].occludes(origin, direction, t_min, t_max);
+        }
+    }
+
+    count_traversal(visited, tested);
+    return blocked;
+}
+
+std::uint32_t bvh::any_hits(const ray_packet& packet) const {
+    if (nodes_.empty() || packet.size == 0)
+        return 0;
+
+    packet_lanes lanes{ packet_rays(packet) };
+    std::uint32_t blocked = 0;
+
+    std::uint32_t stack[stack_size];
+    std::uint32_t stack_top = 0;
+    stack[stack_top++] = 0;
+
+    std::uint64_t visited = 0, tested = 0;
+
+    // Rays leave the packet at their first blocker, the traversal ends when none are left
+    while (stack_top > 0 && lanes.active != 0) {
+        const bvh_node& node = nodes_[stack[--stack_top]];
+        visited++;
+
+        const std::uint32_t mask = lanes.slab(node.bounds);
+        if (mask == 0)
+            continue;
+
+        if (!node.is_leaf()) {
+            stack[stack_top++] = node.right;
+            stack[stack_top++] = node.left;
+            continue;
+        }
+
+        for (std::uint32_t bits = mask; bits != 0; bits &= bits - 1) {
+            const int i = simd::first_bit(bits);
+            for (std::uint32_t p = node.left; p < node.left + node.count; p++) {
+                tested++;
+                if (primitives_[p].occludes(packet.origins[i], packet.directions[i], packet.t_min, packet.t_max[i])) {
+                    blocked |= 1u << i;
+                    break;
+                }
+            }
+        }
+        lanes.active &= ~blocked;
+    }
+
+    count_traversal(visited, tested, static_cast<std::uint64_t>(packet.size));
+    return blocked;
+}
+
+hit_record bvh::make_hit(std::uint32_t primitive, const bardrix::point3& origin, const bardrix::vector3& direction,
+                         double t) const {
+    hit_record record;
+    record.t = t;
+    record.id = primitives_[primitive].id;
+    record.normal = primitives_[primitive].center.vector_to(origin + direction * t) * (1 / primitives_[primitive].radius);
+    return record;
+}
+
+void bvh::for_each_chunk(thread_pool* pool, std::uint32_t begin, std::uint32_t end,
+                         const std::function<void(std::size_t, std::uint32_t, std::uint32_t)>& function) {
+    const std::size_t chunks = (end - begin + chunk_size - 1) / chunk_size;
+    auto run = [&](std::size_t first, std::size_t last) {
+        for (std::size_t chunk = first; chunk < last; chunk++) {
+            const auto chunk_begin = static_cast<std::uint32_t>(begin + chunk * chunk_size);
+            function(chunk, chunk_begin, std::min(chunk_begin + chunk_size, end));
+        }
+    };
+
+    if (pool != nullptr)
+        pool->parallel_for(0, chunks, 1, run);
+    else
+        run(0, chunks);
+}
+
+std::vector<bvh::build_reference> bvh::make_references(const std::vector<sphere>& spheres, thread_pool* pool) {
+    std::vector<build_reference> references(spheres.size());
+    for_each_chunk(pool, 0, static_cast<std::uint32_t>(spheres.size()),
+        [&](std::size_t, std::uint32_t begin, std::uint32_t end) {
+            for (std::uint32_t i = begin; i < end; i++) {
+                references[i].bounds = aabb::of_sphere(spheres[i].get_position(), spheres[i].get_radius());
+                references[i].centroid = spheres[i].get_position();
+                references[i].id = i;
+            }
+        });
+    return references;
+}
+
+void bvh::store_primitives(const std::vector<sphere>& spheres, const std::vector<build_reference>& references,
+                           thread_pool* pool) {
+    primitives_.resize(references.size());
+    for_each_chunk(pool, 0, static_cast<std::uint32_t>(references.size()),
+        [&](std::size_t, std::uint32_t begin, std::uint32_t end) {
+            for (std::uint32_t i = begin; i < end; i++) {
+                const sphere& s = spheres[references[i].id];
+                primitives_[i] = { s.get_position(), s.get_radius(), references[i].id };
+            }
+        });
+}
+
+void bvh::build_node(const build_context& context, std::uint32_t index, std::uint32_t begin, std::uint32_t end,
+                     std::uint32_t depth) {
+    aabb bounds, centroid_bounds;
+    compute_bounds(context, begin, end, bounds, centroid_bounds);
+    nodes_[index].bounds = bounds;
+
+    const std::uint32_t count = end - begin;
+    if (count == 1) {
+        make_leaf(index, begin, end);
+        return;
+    }
+
+    int axis = 0, split = 0;
+    const double split_cost = depth < max_sah_depth
+        ? find_split(bin_references(context, begin, end, centroid_bounds), bounds, centroid_bounds, axis, split)
+        : std::numeric_limits<double>::infinity();
+
+    if (count <= max_leaf_size && split_cost >= intersection_cost * count) {
+        make_leaf(index, begin, end);
+        return;
+    }
+
+    std::uint32_t middle;
+    if (split_cost < std::numeric_limits<double>::infinity())
+        middle = partition(context, begin, end, centroid_bounds, axis, split);
+    else {
+        // No usable plane (all centers equal or too deep), split the references in halves along the widest axis
+        axis = 0;
+        for (int a = 1; a < 3; a++)
+            if (centroid_bounds.extent(a) > centroid_bounds.extent(axis))
+                axis = a;
+
+        middle = begin + count / 2;
+        std::nth_element(context.references.begin() + begin, context.references.begin() + middle,
+            context.references.begin() + end, [axis](const build_reference& a, const build_reference& b) {
+                return aabb::axis_of(a.centroid, axis) < aabb::axis_of(b.centroid, axis);
+            });
+    }
+
+    // The left subtree takes the slots right after this node, the right subtree the ones after that
+    const std::uint32_t left = index + 1;
+    const std::uint32_t right = index + 2 * (middle - begin);
+    nodes_[left].parent = index;
+    nodes_[right].parent = index;
+    nodes_[index].left = left;
+    nodes_[index].right = right;
+    nodes_[index].count = 0;
+
+    if (context.pool != nullptr && count >= spawn_threshold) {
+        task_group group;
+        context.pool->run(group, [&] { build_node(context, left, begin, middle, depth + 1); });
+        build_node(context, right, middle, end, depth + 1);
+        context.pool->wait(group);
+    }
+    else {
+        build_node(context, left, begin, middle, depth + 1);
+        build_node(context, right, middle, end, depth + 1);
+    }
+}
+
+void bvh::compute_bounds(const build_context& context, std::uint32_t begin, std::uint32_t end, aabb& bounds,
+                         aabb& centroid_bounds) {
+    auto bound = [&](std::uint32_t first, std::uint32_t last, aabb& result, aabb& centroid_result) {
+        for (std::uint32_t i = first; i < last; i++) {
+            result.grow(context.references[i].bounds);
+            centroid_result.grow(context.references[i].centroid);
+        }
+    };
+
+    if (end - begin < parallel_threshold) {
+        bound(begin, end, bounds, centroid_bounds);
+        return;
+    }
+
+    // Every chunk writes its own slot, the slots are merged afterwards so no locking is needed
+    std::vector<aabb> chunk_bounds((end - begin + chunk_size - 1) / chunk_size);
+    std::vector<aabb> chunk_centroid_bounds(chunk_bounds.size());
+    for_each_chunk(context.pool, begin, end, [&](std::size_t chunk, std::uint32_t first, std::uint32_t last) {
+        bound(first, last, chunk_bounds[chunk], chunk_centroid_bounds[chunk]);
+    });
+
+    for (std::size_t chunk = 0; chunk < chunk_bounds.size(); chunk++) {
+        bounds.grow(chunk_bounds[chunk]);
+        centroid_bounds.grow(chunk_centroid_bounds[chunk]);
+    }
+}
+
+bvh::bin_set bvh::bin_references(const build_context& context, std::uint32_t begin, std::uint32_t end,
+                                 const aabb& centroid_bounds) {
+    auto bin = [&](std::uint32_t first, std::uint32_t last, bin_set& result) {
+        for (int axis = 0; axis < 3; axis++) {
+            if (centroid_bounds.extent(axis) <= 0)
+                continue;
+
+            const double minimum = aabb::axis_of(centroid_bounds.min, axis);
+            const double scale = bins / centroid_bounds.extent(axis);
+            for (std::uint32_t i = first; i < last; i++) {
+                const int b = bin_of(aabb::axis_of(context.references[i].centroid, axis), minimum, scale);
+                result.bounds[axis][b].grow(context.references[i].bounds);
+                result.counts[axis][b]++;
+            }
+        }
+    };
+
+    bin_set result;
+    if (end - begin < parallel_threshold) {
+        bin(begin, end, result);
+        return result;
+    }
+
+    // Per chunk bins, merged afterwards (min/max and integer sums, so the merge order doesn't matter)
+    std::vector<bin_set> chunk_bins((end - begin + chunk_size - 1) / chunk_size);
+    for_each_chunk(context.pool, begin, end, [&](std::size_t chunk, std::uint32_t first, std::uint32_t last) {
+        bin(first, last, chunk_bins[chunk]);
+    });
+
+    for (const bin_set& chunk : chunk_bins)
+        for (int axis = 0; axis < 3; axis++)
+            for (int b = 0; b < bins; b++) {
+                result.bounds[axis][b].grow(chunk.bounds[axis][b]);
+                result.counts[axis][b] += chunk.counts[axis][b];
+            }
+
+    return result;
+}
+
+double bvh::find_split(const bin_set& binned, const aabb& bounds, const aabb& centroid_bounds, int& axis,
+                       int& split) {
+    double best_cost = std::numeric_limits<double>::infinity();
+    const double area = bounds.surface_area();
+
+    for (int a = 0; a < 3; a++) {
+        if (centroid_bounds.extent(a) <= 0)
+            continue;
+
+        const aabb* bin_bounds = binned.bounds[a];
+        const std::uint32_t* bin_counts = binned.counts[a];
+
+        // Sweep from the right to get the area and count of every right side
+        double right_area[bins];
+        std::uint32_t right_count[bins];
+        aabb right_bounds;
+        std::uint32_t count = 0;
+        for (int b = bins - 1; b > 0; b--) {
+            right_bounds.grow(bin_bounds[b]);
+            count += bin_counts[b];
+            right_area[b] = right_bounds.surface_area();
+            right_count[b] = count;
+        }
+
+        // Sweep from the left and evaluate the plane in front of every bin
+        aabb left_bounds;
+        std::uint32_t left_count = 0;
+        for (int b = 1; b < bins; b++) {
+            left_bounds.grow(bin_bounds[b - 1]);
+            left_count += bin_counts[b - 1];
+            if (left_count == 0 || right_count[b] == 0)
+                continue;
+
+            const double cost = traversal_cost + intersection_cost *
+                (left_bounds.surface_area() * left_count + right_area[b] * right_count[b]) / area;
+            if (cost < best_cost) {
+                best_cost = cost;
+                axis = a;
+                split = b;
+            }
+        }
+    }
+
+    return best_cost;
+}
+
+std::uint32_t bvh::partition(const build_context& context, std::uint32_t begin, std::uint32_t end,
+                             const aabb& centroid_bounds, int axis, int split) {
+    const double minimum = aabb::axis_of(centroid_bounds.min, axis);
+    const double scale = bins / centroid_bounds.extent(axis);
+    auto is_left = [&](const build_reference& reference) {
+        return bin_of(aabb::axis_of(reference.centroid, axis), minimum, scale) < split;
+    };
+
+    if (end - begin < parallel_threshold) {
+        auto it = std::partition(context.references.begin() + begin, context.references.begin() + end, is_left);
+        return static_cast<std::uint32_t>(it - context.references.begin());
+    }
+
+    // Count the left references per chunk, then every chunk scatters into its own range of the scratch space
+    std::vector<std::uint32_t> left_counts((end - begin + chunk_size - 1) / chunk_size);
+    for_each_chunk(context.pool, begin, end, [&](std::size_t chunk, std::uint32_t first, std::uint32_t last) {
+        left_counts[chunk] = static_cast<std::uint32_t>(std::count_if(context.references.begin() + first,
+                                                                      context.references.begin() + last, is_left));
+    });
+
+    std::vector<std::uint32_t> left_offsets(left_counts.size()), right_offsets(left_counts.size());
+    std::uint32_t total_left = 0;
+    for (std::size_t chunk = 0; chunk < left_counts.size(); chunk++) {
+        left_offsets[chunk] = begin + total_left;
+        total_left += left_counts[chunk];
+    }
+    const std::uint32_t middle = begin + total_left;
+    for (std::size_t chunk = 0; chunk < left_counts.size(); chunk++)
+        right_offsets[chunk] = middle + static_cast<std::uint32_t>(chunk * chunk_size) -
+                               (left_offsets[chunk] - begin);
+
+    for_each_chunk(context.pool, begin, end, [&](std::size_t chunk, std::uint32_t first, std::uint32_t last) {
+        std::uint32_t left = left_offsets[chunk], right = right_offsets[chunk];
+        for (std::uint32_t i = first; i < last; i++) {
+            const build_reference& reference = context.references[i];
+            context.scratch[is_left(reference) ? left++ : right++] = reference;
+        }
+    });
+
+    for_each_chunk(context.pool, begin, end, [&](std::size_t, std::uint32_t first, std::uint32_t last) {
+        std::copy(context.scratch.begin() + first, context.scratch.begin() + last, context.references.begin() + first);
+    });
+
+    return middle;
+}
+
+int bvh::bin_of(double value, double minimum, double scale) {
+    return std::clamp(static_cast<int>((value - minimum) * scale), 0, bins - 1);
+}
+
+void bvh::make_leaf(std::uint32_t index, std::uint32_t begin, std::uint32_t end) {
+    nodes_[index].left = begin;
+    nodes_[index].count = end - begin;
+}
+
+void bvh::compact() {
+    // Count the used slots first, only the nodes that are kept get memory next to the slots of the build
+    std::size_t used = 0;
+    std::vector<std::uint32_t> pending = { 0 };
+    while (!pending.empty()) {
+        const bvh_node& node = nodes_[pending.back()];
+        pending.pop_back();
+        used++;
+        if (!node.is_leaf()) {
+            pending.push_back(node.left);
+            pending.push_back(node.right);
+        }
+    }
+
+    std::vector<bvh_node> compacted;
+    compacted.reserve(used);
+    compacted.push_back(nodes_[0]);
+    compacted[0].parent = invalid;
+
+    // Depth first, the children of a node are placed as a pair
+    struct entry {
+        std::uint32_t slot;
+        std::uint32_t index;
+    };
+    std::vector<entry> stack = { { 0, 0 } };
+
+    while (!stack.empty()) {
+        const entry current = stack.back();
+        stack.pop_back();
+
+        const bvh_node& node = nodes_[current.slot];
+        if (node.is_leaf())
+            continue;
+
+        const auto left = static_cast<std::uint32_t>(compacted.size());
+        compacted.push_back(nodes_[node.left]);
+        compacted.push_back(nodes_[node.right]);
+        compacted[left].parent = current.index;
+        compacted[left + 1].parent = current.index;
+        compacted[current.index].left = left;
+        compacted[current.index].right = left + 1;
+
+        stack.push_back({ node.right, left + 1 });
+        stack.push_back({ node.left, left });
+    }
+
+    nodes_ = std::move(compacted);
+}
+
+void bvh::build_linear(const std::vector<sphere>& spheres, thread_pool* pool, int bits) {
+    const auto count = static_cast<std::uint32_t>(spheres.size());
+
+    // Quantize the centers within the bounds of all centers
+    aabb centroid_bounds;
+    for (const sphere& s : spheres)
+        centroid_bounds.grow(s.get_position());
+
+    const double cells = bits == 30 ? 1023.0 : 2097151.0;
+    const bardrix::vector3 scale(
+        centroid_bounds.extent(0) > 0 ? cells / centroid_bounds.extent(0) : 0,
+        centroid_bounds.extent(1) > 0 ? cells / centroid_bounds.extent(1) : 0,
+        centroid_bounds.extent(2) > 0 ? cells / centroid_bounds.extent(2) : 0);
+
+    std::vector<std::uint64_t> codes(count);
+    std::vector<std::uint32_t> order(count);
+    for_each_chunk(pool, 0, count, [&](std::size_t, std::uint32_t begin, std::uint32_t end) {
+        for (std::uint32_t i = begin; i < end; i++) {
+            const bardrix::vector3 offset = centroid_bounds.min.vector_to(spheres[i].get_position());
+            const auto x = static_cast<std::uint32_t>(offset.x * scale.x);
+            const auto y = static_cast<std::uint32_t>(offset.y * scale.y);
+            const auto z = static_cast<std::uint32_t>(offset.z * scale.z);
+            codes[i] = bits == 30 ? morton::encode30(x, y, z) : morton::encode63(x, y, z);
+            order[i] = i;
+        }
+    });
+
+    morton::radix_sort(codes, order, bits, pool);
+
+    primitives_.resize(count);
+    for_each_chunk(pool, 0, count, [&](std::size_t, std::uint32_t begin, std::uint32_t end) {
+        for (std::uint32_t i = begin; i < end; i++) {
+            const sphere& s = spheres[order[i]];
+            primitives_[i] = { s.get_position(), s.get_radius(), order[i] };
+        }
+    });
+
+    // Internal nodes take slots [0, count - 1), leaf i takes slot count - 1 + i
+    nodes_.assign(2 * static_cast<std::size_t>(count) - 1, {});
+    const std::uint32_t leaves = count - 1;
+    for_each_chunk(pool, 0, count, [&](std::size_t, std::uint32_t begin, std::uint32_t end) {
+        for (std::uint32_t i = begin; i < end; i++) {
+            bvh_node& leaf = nodes_[leaves + i];
+            leaf.bounds = aabb::of_sphere(primitives_[i].center, primitives_[i].radius);
+            leaf.left = i;
+            leaf.count = 1;
+        }
+    });
+
+    if (count == 1)
+        return;
+
+    // Length of the common prefix of the codes of leaves i and j, equal codes are told apart by their index
+    auto prefix = [&](std::int64_t i, std::int64_t j) -> int {
+        if (j < 0 || j >= count)
+            return -1;
+        if (codes[i] == codes[j])
+            return 64 + std::countl_zero(static_cast<std::uint32_t>(i ^ j));
+        return std::countl_zero(codes[i] ^ codes[j]);
+    };
+
+    // Every internal node finds the range of leaves it covers and where that range splits, independent of the others
+    for_each_chunk(pool, 0, count - 1, [&](std::size_t, std::uint32_t begin, std::uint32_t end) {
+        for (std::int64_t i = begin; i < end; i++) {
+            const int direction = prefix(i, i + 1) - prefix(i, i - 1) >= 0 ? 1 : -1;
+            const int minimum_prefix = prefix(i, i - direction);
+
+            // Upper bound for the length of the range, then binary search the other end
+            std::int64_t maximum_length = 2;
+            while (prefix(i, i + maximum_length * direction) > minimum_prefix)
+                maximum_length *= 2;
+
+            std::int64_t length = 0;
+            for (std::int64_t step = maximum_length / 2; step >= 1; step /= 2)
+                if (prefix(i, i + (length + step) * direction) > minimum_prefix)
+                    length += step;
+            const std::int64_t j = i + length * direction;
+
+            // Binary search the last leaf that shares more than the common prefix of the range with leaf i
+            const int node_prefix = prefix(i, j);
+            std::int64_t split = 0;
+            for (std::int64_t step = (length + 1) / 2; ; step = (step + 1) / 2) {
+                if (prefix(i, i + (split + step) * direction) > node_prefix)
+                    split += step;
+                if (step == 1)
+                    break;
+            }
+            const std::int64_t gamma = i + split * direction + std::min(direction, 0);
+
+            bvh_node& node = nodes_[i];
+            node.left = static_cast<std::uint32_t>(std::min(i, j) == gamma ? leaves + gamma : gamma);
+            node.right = static_cast<std::uint32_t>(std::max(i, j) == gamma + 1 ? leaves + gamma + 1 : gamma + 1);
+            node.count = 0;
+            nodes_[node.left].parent = static_cast<std::uint32_t>(i);
+            nodes_[node.right].parent = static_cast<std::uint32_t>(i);
+        }
+    });
+    nodes_[0].parent = invalid;
+
+    // Bounds bottom up, the second child to arrive at a node computes its bounds and continues to the parent
+    std::vector<std::atomic<std::uint32_t>> arrivals(count - 1);
+    for_each_chunk(pool, 0, count, [&](std::size_t, std::uint32_t begin, std::uint32_t end) {
+        for (std::uint32_t i = begin; i < end; i++) {
+            std::uint32_t index = nodes_[leaves + i].parent;
+            while (index != invalid && arrivals[index].fetch_add(1, std::memory_order_acq_rel) == 1) {
+                bvh_node& node = nodes_[index];
+                node.bounds = nodes_[node.left].bounds;
+                node.bounds.grow(nodes_[node.right].bounds);
+                index = node.parent;
+            }
+        }
+    });
+}
+
+void bvh::index_leaves() {
+    leaf_of_.resize(primitives_.size());
+    weighted_area_ = 0;
+
+    for (std::uint32_t index = 0; index < nodes_.size(); index++) {
+        const bvh_node& node = nodes_[index];
+        weighted_area_ += weighted_area(node);
+        for (std::uint32_t i = node.left; i < node.left + node.count; i++)
+            leaf_of_[primitives_[i].id] = index;
+    }
+
+    built_weighted_area_ = weighted_area_;
+}
+
+double bvh::weighted_area(const bvh_node& node) {
+    return node.bounds.surface_area() * (node.is_leaf() ? intersection_cost * node.count : traversal_cost);
+}
@@ -0,0 +1,343 @@
+#pragma once
+
+#include "aabb.h"
+#include "accelerator.h"
+#include "sphere.h"
+#include "thread_pool.h"
+
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <vector>
+
+/// \brief A node of the bounding volume hierarchy, exactly one cache line
+struct bvh_node {
+    /// \brief The bounds of everything below this node
+    aabb bounds;
+
+    /// \brief The index of the left child, or the index of the first primitive for a leaf
+    std::uint32_t left = 0;
+
+    /// \brief The index of the right child, unused for a leaf
+    std::uint32_t right = 0;
+
+    /// \brief The amount of primitives in a leaf, 0 for an internal node
+    std::uint32_t count = 0;
+
+    /// \brief The index of the parent, bvh::invalid for the root
+    std::uint32_t parent = std::numeric_limits<std::uint32_t>::max();
+
+    /// \brief Checks if this node is a leaf
+    NODISCARD bool is_leaf() const { return count > 0; }
+};
+
+/// \brief Compact copy of a sphere, stored in the order the leaves reference them
+struct bvh_primitive {
+    /// \brief The center of the sphere
+    bardrix::point3 center;
+
+    /// \brief The radius of the sphere
+    double radius = 0;
+
+    /// \brief The index of the sphere in the scene
+    std::uint32_t id = 0;
+
+    /// \brief Intersects a ray with the sphere, same as sphere::hit without building a hit record
+    /// \param origin The origin of the ray
+    /// \param direction The normalized direction of the ray
+    /// \param t_min The minimum distance along the ray
+    /// \param t_max The maximum distance along the ray
+    /// \param t The distance to the intersection
+    /// \return If the ray hits the sphere within [t_min, t_max]
+    bool intersect(const bardrix::point3& origin, const bardrix::vector3& direction, double t_min, double t_max,
+                   double& t) const {
+        const bardrix::vector3 to_center = origin.vector_to(center);
+        const double b = to_center.dot(direction);
+        const double discriminant = b * b - to_center.dot(to_center) + radius * radius;
+        if (discriminant < 0)
+            return false;
+
+        const double root = std::sqrt(discriminant);
+        t = b - root;
+        if (t < t_min)
+            t = b + root;
+
+        return t >= t_min && t <= t_max;
+    }
+
+    /// \brief Checks if the sphere blocks a ray anywhere in [t_min, t_max], same as sphere::occludes
+    /// \param origin The origin of the ray
+    /// \param direction The normalized direction of the ray
+    /// \param t_min The minimum distance along the ray
+    /// \param t_max The maximum distance along the ray
+    /// \return If the part of the ray inside the sphere overlaps [t_min, t_max]
+    NODISCARD bool occludes(const bardrix::point3& origin, const bardrix::vector3& direction, double t_min,
+                            double t_max) const {
+        const bardrix::vector3 to_center = origin.vector_to(center);
+        const double b = to_center.dot(direction);
+        const double discriminant = b * b - to_center.dot(to_center) + radius * radius;
+        if (discriminant < 0)
+            return false;
+
+        const double root = std::sqrt(discriminant);
+        return b - root <= t_max && b + root >= t_min;
+    }
+};
+
+/// \brief The ways a bvh can be built
+enum class bvh_builder {
+    /// \brief Binned surface area heuristic, best trees
+    sah,
+
+    /// \brief Linear BVH over 30 bit Morton codes, fastest build
+    morton30,
+
+    /// \brief Linear BVH over 63 bit Morton codes, for scenes where 1024 cells per axis are too coarse
+    morton63,
+};
+
+/// \brief Bounding volume hierarchy over spheres, built with the surface area heuristic (SAH)
+/// \details Every split is chosen by binning the sphere centers along each axis and picking the plane with the
+///          lowest SAH cost, a node becomes a leaf when that is cheaper than splitting it.
+///          With a thread pool large nodes are bounded, binned and partitioned in parallel chunks and large subtrees
+///          are built as separate tasks. Chunks have a fixed size and every subtree owns a fixed range of node
+///          slots, so the tree is identical for any amount of threads.
+///          The Morton builders sort the sphere centers along a Z-order curve and emit the hierarchy in O(n) (Karras,
+///          "Maximizing parallelism in the construction of BVHs, octrees, and k-d trees"), with a single sphere per
+///          leaf. Their trees are worse than SAH trees, but can be rebuilt from scratch every frame.
+///          When a few spheres move the tree can be refit instead, only the bounds from their leaves up to the root
+///          are updated. The tree gets worse as the spheres drift away from where they were, get_degradation() tells
+///          when a rebuild pays off again.
+class bvh : public accelerator {
+public:
+    /// \brief The index used for "no node"
+    static constexpr std::uint32_t invalid = std::numeric_limits<std::uint32_t>::max();
+
+    /// \brief The maximum amount of spheres in a leaf
+    static constexpr std::uint32_t max_leaf_size = 4;
+
+    /// \brief The amount of bins per axis to evaluate the SAH with
+    static constexpr int bins = 16;
+
+    /// \brief Past this depth nodes are split at the median, this bounds the traversal stack
+    static constexpr std::uint32_t max_sah_depth = 96;
+
+    /// \brief The size of the traversal stack
+    static constexpr std::uint32_t stack_size = 128;
+
+    /// \brief Cost of visiting a node relative to testing a sphere, used by the SAH
+    static constexpr double traversal_cost = 1.0;
+
+    /// \brief Cost of testing a sphere, used by the SAH
+    static constexpr double intersection_cost = 1.0;
+
+    /// \brief Nodes with at least this many spheres are bounded, binned and partitioned in chunks (in parallel when
+    ///        there's a pool), the chunked partition is stable so it's used with and without a pool
+    static constexpr std::uint32_t parallel_threshold = 1u << 16;
+
+    /// \brief The amount of spheres per chunk, fixed so the chunks don't depend on the amount of threads
+    static constexpr std::uint32_t chunk_size = 1u << 14;
+
+    /// \brief Nodes with at least this many spheres build their left child as a separate task
+    static constexpr std::uint32_t spawn_threshold = 1u << 12;
+
+protected:
+    /// \brief The nodes, the root is node 0
+    std::vector<bvh_node> nodes_;
+
+    /// \brief The spheres in leaf order
+    std::vector<bvh_primitive> primitives_;
+
+    /// \brief The leaf of every sphere, indexed by the index of the sphere
+    std::vector<std::uint32_t> leaf_of_;
+
+    /// \brief weighted_area_ right after the build
+    double built_weighted_area_ = 0;
+
+    /// \brief The SAH cost times the surface area of the root, kept up to date by refit()
+    double weighted_area_ = 0;
+
+    /// \brief A sphere during the build
+    struct build_reference {
+        aabb bounds;
+        bardrix::point3 centroid;
+        std::uint32_t id;
+    };
+
+    /// \brief The bins of all three axes
+    struct bin_set {
+        aabb bounds[3][bins];
+        std::uint32_t counts[3][bins] = {};
+    };
+
+    /// \brief State shared by all nodes of a build
+    struct build_context {
+        /// \brief The spheres, partitioned in place
+        std::vector<build_reference>& references;
+
+        /// \brief Scratch space for the parallel partition, same size as references
+        std::vector<build_reference>& scratch;
+
+        /// \brief The threads to build on, nullptr to build on the calling thread only
+        thread_pool* pool;
+    };
+
+public:
+    // CONSTRUCTORS
+
+    /// \brief Default constructor for bvh (empty)
+    bvh() = default;
+
+    /// \brief Constructor for bvh, builds the hierarchy
+    /// \param spheres The spheres to build over, the index of a sphere is its id in the hit records
+    /// \param pool The threads to build on, nullptr to build on the calling thread only
+    /// \param builder The way to build the hierarchy
+    explicit bvh(const std::vector<sphere>& spheres, thread_pool* pool = nullptr,
+                 bvh_builder builder = bvh_builder::sah);
+
+    // GETTERS
+    NODISCARD const std::vector<bvh_node>& get_nodes() const;
+    NODISCARD const std::vector<bvh_primitive>& get_primitives() const;
+
+    /// \brief Gets the depth of the deepest leaf, the root has depth 1
+    /// \return The depth, computed by walking the tree
+    NODISCARD std::uint32_t get_depth() const;
+
+    /// \brief Gets the SAH cost of the tree, the expected cost of tracing a ray that hits the root
+    /// \return The SAH cost, lower is better
+    NODISCARD double sah_cost() const;
+
+    // BUILDING
+
+    /// \brief (Re)builds the hierarchy
+    /// \param spheres The spheres to build over
+    /// \param pool The threads to build on, nullptr to build on the calling thread only
+    /// \param builder The way to build the hierarchy
+    void build(const std::vector<sphere>& spheres, thread_pool* pool = nullptr, bvh_builder builder = bvh_builder::sah);
+
+    // UPDATING
+
+    /// \brief Updates the bounds on the paths from the leaves of the changed spheres to the root
+    /// \param spheres The spheres the hierarchy was built over, in their new state
+    /// \param changed The indices of the spheres that changed
+    /// \example positions[3] += offset; spheres[3].set_position(positions[3]); hierarchy.refit(spheres, { 3 });
+    void refit(const std::vector<sphere>& spheres, const std::vector<std::uint32_t>& changed) override;
+
+    /// \brief Gets the unnormalized SAH cost of the refit tree relative to the cost right after the build
+    /// \return 1 right after a build, grows as refit spheres move away from where they were
+    /// \details Not divided by the area of the root, so spheres that move outward don't make the tree look better.
+    NODISCARD double get_degradation() const override;
+
+    // RAYTRACING
+
+    NODISCARD std::optional<hit_record> closest_hit(const bardrix::ray& ray, double t_min,
+                                                    double t_max) const override;
+
+    /// \brief Traces the rays of a packet together, every node is tested against all rays at once (8 wide SIMD)
+    /// \details When the directions of the rays agree in sign per axis, a node is first tested against the
+    ///          interval of all origins and directions (the frustum of the packet), which rejects it for the whole
+    ///          packet with a single test.
+    ///          The spheres of a leaf are tested against all rays at once in single precision as well, only the rays
+    ///          that may hit a sphere test it again in double precision, so the hits are the same as closest_hit.
+    void closest_hits(const ray_packet& packet, packet_hits& hits) const override;
+
+    /// \brief Traces a queue in packets of ray_packet::max_size consecutive rays, see closest_hits
+    /// \details The lanes of a packet are loaded straight from the arrays of the queue and the hits are appended as
+    ///          they are found, no ray_packet or hit_record is built in between.
+    void closest_hits(const ray_queue& rays, hit_queue& hits) const override;
+
+    NODISCARD bool any_hit(const bardrix::ray& ray, double t_min, double t_max) const override;
+
+    /// \brief Traces the shadow rays of a packet together, see closest_hits
+    NODISCARD std::uint32_t any_hits(const ray_packet& packet) const override;
+
+protected:
+    /// \brief Runs a function over fixed size chunks of [begin, end), in parallel when there's a pool
+    /// \param pool The threads to run on, may be nullptr
+    /// \param begin The first index
+    /// \param end One past the last index
+    /// \param function Called with the chunk number and the range of the chunk
+    static void for_each_chunk(thread_pool* pool, std::uint32_t begin, std::uint32_t end,
+                               const std::function<void(std::size_t, std::uint32_t, std::uint32_t)>& function);
+
+    /// \brief Creates the build references of the spheres
+    /// \param spheres The spheres to build over
+    /// \param pool The threads to run on, may be nullptr
+    /// \return A reference per sphere
+    static std::vector<build_reference> make_references(const std::vector<sphere>& spheres, thread_pool* pool);
+
+    /// \brief Copies the spheres into primitives_ in the order of the references
+    void store_primitives(const std::vector<sphere>& spheres, const std::vector<build_reference>& references,
+                          thread_pool* pool);
+
+    /// \brief Builds a node and its children over references [begin, end)
+    /// \param context The state of the build
+    /// \param index The slot of the node, its subtree owns slots [index, index + 2 * (end - begin) - 1)
+    /// \param begin The first reference of the node
+    /// \param end One past the last reference of the node
+    /// \param depth The depth of the node
+    void build_node(const build_context& context, std::uint32_t index, std::uint32_t begin, std::uint32_t end,
+                    std::uint32_t depth);
+
+    /// \brief Computes the bounds of references [begin, end) and of their centroids
+    static void compute_bounds(const build_context& context, std::uint32_t begin, std::uint32_t end, aabb& bounds,
+                               aabb& centroid_bounds);
+
+    /// \brief Bins the centroids of references [begin, end) along all three axes
+    static bin_set bin_references(const build_context& context, std::uint32_t begin, std::uint32_t end,
+                                  const aabb& centroid_bounds);
+
+    /// \brief Finds the split with the lowest SAH cost
+    /// \param bins The binned references
+    /// \param bounds The bounds of the references
+    /// \param centroid_bounds The bounds of the centroids of the references
+    /// \param axis The axis of the best split
+    /// \param split The first bin on the right side of the best split
+    /// \return The SAH cost of the best split, infinity if the centroids can't be split
+    static double find_split(const bin_set& bins, const aabb& bounds, const aabb& centroid_bounds, int& axis,
+                             int& split);
+
+    /// \brief Moves the references left of the split before the ones right of it
+    /// \return The index of the first reference right of the split
+    static std::uint32_t partition(const build_context& context, std::uint32_t begin, std::uint32_t end,
+                                   const aabb& centroid_bounds, int axis, int split);
+
+    /// \brief Gets the bin of a centroid component
+    /// \param value The component of the centroid along the binned axis
+    /// \param minimum The minimum of the centroid bounds along the binned axis
+    /// \param scale bins / the extent of the centroid bounds along the binned axis
+    static int bin_of(double value, double minimum, double scale);
+
+    /// \brief Makes a node a leaf
+    void make_leaf(std::uint32_t index, std::uint32_t begin, std::uint32_t end);
+
+    /// \brief The traversal of closest_hits, shared by packets and queues
+    /// \tparam rays The source of the rays, see packet_rays and queue_rays in bvh.cpp
+    /// \param source The rays, at least one and at most ray_packet::max_size
+    /// \param t_max Set to the distance to the nearest hit of every ray, or to its maximum distance
+    /// \param closest Set to the primitive of the nearest hit of every ray, invalid for a miss
+    template<typename rays>
+    void trace_closest(const rays& source, double* t_max, std::uint32_t* closest) const;
+
+    /// \brief Builds the hit record of a ray that hits a primitive at distance t
+    /// \return The hit record, with the index of the sphere as id
+    NODISCARD hit_record make_hit(std::uint32_t primitive, const bardrix::point3& origin,
+                                  const bardrix::vector3& direction, double t) const;
+
+    /// \brief Removes the unused node slots and places siblings next to each other
+    void compact();
+
+    /// \brief Builds a linear BVH, see bvh_builder::morton30
+    /// \param spheres The spheres to build over, must not be empty
+    /// \param pool The threads to build on, may be nullptr
+    /// \param bits The amount of bits per Morton code, 30 or 63
+    void build_linear(const std::vector<sphere>& spheres, thread_pool* pool, int bits);
+
+    /// \brief Fills leaf_of_ and the costs that refit() starts from
+    void index_leaves();
+
+    /// \brief Gets the contribution of a node to the SAH cost, times the surface area of the root
+    NODISCARD static double weighted_area(const bvh_node& node);
+}; // class bvh
@@ -0,0 +1,347 @@
+#include "bvh8.h"
+
+#include "simd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+bvh8::bvh8(const std::vector<sphere>& spheres, thread_pool* pool, bvh_builder builder) {
+    collapse(bvh(spheres, pool, builder));
+}
+
+bvh8::bvh8(const bvh& binary) { collapse(binary); }
+
+const std::vector<bvh8_node>& bvh8::get_nodes() const { return nodes_; }
+
+const std::vector<bvh_primitive>& bvh8::get_primitives() const { return primitives_; }
+
+void bvh8::collapse(const bvh& binary) {
+    nodes_.clear();
+    bounds_.clear();
+    parents_.clear();
+    primitives_ = binary.get_primitives();
+    leaf_of_.assign(primitives_.size(), { invalid, 0 });
+
+    const std::vector<bvh_node>& source = binary.get_nodes();
+    if (source.empty())
+        return;
+
+    // Breadth first, so the children of a node are next to each other and always come after it
+    std::vector<std::uint32_t> sources = { 0 };
+    nodes_.emplace_back();
+    parents_.push_back(invalid);
+
+    for (std::uint32_t index = 0; index < nodes_.size(); index++) {
+        // Open the internal child with the largest surface area until there are eight children
+        std::vector<std::uint32_t> children;
+        if (source[sources[index]].is_leaf())
+            children.push_back(sources[index]); // Only for a root that is a leaf
+        else
+            children = { source[sources[index]].left, source[sources[index]].right };
+
+        while (children.size() < 8) {
+            std::size_t largest = children.size();
+            double largest_area = -1;
+            for (std::size_t i = 0; i < children.size(); i++) {
+                if (!source[children[i]].is_leaf() && source[children[i]].bounds.surface_area() > largest_area) {
+                    largest = i;
+                    largest_area = source[children[i]].bounds.surface_area();
+                }
+            }
+
+            if (largest == children.size())
+                break;
+
+            const bvh_node& opened = source[children[largest]];
+            children[largest] = opened.left;
+            children.push_back(opened.right);
+        }
+
+        for (std::size_t slot = 0; slot < children.size(); slot++) {
+            const bvh_node& child = source[children[slot]];
+            std::uint32_t target = child.left;
+            if (!child.is_leaf()) {
+                target = static_cast<std::uint32_t>(nodes_.size());
+                nodes_.emplace_back();
+                parents_.push_back(index);
+                sources.push_back(children[slot]);
+            }
+
+            bvh8_node& node = nodes_[index];
+            node.child[slot] = target;
+            node.count[slot] = static_cast<std::uint8_t>(child.count);
+            node.occupied |= static_cast<std::uint8_t>(1u << slot);
+
+            for (std::uint32_t i = child.left; i < child.left + child.count; i++)
+                leaf_of_[primitives_[i].id] = { index, static_cast<std::uint8_t>(slot) };
+        }
+    }
+
+    // Children come after their parents, so in reverse order every child is bounded before its parent
+    bounds_.resize(nodes_.size());
+    area_ = 0;
+    for (std::size_t index = nodes_.size(); index-- > 0;) {
+        bounds_[index] = quantize(static_cast<std::uint32_t>(index));
+        area_ += bounds_[index].surface_area();
+    }
+    built_area_ = area_;
+}
+
+aabb bvh8::child_bounds(std::uint32_t index, int slot) const {
+    const bvh8_node& node = nodes_[index];
+    if (node.count[slot] == 0)
+        return bounds_[node.child[slot]];
+
+    aabb bounds;
+    for (std::uint32_t i = node.child[slot]; i < node.child[slot] + node.count[slot]; i++)
+        bounds.grow(aabb::of_sphere(primitives_[i].center, primitives_[i].radius));
+    return bounds;
+}
+
+aabb bvh8::quantize(std::uint32_t index) {
+    aabb children[8];
+    aabb bounds;
+    for (int slot = 0; slot < 8; slot++) {
+        if (nodes_[index].occupied & (1u << slot)) {
+            children[slot] = child_bounds(index, slot);
+            bounds.grow(children[slot]);
+        }
+    }
+
+    bvh8_node& node = nodes_[index];
+
+    // Pad the children, the traversal works in single precision
+    double magnitude = 0;
+    for (int axis = 0; axis < 3; axis++)
+        magnitude = std::max({ magnitude, std::abs(aabb::axis_of(bounds.min, axis)),
+                               std::abs(aabb::axis_of(bounds.max, axis)), bounds.extent(axis) });
+    const double padding = magnitude * 1e-6;
+
+    for (int axis = 0; axis < 3; axis++) {
+        const double minimum = aabb::axis_of(bounds.min, axis) - padding;
+        const double maximum = aabb::axis_of(bounds.max, axis) + padding;
+
+        // The origin is rounded down and the cell size up to a power of two, so 255 cells cover the node
+        float origin = static_cast<float>(minimum);
+        if (origin > minimum)
+            origin = std::nextafter(origin, -std::numeric_limits<float>::infinity());
+
+        const double cell = (maximum - origin) / grid_cells * (1 + 1e-6);
+        const float scale = cell > 0 ? std::exp2(std::ceil(std::log2(static_cast<float>(cell)))) : 1.0f;
+        node.origin[axis] = origin;
+        node.scale[axis] = scale;
+
+        for (int slot = 0; slot < 8; slot++) {
+            if ((node.occupied & (1u << slot)) == 0) {
+                node.lower[axis][slot] = grid_cells;
+                node.upper[axis][slot] = 0;
+                continue;
+            }
+
+            const double lower = aabb::axis_of(children[slot].min, axis) - padding;
+            const double upper = aabb::axis_of(children[slot].max, axis) + padding;
+
+            // Round outward, the loops catch what the rounding of origin + q * scale gets wrong
+            int q_lower = std::clamp(static_cast<int>(std::floor((lower - origin) / scale)), 0, grid_cells);
+            while (q_lower > 0 && origin + static_cast<float>(q_lower) * scale > lower)
+                q_lower--;
+
+            int q_upper = std::clamp(static_cast<int>(std::ceil((upper - origin) / scale)), 0, grid_cells);
+            while (q_upper < grid_cells && origin + static_cast<float>(q_upper) * scale < upper)
+                q_upper++;
+
+            node.lower[axis][slot] = static_cast<std::uint8_t>(q_lower);
+            node.upper[axis][slot] = static_cast<std::uint8_t>(q_upper);
+        }
+    }
+
+    return bounds;
+}
+
+void bvh8::refit(const std::vector<sphere>& spheres, const std::vector<std::uint32_t>& changed) {
+    for (std::uint32_t id : changed) {
+        const auto [leaf, slot] = leaf_of_[id];
+        const bvh8_node& node = nodes_[leaf];
+        for (std::uint32_t i = node.child[slot]; i < node.child[slot] + node.count[slot]; i++) {
+            if (primitives_[i].id == id) {
+                primitives_[i].center = spheres[id].get_position();
+                primitives_[i].radius = spheres[id].get_radius();
+            }
+        }
+
+        // Requantize up to the root, or until a node keeps its bounds
+        for (std::uint32_t index = leaf; index != invalid; index = parents_[index]) {
+            const aabb previous = bounds_[index];
+            bounds_[index] = quantize(index);
+            area_ += bounds_[index].surface_area() - previous.surface_area();
+
+            if (bounds_[index].min == previous.min && bounds_[index].max == previous.max)
+                break;
+        }
+    }
+}
+
+double bvh8::get_degradation() const { return built_area_ > 0 ? area_ / built_area_ : 1; }
+
+std::optional<hit_record> bvh8::closest_hit(const bardrix::ray& ray, double t_min, double t_max) const {
+    using lane = simd::vfloat<8>;
+
+    if (nodes_.empty())
+        return std::nullopt;
+
+    const bardrix::point3& origin = ray.position;
+    const bardrix::vector3& direction = ray.get_direction();
+
+    // Keep the inverse finite, 0 * infinity would poison the lanes of children with a plane at the origin
+    const double directions[3] = { direction.x, direction.y, direction.z };
+    float inverse[3], ray_origin[3];
+    for (int axis = 0; axis < 3; axis++) {
+        const double d = directions[axis];
+        inverse[axis] = static_cast<float>(1 / (std::abs(d) > 1e-18 ? d : std::copysign(1e-18, d)));
+        ray_origin[axis] = static_cast<float>(aabb::axis_of(origin, axis));
+    }
+
+    // Near child first, a negative direction swaps the lower and upper planes
+    const int near[3] = { inverse[0] >= 0 ? 0 : 1, inverse[1] >= 0 ? 0 : 1, inverse[2] >= 0 ? 0 : 1 };
+
+    struct entry {
+        std::uint32_t child;
+        std::uint32_t count;
+        float t;
+    };
+    entry stack[stack_size];
+    std::uint32_t stack_top = 0;
+    stack[stack_top++] = { 0, 0, static_cast<float>(t_min) };
+
+    std::uint64_t visited = 0, tested = 0;
+    std::uint32_t closest = invalid;
+
+    while (stack_top > 0) {
+        const entry current = stack[--stack_top];
+        if (current.t > t_max)
+            continue; // A nearer hit was found after this child was pushed
+
+        if (current.count > 0) {
+            for (std::uint32_t i = current.child; i < current.child + current.count; i++) {
+                double t;
+                tested++;
+                if (primitives_[i].intersect(origin, direction, t_min, t_max, t)) {
+                    t_max = t;
+                    closest = i;
+                }
+            }
+            continue;
+        }
+
+        const bvh8_node& node = nodes_[current.child];
+        visited++;
+
+        // Plane q is at origin + q * scale, so its distance along the ray is q * (scale / d) + (origin - o) / d
+        lane entry_t(static_cast<float>(t_min)), exit_t(static_cast<float>(t_max));
+        for (int axis = 0; axis < 3; axis++) {
+            const lane step(node.scale[axis] * inverse[axis]);
+            const lane offset((node.origin[axis] - ray_origin[axis]) * inverse[axis]);
+            const std::uint8_t* planes[2] = { node.lower[axis], node.upper[axis] };
+            entry_t = simd::max(entry_t, lane::from_bytes(planes[near[axis]]) * step + offset);
+            exit_t = simd::min(exit_t, lane::from_bytes(planes[1 - near[axis]]) * step + offset);
+        }
+
+        // Accept a little slack for the single precision, the spheres are tested exactly
+        std::uint32_t hits = (entry_t <= exit_t * lane(1 + 1e-6f)).bits() & node.occupied;
+        if (hits == 0)
+            continue;
+
+        float entries[8];
+        entry_t.store(entries);
+
+        // Sort the hit children far to near, so the nearest one is on top of the stack
+        entry sorted[8];
+        int size = 0;
+        while (hits != 0) {
+            const int slot = simd::first_bit(hits);
+            hits &= hits - 1;
+
+            const entry child = { node.child[slot], node.count[slot], entries[slot] };
+            int i = size++;
+            for (; i > 0 && sorted[i - 1].t < child.t; i--)
+                sorted[i] = sorted[i - 1];
+            sorted[i] = child;
+        }
+
+        for (int i = 0; i < size; i++)
+            stack[stack_top++] = sorted[i];
+    }
+
+    count_traversal(visited, tested);
+
+    if (closest == invalid)
+        return std::nullopt;
+
+    const bvh_primitive& primitive = primitives_[closest];
+    hit_record record;
+    record.t = t_max;
+    record.id = primitive.id;
+    record.normal = primitive.center.vector_to(record.point(ray)) * (1 / primitive.radius);
+    return record;
+}
+
+bool bvh8::any_hit(const bardrix::ray& ray, double t_min, double t_max) const {
+    using lane = simd::vfloat<8>;
+
+    if (nodes_.empty())
+        return false;
+
+    const bardrix::point3& origin = ray.position;
+    const bardrix::vector3& direction = ray.get_direction();
+
+    const double directions[3] = { direction.x, direction.y, direction.z };
+    float inverse[3], ray_origin[3];
+    for (int axis = 0; axis < 3; axis++) {
+        const double d = directions[axis];
+        inverse[axis] = static_cast<float>(1 / (std::abs(d) > 1e-18 ? d : std::copysign(1e-18, d)));
+        ray_origin[axis] = static_cast<float>(aabb::axis_of(origin, axis));
+    }
+    const int near[3] = { inverse[0] >= 0 ? 0 : 1, inverse[1] >= 0 ? 0 : 1, inverse[2] >= 0 ? 0 : 1 };
+
+    // Any blocker will do, so the children are pushed unsorted
+    std::uint32_t stack[stack_size];
+    std::uint32_t stack_top = 0;
+    stack[stack_top++] = 0;
+
+    std::uint64_t visited = 0, tested = 0;
+
+    while (stack_top > 0) {
+        const bvh8_node& node = nodes_[stack[--stack_top]];
+        visited++;
+
+        lane entry_t(static_cast<float>(t_min)), exit_t(static_cast<float>(t_max));
+        for (int axis = 0; axis < 3; axis++) {
+            const lane step(node.scale[axis] * inverse[axis]);
+            const lane offset((node.origin[axis] - ray_origin[axis]) * inverse[axis]);
+            const std::uint8_t* planes[2] = { node.lower[axis], node.upper[axis] };
+            entry_t = simd::max(entry_t, lane::from_bytes(planes[near[axis]]) * step + offset);
+            exit_t = simd::min(exit_t, lane::from_bytes(planes[1 - near[axis]]) * step + offset);
+        }
+
+        for (std::uint32_t hits = (entry_t <= exit_t * lane(1 + 1e-6f)).bits() & node.occupied; hits != 0;
+             hits &= hits - 1) {
+            const int slot = simd::first_bit(hits);
+            if (node.count[slot] == 0) {
+                stack[stack_top++] = node.child[slot];
+                continue;
+            }
+
+            for (std::uint32_t i = node.child[slot]; i < node.child[slot] + node.count[slot]; i++) {
+                tested++;
+                if (primitives_[i].occludes(origin, direction, t_min, t_max)) {
+                    count_traversal(visited, tested);
+                    return true;
+                }
+            }
+        }
+    }
+
+    count_traversal(visited, tested);
+    return false;
+}
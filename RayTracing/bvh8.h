@@ -0,0 +1,120 @@
+#pragma once
+
+#include "bvh.h"
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+/// \brief A node of the 8 wide bvh, exactly two cache lines
+/// \details The bounds of the children are quantized to 8 bits per plane on a grid of the node, child i is at
+///          origin + lower * scale up to origin + upper * scale. Every plane is its own row, so a row loads as the
+///          8 lanes of a vector.
+struct alignas(64) bvh8_node {
+    /// \brief The corner of the grid the children are quantized on
+    float origin[3];
+
+    /// \brief The size of a grid cell per axis, a power of two
+    float scale[3];
+
+    /// \brief The quantized lower planes of the children, per axis
+    std::uint8_t lower[3][8];
+
+    /// \brief The quantized upper planes of the children, per axis
+    std::uint8_t upper[3][8];
+
+    /// \brief The index of every child node, or the index of the first primitive for a leaf child
+    std::uint32_t child[8];
+
+    /// \brief The amount of primitives of every leaf child, 0 for a node child
+    std::uint8_t count[8];
+
+    /// \brief Bit i is set when child i is used
+    std::uint8_t occupied = 0;
+};
+
+static_assert(sizeof(bvh8_node) == 128, "A bvh8_node should fill exactly two cache lines");
+
+/// \brief Bounding volume hierarchy with eight children per node, collapsed from a binary bvh
+/// \details One slab test checks all eight children of a node with 8 wide vectors (AVX2), the children that are hit
+///          are visited front to back. The quantized bounds keep a node in two cache lines, half of the memory of
+///          the binary nodes it replaces, as traversing a million spheres is mostly waiting on memory.
+///          Quantized bounds are rounded outward, so they can only make a child bigger.
+class bvh8 : public accelerator {
+public:
+    /// \brief The index used for "no node"
+    static constexpr std::uint32_t invalid = bvh::invalid;
+
+    /// \brief The size of the traversal stack, a level pushes up to seven more entries than it pops
+    static constexpr std::uint32_t stack_size = bvh::stack_size * 7;
+
+    /// \brief The amount of grid cells per axis of a node
+    static constexpr int grid_cells = 255;
+
+protected:
+    /// \brief The nodes, the root is node 0
+    std::vector<bvh8_node> nodes_;
+
+    /// \brief The exact bounds of every node, used to requantize a node after a refit
+    std::vector<aabb> bounds_;
+
+    /// \brief The parent of every node, invalid for the root
+    std::vector<std::uint32_t> parents_;
+
+    /// \brief The spheres in leaf order
+    std::vector<bvh_primitive> primitives_;
+
+    /// \brief The node and child slot of the leaf of every sphere, indexed by the index of the sphere
+    std::vector<std::pair<std::uint32_t, std::uint8_t>> leaf_of_;
+
+    /// \brief The sum of the surface areas of all nodes, kept up to date by refit()
+    double area_ = 0;
+
+    /// \brief area_ right after the build
+    double built_area_ = 0;
+
+public:
+    // CONSTRUCTORS
+
+    /// \brief Default constructor for bvh8 (empty)
+    bvh8() = default;
+
+    /// \brief Constructor for bvh8, builds a binary bvh and collapses it
+    /// \param spheres The spheres to build over, the index of a sphere is its id in the hit records
+    /// \param pool The threads to build the binary bvh on, nullptr to build on the calling thread only
+    /// \param builder The way to build the binary bvh
+    explicit bvh8(const std::vector<sphere>& spheres, thread_pool* pool = nullptr,
+                  bvh_builder builder = bvh_builder::sah);
+
+    /// \brief Constructor for bvh8, collapses a binary bvh
+    /// \param binary The binary bvh to collapse
+    explicit bvh8(const bvh& binary);
+
+    // GETTERS
+    NODISCARD const std::vector<bvh8_node>& get_nodes() const;
+    NODISCARD const std::vector<bvh_primitive>& get_primitives() const;
+
+    // UPDATING
+
+    void refit(const std::vector<sphere>& spheres, const std::vector<std::uint32_t>& changed) override;
+
+    NODISCARD double get_degradation() const override;
+
+    // RAYTRACING
+
+    NODISCARD std::optional<hit_record> closest_hit(const bardrix::ray& ray, double t_min,
+                                                    double t_max) const override;
+
+    NODISCARD bool any_hit(const bardrix::ray& ray, double t_min, double t_max) const override;
+
+protected:
+    /// \brief Collapses a binary bvh into nodes_, every node takes the (up to) eight largest descendants as children
+    void collapse(const bvh& binary);
+
+    /// \brief Gets the exact bounds of a child of a node
+    NODISCARD aabb child_bounds(std::uint32_t index, int slot) const;
+
+    /// \brief Computes the exact bounds of a node from its children and quantizes the children again
+    /// \return The new exact bounds of the node
+    aabb quantize(std::uint32_t index);
+}; // class bvh8
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <bardrix/bardrix.h>
+
+#include <atomic>
+#include <cstdint>
+
+/// \brief Tells a frame that a newer frame was requested, so it can stop instead of finishing a stale image
+/// \details Whoever requests frames bumps a generation counter, a frame remembers the generation it was started for
+///          and is cancelled once the counter moved on. The renderer checks the token before every tile, so a
+///          superseded frame stops within a tile. A default token is never cancelled.
+/// \example cancel_token token(generation); renderer.render(buffer, width, height, token);
+class cancel_token {
+protected:
+    /// \brief The generation counter, nullptr for a token that is never cancelled
+    const std::atomic<std::uint64_t>* generation_ = nullptr;
+
+    /// \brief The generation the frame was started for
+    std::uint64_t frame_ = 0;
+
+public:
+    /// \brief Default constructor for cancel_token (never cancelled)
+    cancel_token() = default;
+
+    /// \brief Constructor for cancel_token, for the current generation
+    /// \param generation The generation counter, must outlive the token
+    explicit cancel_token(const std::atomic<std::uint64_t>& generation)
+        : generation_(&generation), frame_(generation.load(std::memory_order_acquire)) {}
+
+    /// \brief Checks if a newer frame was requested since the token was made
+    NODISCARD bool cancelled() const {
+        return generation_ != nullptr && generation_->load(std::memory_order_relaxed) != frame_;
+    }
+}; // class cancel_token
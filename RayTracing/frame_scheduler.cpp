@@ -0,0 +1,88 @@
+#include "frame_scheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+frame_scheduler::frame_scheduler(const renderer& renderer, bardrix::camera& camera, double budget, double min_scale)
+    : renderer_(renderer), camera_(camera), budget_(budget), min_scale_(std::clamp(min_scale, 0.01, 1.0)),
+      scale_(min_scale_) {}
+
+double frame_scheduler::get_budget() const { return budget_; }
+
+void frame_scheduler::set_budget(double budget) { budget_ = budget; }
+
+double frame_scheduler::get_scale() const { return scale_; }
+
+double frame_scheduler::get_seconds_per_pixel() const { return seconds_per_pixel_; }
+
+render_stats frame_scheduler::render(framebuffer& buffer, int width, int height,
+                                     const cancel_token& token) {
+    const auto start = std::chrono::steady_clock::now();
+
+    // The amount of pixels that fit the budget, the scale applies to both sides
+    if (seconds_per_pixel_ > 0 && width > 0 && height > 0) {
+        const double pixels = budget_ * headroom / seconds_per_pixel_;
+        const double scale = std::sqrt(pixels / (static_cast<double>(width) * height));
+        scale_ = std::clamp(std::floor(scale * scale_steps) / scale_steps, min_scale_, 1.0);
+    }
+
+    const int scaled_width = std::max(1, static_cast<int>(std::lround(width * scale_)));
+    const int scaled_height = std::max(1, static_cast<int>(std::lround(height * scale_)));
+
+    render_stats stats;
+    if (scaled_width >= width && scaled_height >= height)
+        stats = renderer_.render(buffer, width, height, token);
+    else {
+        camera_.set_width(scaled_width);
+        camera_.set_height(scaled_height);
+        stats = renderer_.render(scaled_, scaled_width, scaled_height, token);
+        camera_.set_width(width);
+        camera_.set_height(height);
+
+        if (!stats.cancelled) {
+            buffer.resize(static_cast<std::size_t>(width) * height);
+            upscale(buffer, width, height, scaled_width, scaled_height);
+        }
+    }
+
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (width <= 0 || height <= 0)
+        return stats; // Nothing to render, e.g. a minimized window, the scale stays 1
+    stats.resolution_scale = static_cast<double>(scaled_width) / width;
+    if (stats.cancelled)
+        return stats;
+
+    // The time per pixel of this frame, smoothed over the recent frames
+    const double seconds_per_pixel = stats.seconds / (static_cast<double>(scaled_width) * scaled_height);
+    seconds_per_pixel_ = seconds_per_pixel_ == 0
+                             ? seconds_per_pixel
+                             : seconds_per_pixel_ + (seconds_per_pixel - seconds_per_pixel_) * smoothing;
+
+    return stats;
+}
+
+void frame_scheduler::upscale(framebuffer& buffer, int width, int height, int scaled_width,
+                              int scaled_height) {
+    // The source column of every column, shared by all rows
+    columns_.resize(width);
+    for (int x = 0; x < width; x++)
+        columns_[x] = std::min(scaled_width - 1, static_cast<int>((x + 0.5) * scaled_width / width));
+
+    int previous = -1;
+    for (int y = 0; y < height; y++) {
+        const int row = std::min(scaled_height - 1, static_cast<int>((y + 0.5) * scaled_height / height));
+        std::uint32_t* target = buffer.data() + static_cast<std::size_t>(y) * width;
+
+        // Rows that stretch the same row are copies of the row above
+        if (row == previous) {
+            std::copy(target - width, target, target);
+            continue;
+        }
+
+        const std::uint32_t* source = scaled_.data() + static_cast<std::size_t>(row) * scaled_width;
+        for (int x = 0; x < width; x++)
+            target[x] = source[columns_[x]];
+        previous = row;
+    }
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "framebuffer.h"
+#include "renderer.h"
+
+#include <bardrix/camera.h>
+
+#include <cstdint>
+#include <vector>
+
+/// \brief Keeps frames within a time budget by rendering them at a lower resolution and upscaling them
+/// \details The scheduler measures the time per pixel of the recent frames and picks the resolution scale of a frame
+///          from that and the size of the frame, so the first frame after a resize fits the budget as well. The scale
+///          lies between min_scale and 1, frames are rendered at min_scale until the first one was measured.
+///          The frame is rendered at the scaled size and stretched to the requested size (nearest neighbour), at
+///          scale 1 it is rendered directly.
+///          The camera is resized to the scaled size during the frame and back afterwards, so it must not be changed
+///          on another thread while a frame renders.
+class frame_scheduler {
+public:
+    /// \brief The part of the budget the scheduler aims for, the rest absorbs frame to frame noise
+    static constexpr double headroom = 0.9;
+
+    /// \brief How fast the measured time per pixel follows new frames, between 0 (never) and 1 (only the last frame)
+    static constexpr double smoothing = 0.3;
+
+    /// \brief The scale is rounded to steps of 1 / scale_steps, so the resolution doesn't change for every frame
+    static constexpr int scale_steps = 32;
+
+protected:
+    /// \brief The renderer to render with
+    const renderer& renderer_;
+
+    /// \brief The camera of the renderer, resized to the scaled size during a frame
+    bardrix::camera& camera_;
+
+    /// \brief The time budget of a frame in seconds
+    double budget_;
+
+    /// \brief The lowest resolution scale
+    double min_scale_;
+
+    /// \brief The resolution scale of the last frame
+    double scale_;
+
+    /// \brief The smoothed time per pixel in seconds, 0 before the first frame
+    double seconds_per_pixel_ = 0;
+
+    /// \brief The frame at the scaled size, kept for the next frames
+    framebuffer scaled_;
+
+    /// \brief The source column of every column of the upscaled frame, kept for the next frames
+    std::vector<int> columns_;
+
+public:
+    // CONSTRUCTORS
+
+    /// \brief Constructor for frame_scheduler
+    /// \param renderer The renderer to render with
+    /// \param camera The camera of the renderer
+    /// \param budget The time budget of a frame in seconds, e.g. 0.016
+    /// \param min_scale The lowest resolution scale, e.g. 0.25 for a quarter of the width and height
+    /// \example frame_scheduler scheduler(renderer, camera, 0.016);
+    frame_scheduler(const renderer& renderer, bardrix::camera& camera, double budget, double min_scale = 0.25);
+
+    // GETTERS/SETTERS
+    NODISCARD double get_budget() const;
+    void set_budget(double budget);
+
+    /// \brief Gets the resolution scale the last frame was rendered at, min_scale before the first frame
+    NODISCARD double get_scale() const;
+
+    /// \brief Gets the smoothed time per pixel of the recent frames in seconds, 0 before the first frame
+    NODISCARD double get_seconds_per_pixel() const;
+
+    // RENDERING
+
+    /// \brief Renders a frame at the scale that fits the budget and upscales it to the requested size
+    /// \param buffer The buffer to render to in the AARRGGBB format, resized to width * height when needed
+    /// \param width The width of the frame
+    /// \param height The height of the frame
+    /// \param token Stops the frame before the next tile once a newer frame was requested
+    /// \return The statistics of the frame, render_stats::resolution_scale holds the scale it was rendered at
+    /// \example render_stats stats = scheduler.render(buffer, width, height);
+    render_stats render(framebuffer& buffer, int width, int height, const cancel_token& token = {});
+
+protected:
+    /// \brief Stretches the scaled frame over the buffer
+    void upscale(framebuffer& buffer, int width, int height, int scaled_width, int scaled_height);
+}; // class frame_scheduler
@@ -0,0 +1,107 @@
+#include "framebuffer.h"
+
+#include <algorithm>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#else // _WIN32
+#include <sys/mman.h>
+#endif // _WIN32
+
+void* page_pool::map(std::size_t size) {
+#ifdef _WIN32
+    // Large pages need the "Lock pages in memory" privilege, without it the normal pages are used
+    const std::size_t large_page = GetLargePageMinimum();
+    if (large_page != 0 && size % large_page == 0) {
+        void* memory = VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES, PAGE_READWRITE);
+        if (memory != nullptr)
+            return memory;
+    }
+
+    void* memory = VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    if (memory == nullptr)
+        throw std::bad_alloc();
+    return memory;
+#else // _WIN32
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+        throw std::bad_alloc();
+
+#ifdef MADV_HUGEPAGE
+    // Transparent huge pages, ignored where they are switched off
+    if (size >= huge_page_size)
+        madvise(memory, size, MADV_HUGEPAGE);
+#endif // MADV_HUGEPAGE
+    return memory;
+#endif // _WIN32
+}
+
+void page_pool::unmap(void* memory, std::size_t size) {
+#ifdef _WIN32
+    VirtualFree(memory, 0, MEM_RELEASE);
+#else // _WIN32
+    munmap(memory, size);
+#endif // _WIN32
+}
+
+page_pool& page_pool::instance() {
+    // Never destroyed, buffers with static lifetime may outlive any other static
+    static page_pool* pool = new page_pool();
+    return *pool;
+}
+
+void* page_pool::allocate(std::size_t bytes) {
+    const std::size_t granularity = bytes >= huge_page_size ? huge_page_size : page_size;
+    const std::size_t size = (std::max<std::size_t>(bytes, 1) + granularity - 1) / granularity * granularity;
+
+    std::lock_guard lock(mutex_);
+
+    // The smallest free block that fits
+    auto best = free_.end();
+    for (auto it = free_.begin(); it != free_.end(); ++it)
+        if (it->size >= size && (best == free_.end() || it->size < best->size))
+            best = it;
+
+    block taken;
+    if (best != free_.end()) {
+        taken = *best;
+        *best = free_.back();
+        free_.pop_back();
+    }
+    else {
+        taken = { map(size), size };
+        allocations_++;
+        reserved_ += size;
+    }
+
+    used_.push_back(taken);
+    return taken.memory;
+}
+
+void page_pool::deallocate(void* memory) {
+    if (memory == nullptr)
+        return;
+
+    std::lock_guard lock(mutex_);
+    const auto it = std::find_if(used_.begin(), used_.end(), [memory](const block& b) { return b.memory == memory; });
+    if (it == used_.end())
+        return;
+
+    free_.push_back(*it);
+    *it = used_.back();
+    used_.pop_back();
+}
+
+void page_pool::trim() {
+    std::lock_guard lock(mutex_);
+    for (const block& b : free_) {
+        unmap(b.memory, b.size);
+        reserved_ -= b.size;
+    }
+    free_.clear();
+}
+
+std::uint64_t page_pool::get_allocations() const { return allocations_; }
+
+std::size_t page_pool::get_reserved() const { return reserved_; }
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <bardrix/bardrix.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/// \brief Pool of page aligned memory blocks for frame buffers
+/// \details Blocks come straight from the operating system, blocks of at least huge_page_size use huge pages where
+///          the system offers them. Freed blocks stay in the pool and are handed out again for any request that fits,
+///          so buffers that shrink and grow back (e.g. while a window is resized) stop allocating once the pool holds
+///          their peak size. trim() returns the free blocks to the system.
+class page_pool {
+public:
+    /// \brief The size of a page, every block is a multiple of it
+    static constexpr std::size_t page_size = 4096;
+
+    /// \brief The size of a huge page, larger blocks are a multiple of it
+    static constexpr std::size_t huge_page_size = std::size_t(2) << 20;
+
+protected:
+    /// \brief A block of memory
+    struct block {
+        void* memory;
+        std::size_t size;
+    };
+
+    /// \brief Guards the blocks
+    std::mutex mutex_;
+
+    /// \brief The blocks that are handed out
+    std::vector<block> used_;
+
+    /// \brief The blocks that can be handed out again
+    std::vector<block> free_;
+
+    /// \brief The amount of blocks taken from the system
+    std::atomic<std::uint64_t> allocations_ = 0;
+
+    /// \brief The amount of bytes held, used or free
+    std::atomic<std::size_t> reserved_ = 0;
+
+    /// \brief Takes a block from the system
+    static void* map(std::size_t size);
+
+    /// \brief Returns a block to the system
+    static void unmap(void* memory, std::size_t size);
+
+public:
+    /// \brief Gets the pool all frame buffers share
+    NODISCARD static page_pool& instance();
+
+    /// \brief Hands out a block of at least a size, the smallest free block that fits or a new one
+    /// \param bytes The size in bytes
+    /// \return The page aligned block
+    NODISCARD void* allocate(std::size_t bytes);
+
+    /// \brief Gives a block back to the pool, it stays reserved for the next allocate
+    /// \param memory The block, from allocate
+    void deallocate(void* memory);
+
+    /// \brief Returns all free blocks to the system
+    void trim();
+
+    /// \brief Gets the amount of blocks taken from the system so far, constant while buffers only reuse memory
+    NODISCARD std::uint64_t get_allocations() const;
+
+    /// \brief Gets the amount of bytes the pool holds, used or free
+    NODISCARD std::size_t get_reserved() const;
+}; // class page_pool
+
+/// \brief Allocator that takes its memory from the page_pool
+/// \details Elements are default initialized, so growing a buffer of pixels doesn't write the new memory twice.
+/// \tparam T The type to allocate
+/// \example std::vector<std::uint32_t, page_allocator<std::uint32_t>> pixels;
+template<typename T>
+struct page_allocator {
+    using value_type = T;
+
+    template<typename U>
+    struct rebind {
+        using other = page_allocator<U>;
+    };
+
+    page_allocator() noexcept = default;
+
+    template<typename U>
+    page_allocator(const page_allocator<U>&) noexcept {}
+
+    T* allocate(std::size_t count) { return static_cast<T*>(page_pool::instance().allocate(count * sizeof(T))); }
+
+    void deallocate(T* pointer, std::size_t) noexcept { page_pool::instance().deallocate(pointer); }
+
+    /// \brief Default initializes instead of value initializing, e.g. pixels stay unwritten until they are rendered
+    template<typename U>
+    void construct(U* pointer) noexcept(std::is_nothrow_default_constructible_v<U>) {
+        ::new (static_cast<void*>(pointer)) U;
+    }
+
+    template<typename U, typename... Args>
+    void construct(U* pointer, Args&&... args) { ::new (static_cast<void*>(pointer)) U(std::forward<Args>(args)...); }
+
+    template<typename U>
+    bool operator==(const page_allocator<U>&) const noexcept { return true; }
+
+    template<typename U>
+    bool operator!=(const page_allocator<U>&) const noexcept { return false; }
+};
+
+/// \brief Pixels in the AARRGGBB format, row after row, in page aligned memory from the page_pool
+using framebuffer = std::vector<std::uint32_t, page_allocator<std::uint32_t>>;
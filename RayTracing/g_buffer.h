@@ -0,0 +1,81 @@
+#pragma once
+
+#include "aligned_allocator.h"
+#include "hit_record.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+/// \brief The primary hit of every pixel of a frame, so a frame with the same spheres and camera only has to shade
+/// \details Stores the distance, normal and sphere index (the sphere holds the material) per pixel as structure of
+///          arrays. The renderer clears valid whenever the spheres or the camera change.
+struct g_buffer {
+    /// \brief The id of pixels whose primary ray hits nothing
+    static constexpr std::uint32_t miss = UINT32_MAX;
+
+    /// \brief The width of the buffer in pixels
+    int width = 0;
+
+    /// \brief The height of the buffer in pixels
+    int height = 0;
+
+    /// \brief If the hits belong to the current spheres and camera
+    bool valid = false;
+
+    /// \brief The distance along the primary ray of every pixel
+    aligned_vector<double> t;
+
+    /// \brief The normalized normals at the hits
+    aligned_vector<double> normal_x, normal_y, normal_z;
+
+    /// \brief The index of the sphere every pixel sees, miss for none
+    std::vector<std::uint32_t> id;
+
+    /// \brief Resizes the buffer and marks it as invalid, keeps the memory
+    /// \param buffer_width The width in pixels
+    /// \param buffer_height The height in pixels
+    void resize(int buffer_width, int buffer_height) {
+        width = buffer_width;
+        height = buffer_height;
+        valid = false;
+
+        const std::size_t pixels = static_cast<std::size_t>(width) * height;
+        t.resize(pixels);
+        normal_x.resize(pixels);
+        normal_y.resize(pixels);
+        normal_z.resize(pixels);
+        id.resize(pixels);
+    }
+
+    /// \brief Stores the hit of a pixel
+    /// \param pixel The index of the pixel, y * width + x
+    /// \param hit The hit of the primary ray of the pixel, std::nullopt for a miss
+    void store(std::size_t pixel, const std::optional<hit_record>& hit) {
+        if (!hit.has_value()) {
+            id[pixel] = miss;
+            return;
+        }
+
+        t[pixel] = hit->t;
+        normal_x[pixel] = hit->normal.x;
+        normal_y[pixel] = hit->normal.y;
+        normal_z[pixel] = hit->normal.z;
+        id[pixel] = static_cast<std::uint32_t>(hit->id);
+    }
+
+    /// \brief Gets the hit of a pixel
+    /// \param pixel The index of the pixel, y * width + x
+    /// \return The hit, std::nullopt for a miss
+    NODISCARD std::optional<hit_record> hit(std::size_t pixel) const {
+        if (id[pixel] == miss)
+            return std::nullopt;
+
+        hit_record record;
+        record.t = t[pixel];
+        record.normal = bardrix::vector3(normal_x[pixel], normal_y[pixel], normal_z[pixel]);
+        record.id = id[pixel];
+        return record;
+    }
+};
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <bardrix/bardrix.h>
+#include <bardrix/ray.h>
+
+#include <cstddef>
+
+/// \brief Information about an intersection of a ray with a shape
+struct hit_record {
+    /// \brief The distance along the ray to the intersection (ray directions are normalized)
+    double t = 0;
+
+    /// \brief The normalized normal of the shape at the intersection
+    bardrix::vector3 normal;
+
+    /// \brief The index of the intersected shape in the scene, the material is looked up through the shape
+    std::size_t id = 0;
+
+    /// \brief Gets the intersection point
+    /// \param ray The ray that produced this hit
+    /// \return The intersection point
+    /// \example bardrix::point3 point = hit.point(ray);
+    NODISCARD bardrix::point3 point(const bardrix::ray& ray) const { return ray.position + ray.get_direction() * t; }
+};
@@ -0,0 +1,28 @@
+#include "image.h"
+
+#include <fstream>
+
+bool write_ppm(const std::string& path, const framebuffer& buffer, int width, int height) {
+    if (width <= 0 || height <= 0 || buffer.size() < static_cast<std::size_t>(width) * height)
+        return false;
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+
+    file << "P6\n" << width << ' ' << height << "\n255\n";
+
+    // Convert a row at a time from AARRGGBB to RGB
+    std::vector<char> row(static_cast<std::size_t>(width) * 3);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            const std::uint32_t pixel = buffer[static_cast<std::size_t>(y) * width + x];
+            row[x * 3 + 0] = static_cast<char>(pixel >> 16 & 0xFF);
+            row[x * 3 + 1] = static_cast<char>(pixel >> 8 & 0xFF);
+            row[x * 3 + 2] = static_cast<char>(pixel & 0xFF);
+        }
+        file.write(row.data(), static_cast<std::streamsize>(row.size()));
+    }
+
+    return static_cast<bool>(file);
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "framebuffer.h"
+
+#include <bardrix/bardrix.h>
+
+#include <cstdint>
+#include <string>
+
+/// \brief Writes an AARRGGBB buffer to disk as a binary PPM (P6) image, the alpha channel is dropped
+/// \param path The path of the file to write
+/// \param buffer The buffer to write, must contain at least width * height pixels
+/// \param width The width of the image
+/// \param height The height of the image
+/// \return If the image was written successfully
+/// \example if (!write_ppm("frame.ppm", buffer, 600, 600)) return 1;
+NODISCARD bool write_ppm(const std::string& path, const framebuffer& buffer, int width, int height);
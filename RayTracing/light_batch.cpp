@@ -0,0 +1,244 @@
+#include "light_batch.h"
+
+#include "renderer.h"
+
+#include <bit>
+#include <cmath>
+
+using lane = simd::vfloat<light_batch::width>;
+
+light_batch::light_batch(const std::vector<bardrix::light>& lights) { assign(lights); }
+
+std::size_t light_batch::size() const { return lights_.size(); }
+
+void light_batch::assign(const std::vector<bardrix::light>& lights) {
+    lights_ = lights;
+    const std::size_t padded = (lights.size() + padding - 1) / padding * padding + padding;
+
+    position_x_.assign(padded, 0);
+    position_y_.assign(padded, 0);
+    position_z_.assign(padded, 0);
+    falloff_.assign(padded, 0);
+
+    for (std::size_t i = 0; i < lights.size(); i++) {
+        const bardrix::point3& position = lights[i].position;
+        position_x_[i] = static_cast<float>(position.x);
+        position_y_[i] = static_cast<float>(position.y);
+        position_z_[i] = static_cast<float>(position.z);
+
+        falloff_[i] = static_cast<float>(unit_falloff(lights[i]));
+    }
+}
+
+double light_batch::unit_falloff(const bardrix::light& light) {
+    // The falloff is c / distance^2, c is what the light gives at distance 1
+    return light.inverse_square_law(light.position + bardrix::vector3(1, 0, 0));
+}
+
+bool light_batch::integer_shininess(const bardrix::material& material) {
+    const double shininess = material.get_shininess();
+    return shininess >= 0 && shininess <= max_integer_shininess && shininess == std::floor(shininess);
+}
+
+void light_batch::point_lanes::add(const bardrix::material& material, const bardrix::vector3& normal,
+                                   const bardrix::point3& point, const bardrix::camera& camera,
+                                   const std::uint8_t* flags) {
+    point_x[size] = static_cast<float>(point.x);
+    point_y[size] = static_cast<float>(point.y);
+    point_z[size] = static_cast<float>(point.z);
+    normal_x[size] = static_cast<float>(normal.x);
+    normal_y[size] = static_cast<float>(normal.y);
+    normal_z[size] = static_cast<float>(normal.z);
+
+    const bardrix::vector3 view = camera.position.vector_to(point).normalized();
+    view_x[size] = static_cast<float>(view.x);
+    view_y[size] = static_cast<float>(view.y);
+    view_z[size] = static_cast<float>(view.z);
+
+    ambient[size] = static_cast<float>(material.get_ambient());
+    diffuse[size] = static_cast<float>(material.get_diffuse());
+    specular[size] = static_cast<float>(material.get_specular());
+    power[size] = static_cast<std::uint32_t>(material.get_shininess());
+    occluded[size] = flags;
+    size++;
+}
+
+double light_batch::intensity(const bardrix::material& material, const bardrix::vector3& normal,
+                              const bardrix::point3& point, const bardrix::camera& camera, std::size_t first,
+                              std::size_t count, std::uint32_t occluded) const {
+    if (!integer_shininess(material)) {
+        double sum = 0;
+        for (std::size_t i = 0; i < count; i++) {
+            const bardrix::light& light = lights_[first + i];
+            sum += i < 32 && (occluded >> i) & 1
+                       ? std::min(1.0, material.get_ambient() * light.inverse_square_law(point))
+                       : calculate_light_intensity(material, normal, light, camera, point);
+        }
+        return sum;
+    }
+
+    const lane point_x(static_cast<float>(point.x));
+    const lane point_y(static_cast<float>(point.y));
+    const lane point_z(static_cast<float>(point.z));
+    const lane normal_x(static_cast<float>(normal.x));
+    const lane normal_y(static_cast<float>(normal.y));
+    const lane normal_z(static_cast<float>(normal.z));
+
+    // The view direction is the same for every light
+    const bardrix::vector3 view = camera.position.vector_to(point).normalized();
+    const lane view_x(static_cast<float>(view.x));
+    const lane view_y(static_cast<float>(view.y));
+    const lane view_z(static_cast<float>(view.z));
+
+    const lane ambient(static_cast<float>(material.get_ambient()));
+    const lane diffuse(static_cast<float>(material.get_diffuse()));
+    const lane specular(static_cast<float>(material.get_specular()));
+    const lane zero(0.0f), one(1.0f), two(2.0f);
+    const lane last(static_cast<float>(count));
+    const auto power = static_cast<std::uint32_t>(material.get_shininess());
+
+    double sum = 0;
+    for (std::size_t i = 0; i < count; i += width) {
+        const std::size_t light = first + i;
+
+        // Normalized vector from the point to the light
+        lane to_light_x = lane::loadu(&position_x_[light]) - point_x;
+        lane to_light_y = lane::loadu(&position_y_[light]) - point_y;
+        lane to_light_z = lane::loadu(&position_z_[light]) - point_z;
+        const lane distance_squared = to_light_x * to_light_x + to_light_y * to_light_y + to_light_z * to_light_z;
+        const lane inverse_distance = one / simd::sqrt(distance_squared);
+        to_light_x = to_light_x * inverse_distance;
+        to_light_y = to_light_y * inverse_distance;
+        to_light_z = to_light_z * inverse_distance;
+
+        const lane angle = normal_x * to_light_x + normal_y * to_light_y + normal_z * to_light_z;
+
+        // The light mirrored around the normal, 2 (n . l) n - l
+        const lane reflection_x = normal_x * (two * angle) - to_light_x;
+        const lane reflection_y = normal_y * (two * angle) - to_light_y;
+        const lane reflection_z = normal_z * (two * angle) - to_light_z;
+        const lane specular_angle = reflection_x * view_x + reflection_y * view_y + reflection_z * view_z;
+
+        // specular_angle ^ power by repeated squaring, keeps the sign of odd powers like std::pow
+        lane specular_power = one, base = specular_angle;
+        for (std::uint32_t exponent = power; exponent != 0; exponent >>= 1) {
+            if (exponent & 1)
+                specular_power = specular_power * base;
+            base = base * base;
+        }
+
+        const lane falloff = lane::loadu(&falloff_[light]) / distance_squared;
+        const lane lit = simd::min(one, (ambient + diffuse * angle + specular * specular_power) * falloff);
+
+        // Occluded lights only keep their ambient part, lights behind the surface add nothing
+        float blocked[width];
+        for (int lane_index = 0; lane_index < width; lane_index++) {
+            const std::size_t bit = i + lane_index;
+            blocked[lane_index] = bit < 32 && (occluded >> bit) & 1 ? 1.0f : 0.0f;
+        }
+        const lane shadowed = simd::min(one, ambient * falloff);
+        lane contribution = simd::select(lane::loadu(blocked) > zero, shadowed,
+                                         simd::select(angle < zero, zero, lit));
+
+        // Lanes past the range belong to other lights or the padding
+        contribution = simd::select(lane::iota() + lane(static_cast<float>(i)) < last, contribution, zero);
+        sum += simd::reduce_add(contribution);
+    }
+
+    return sum;
+}
+
+std::array<double, light_batch::width> light_batch::intensities(const point_lanes& points, std::size_t first,
+                                                                std::size_t count) const {
+    const lane point_x = lane::loadu(points.point_x);
+    const lane point_y = lane::loadu(points.point_y);
+    const lane point_z = lane::loadu(points.point_z);
+    const lane normal_x = lane::loadu(points.normal_x);
+    const lane normal_y = lane::loadu(points.normal_y);
+    const lane normal_z = lane::loadu(points.normal_z);
+    const lane view_x = lane::loadu(points.view_x);
+    const lane view_y = lane::loadu(points.view_y);
+    const lane view_z = lane::loadu(points.view_z);
+    const lane ambient = lane::loadu(points.ambient);
+    const lane diffuse = lane::loadu(points.diffuse);
+    const lane specular = lane::loadu(points.specular);
+    const lane zero(0.0f), one(1.0f), two(2.0f);
+
+    // The bits of the powers as masks, the repeated squaring multiplies a lane only where its power has the bit
+    constexpr int max_bits = std::bit_width(static_cast<std::uint32_t>(max_integer_shininess));
+    std::uint32_t powers = 0;
+    bool any_occluded = false;
+    for (int i = 0; i < points.size; i++) {
+        powers |= points.power[i];
+        any_occluded = any_occluded || points.occluded[i] != nullptr;
+    }
+
+    const int bits = std::bit_width(powers);
+    lane odd[max_bits];
+    for (int bit = 0; bit < bits; bit++) {
+        float flags[width] = {};
+        for (int i = 0; i < points.size; i++)
+            flags[i] = (points.power[i] >> bit) & 1 ? 1.0f : 0.0f;
+        odd[bit] = lane::loadu(flags);
+    }
+
+    std::array<double, width> sums = {};
+    double block[width] = {};
+    lane chunk = zero;
+    for (std::size_t i = 0; i < count; i++) {
+        const std::size_t light = first + i;
+
+        // Normalized vector from every point to the light
+        lane to_light_x = lane(position_x_[light]) - point_x;
+        lane to_light_y = lane(position_y_[light]) - point_y;
+        lane to_light_z = lane(position_z_[light]) - point_z;
+        const lane distance_squared = to_light_x * to_light_x + to_light_y * to_light_y + to_light_z * to_light_z;
+        const lane inverse_distance = one / simd::sqrt(distance_squared);
+        to_light_x = to_light_x * inverse_distance;
+        to_light_y = to_light_y * inverse_distance;
+        to_light_z = to_light_z * inverse_distance;
+
+        const lane angle = normal_x * to_light_x + normal_y * to_light_y + normal_z * to_light_z;
+
+        // The light mirrored around the normal, 2 (n . l) n - l
+        const lane reflection_x = normal_x * (two * angle) - to_light_x;
+        const lane reflection_y = normal_y * (two * angle) - to_light_y;
+        const lane reflection_z = normal_z * (two * angle) - to_light_z;
+        const lane specular_angle = reflection_x * view_x + reflection_y * view_y + reflection_z * view_z;
+
+        lane specular_power = one, base = specular_angle;
+        for (int bit = 0; bit < bits; bit++) {
+            specular_power = simd::select(odd[bit] > zero, specular_power * base, specular_power);
+            base = base * base;
+        }
+
+        const lane falloff = lane(falloff_[light]) / distance_squared;
+        const lane lit = simd::min(one, (ambient + diffuse * angle + specular * specular_power) * falloff);
+
+        // Occluded lights only keep their ambient part, lights behind the surface add nothing
+        float blocked[width] = {};
+        for (int point = 0; point < points.size && any_occluded; point++)
+            blocked[point] = points.occluded[point] != nullptr && points.occluded[point][i] ? 1.0f : 0.0f;
+        const lane shadowed = simd::min(one, ambient * falloff);
+        chunk = chunk + simd::select(lane::loadu(blocked) > zero, shadowed, simd::select(angle < zero, zero, lit));
+
+        // Added like intensity(): width lights in single precision, then per block of 32 lights in double precision
+        const bool last = i + 1 == count;
+        if ((i + 1) % width == 0 || last) {
+            float chunk_sums[width];
+            chunk.store(chunk_sums);
+            for (int point = 0; point < width; point++)
+                block[point] += chunk_sums[point];
+            chunk = zero;
+        }
+
+        if ((i + 1) % 32 == 0 || last) {
+            for (int point = 0; point < width; point++) {
+                sums[point] += block[point];
+                block[point] = 0;
+            }
+        }
+    }
+
+    return sums;
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "aligned_allocator.h"
+#include "simd.h"
+
+#include <bardrix/camera.h>
+#include <bardrix/light.h>
+#include <bardrix/objects.h>
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+/// \brief Structure-of-arrays copy of a list of lights, shades a point with simd::native_width lights at once
+/// \details Computes the same Phong terms as calculate_light_intensity in single precision. The specular power is
+///          taken by repeated squaring, so materials with an integer shininess never call std::pow, other
+///          materials fall back to calculate_light_intensity per light.
+///          The falloff of a light is calibrated once from light::inverse_square_law at distance 1, after that it
+///          costs a division per light instead of a call.
+class light_batch {
+public:
+    /// \brief The amount of lights that are shaded per instruction
+    static constexpr int width = simd::native_width < 4 ? 4 : simd::native_width;
+
+    /// \brief The arrays are padded to a multiple of this plus one more, so a range starting anywhere fits every width
+    static constexpr std::size_t padding = 16;
+
+    /// \brief The largest shininess that is raised by repeated squaring, higher ones fall back to std::pow
+    static constexpr double max_integer_shininess = 1 << 16;
+
+    /// \brief Up to width points that are shaded together by intensities(), a point per lane
+    struct point_lanes {
+        /// \brief The amount of points, the other lanes are shaded but ignored
+        int size = 0;
+
+        /// \brief The points and their normalized normals
+        float point_x[width] = {}, point_y[width] = {}, point_z[width] = {};
+        float normal_x[width] = {}, normal_y[width] = {}, normal_z[width] = {};
+
+        /// \brief The normalized directions from the camera to the points
+        float view_x[width] = {}, view_y[width] = {}, view_z[width] = {};
+
+        /// \brief The Phong factors of the materials of the points
+        float ambient[width] = {}, diffuse[width] = {}, specular[width] = {};
+
+        /// \brief The shininess of the materials of the points, see integer_shininess
+        std::uint32_t power[width] = {};
+
+        /// \brief Per point a flag per light of the range, 1 if the light is blocked, nullptr if none are blocked
+        const std::uint8_t* occluded[width] = {};
+
+        /// \brief Adds a point, the material must have an integer_shininess
+        /// \param material The material of the shape the point lies on
+        /// \param normal The normalized normal at the point
+        /// \param point The point to shade
+        /// \param camera The camera the point is seen from
+        /// \param flags The flags of the lights of the point, may be nullptr
+        /// \example lanes.add(material, hits.normal(hit), hits.point(hit), camera, nullptr);
+        void add(const bardrix::material& material, const bardrix::vector3& normal, const bardrix::point3& point,
+                 const bardrix::camera& camera, const std::uint8_t* flags);
+    };
+
+protected:
+    /// \brief Positions of the lights
+    aligned_vector<float> position_x_, position_y_, position_z_;
+
+    /// \brief The falloff of every light at distance 1, padding uses 0 so it adds nothing
+    aligned_vector<float> falloff_;
+
+    /// \brief The lights, for the fallback
+    std::vector<bardrix::light> lights_;
+
+public:
+    // CONSTRUCTORS
+
+    /// \brief Default constructor for light_batch (empty)
+    light_batch() = default;
+
+    /// \brief Constructor for light_batch
+    /// \param lights The lights to copy
+    explicit light_batch(const std::vector<bardrix::light>& lights);
+
+    // GETTERS/SETTERS
+    NODISCARD std::size_t size() const;
+
+    /// \brief Replaces all lights, call this after lights moved or changed
+    /// \param lights The lights to copy
+    void assign(const std::vector<bardrix::light>& lights);
+
+    /// \brief Gets the falloff of a light at distance 1, at distance d the light gives unit_falloff(light) / d^2
+    /// \param light The light
+    /// \return The value of light::inverse_square_law at distance 1
+    NODISCARD static double unit_falloff(const bardrix::light& light);
+
+    /// \brief Checks if the specular power of a material is taken by repeated squaring
+    /// \param material The material to check
+    /// \return If the shininess is a whole number in [0, max_integer_shininess], otherwise std::pow is used
+    NODISCARD static bool integer_shininess(const bardrix::material& material);
+
+    // SHADING
+
+    /// \brief Sums the Phong intensity of a range of lights at a point, every light is clamped to 1 on its own
+    /// \param material The material of the shape the point lies on
+    /// \param normal The normalized normal at the point
+    /// \param point The point to shade
+    /// \param camera The camera the point is seen from
+    /// \param first The index of the first light
+    /// \param count The amount of lights
+    /// \param occluded Bit i is set if light first + i is blocked, then only its ambient part is added. Only the
+    ///        first 32 lights of the range can be marked.
+    /// \return The summed intensity, the same as adding calculate_light_intensity of every light
+    /// \example double intensity = lights.intensity(material, hit.normal, point, camera, 0, lights.size());
+    NODISCARD double intensity(const bardrix::material& material, const bardrix::vector3& normal,
+                               const bardrix::point3& point, const bardrix::camera& camera, std::size_t first,
+                               std::size_t count, std::uint32_t occluded = 0) const;
+
+    /// \brief Sums the Phong intensity of a range of lights at up to width points at once, a point per lane
+    /// \details The lights are looped one by one and every step shades all points, so the points are the vector
+    ///          instead of the lights. The sums are added in the same order as intensity() over blocks of 32 lights,
+    ///          so every point gets exactly the same intensity as when it is shaded on its own.
+    /// \param points The points to shade, their materials must have an integer_shininess
+    /// \param first The index of the first light
+    /// \param count The amount of lights
+    /// \return The summed intensity of every point
+    /// \example std::array<double, light_batch::width> sums = lights.intensities(lanes, 0, lights.size());
+    NODISCARD std::array<double, width> intensities(const point_lanes& points, std::size_t first,
+                                                    std::size_t count) const;
+}; // class light_batch
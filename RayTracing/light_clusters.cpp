@@ -0,0 +1,72 @@
+#include "light_clusters.h"
+
+#include <algorithm>
+#include <cmath>
+
+void light_clusters::build(const bardrix::camera& camera, const std::vector<bardrix::light>& lights, double cutoff,
+                           int width, int height, int tile_size, int slices, double max_distance, thread_pool* pool) {
+    tile_size_ = std::max(tile_size, 1);
+    tiles_x_ = (width + tile_size_ - 1) / tile_size_;
+    slices_ = std::max(slices, 1);
+    max_distance_ = max_distance;
+    eye_ = camera.position;
+
+    // The tiles a light reaches are the tiles the sphere of its cutoff radius projects onto
+    spheres_.resize(lights.size());
+    for (std::size_t i = 0; i < lights.size(); i++)
+        spheres_[i] = sphere(cutoff_radius(lights[i], cutoff), lights[i].position);
+    bins_.build(camera, spheres_, width, height, tile_size_, max_distance, pool);
+
+    auto slice_of = [&](double distance) {
+        return std::clamp(static_cast<int>(distance / max_distance_ * slices_), 0, slices_ - 1);
+    };
+
+    // Split the lights of every tile over the slices, counting first and copying in a second pass
+    const int tiles_y = (height + tile_size_ - 1) / tile_size_;
+    const std::size_t tiles = static_cast<std::size_t>(tiles_x_) * tiles_y;
+    offsets_.assign(tiles * slices_ + 1, 0);
+
+    auto for_each_cluster = [&](auto&& function) {
+        for (std::size_t tile = 0; tile < tiles; tile++) {
+            const auto candidates = bins_.candidates(static_cast<int>(tile % tiles_x_),
+                                                     static_cast<int>(tile / tiles_x_));
+            for (std::uint32_t id : candidates) {
+                const double distance = eye_.vector_to(lights[id].position).length();
+                const double radius = spheres_[id].get_radius();
+                for (int slice = slice_of(distance - radius); slice <= slice_of(distance + radius); slice++)
+                    function(tile * slices_ + slice, id);
+            }
+        }
+    };
+
+    for_each_cluster([&](std::size_t cluster, std::uint32_t) { offsets_[cluster + 1]++; });
+
+    for (std::size_t i = 1; i < offsets_.size(); i++)
+        offsets_[i] += offsets_[i - 1];
+
+    // The candidates of a tile are ascending, so every cluster keeps the order of the lights
+    std::vector<std::uint32_t> references(offsets_.back());
+    std::vector<std::uint32_t> cursors(offsets_.begin(), offsets_.end() - 1);
+    for_each_cluster([&](std::size_t cluster, std::uint32_t id) { references[cursors[cluster]++] = id; });
+
+    lights_.clear();
+    lights_.reserve(references.size());
+    for (std::uint32_t id : references)
+        lights_.push_back(lights[id]);
+
+    batch_.assign(lights_);
+}
+
+double light_clusters::cutoff_radius(const bardrix::light& light, double cutoff) {
+    return std::sqrt(std::max(light_batch::unit_falloff(light), 0.0) / cutoff);
+}
+
+light_range light_clusters::lights_at(int x, int y, const bardrix::point3& point) const {
+    const double distance = eye_.vector_to(point).length();
+    const int slice = std::clamp(static_cast<int>(distance / max_distance_ * slices_), 0, slices_ - 1);
+    const std::size_t tile = static_cast<std::size_t>(y / tile_size_) * tiles_x_ + x / tile_size_;
+    const std::size_t cluster = tile * slices_ + slice;
+    return { &lights_, &batch_, offsets_[cluster], offsets_[cluster + 1] - offsets_[cluster] };
+}
+
+std::size_t light_clusters::get_reference_count() const { return lights_.size(); }
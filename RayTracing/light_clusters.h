@@ -0,0 +1,105 @@
+#pragma once
+
+#include "light_batch.h"
+#include "sphere.h"
+#include "thread_pool.h"
+#include "tile_bins.h"
+
+#include <bardrix/camera.h>
+#include <bardrix/light.h>
+
+#include <cstdint>
+#include <vector>
+
+/// \brief A contiguous range of lights to shade with, either all lights of the scene or the lights of a cluster
+struct light_range {
+    /// \brief The lights the range points into
+    const std::vector<bardrix::light>* lights = nullptr;
+
+    /// \brief The same lights as structure of arrays
+    const light_batch* batch = nullptr;
+
+    /// \brief The index of the first light of the range
+    std::size_t first = 0;
+
+    /// \brief The amount of lights in the range
+    std::size_t count = 0;
+
+    /// \brief Gets a light of the range
+    /// \param i The index within the range
+    NODISCARD const bardrix::light& operator[](std::size_t i) const { return (*lights)[first + i]; }
+};
+
+/// \brief Lists of the lights that can reach every cluster, a cluster is a screen tile cut into depth slices
+/// \details A light only matters within its cutoff radius, where its falloff (light::inverse_square_law) drops
+///          below the cutoff. The sphere of that radius is projected into the tiles with tile_bins, then split over
+///          the slices by its distance to the camera. Shading a point then only loops over the lights of its
+///          cluster, so scenes with thousands of small lights cost as much as the lights that reach the point.
+///          The lights are copied cluster after cluster into a single list, so every cluster is a light_range.
+class light_clusters {
+protected:
+    /// \brief The width and height of a tile in pixels
+    int tile_size_ = 1;
+
+    /// \brief The amount of tiles along x
+    int tiles_x_ = 0;
+
+    /// \brief The amount of depth slices per tile
+    int slices_ = 1;
+
+    /// \brief The distance to the camera the slices cover, further points use the last slice
+    double max_distance_ = 1;
+
+    /// \brief The position of the camera the distances are measured from
+    bardrix::point3 eye_;
+
+    /// \brief The first light in lights_ of every cluster, one extra entry marks the end of the last cluster
+    std::vector<std::uint32_t> offsets_;
+
+    /// \brief The lights of the clusters, cluster after cluster, a light is copied into every cluster it reaches
+    std::vector<bardrix::light> lights_;
+
+    /// \brief lights_ as structure of arrays
+    light_batch batch_;
+
+    /// \brief The lights as spheres of their cutoff radius
+    std::vector<sphere> spheres_;
+
+    /// \brief The lights per tile
+    tile_bins bins_;
+
+public:
+    // BUILDING
+
+    /// \brief Finds the cutoff radius of every light and fills the clusters
+    /// \param camera The camera the primary rays are shot from
+    /// \param lights The lights of the scene
+    /// \param cutoff The falloff below which a light is left out, must be above 0
+    /// \param width The width of the frame in pixels
+    /// \param height The height of the frame in pixels
+    /// \param tile_size The width and height of a tile in pixels
+    /// \param slices The amount of depth slices per tile
+    /// \param max_distance The length of the primary rays, the slices evenly cover the distances up to it
+    /// \param pool The threads to project on, may be nullptr
+    void build(const bardrix::camera& camera, const std::vector<bardrix::light>& lights, double cutoff, int width,
+               int height, int tile_size, int slices, double max_distance, thread_pool* pool = nullptr);
+
+    /// \brief Gets the distance from a light where its falloff drops below the cutoff
+    /// \param light The light
+    /// \param cutoff The falloff below which the light is left out, must be above 0
+    /// \return The cutoff radius
+    /// \example double radius = light_clusters::cutoff_radius(light, 1.0 / 256);
+    NODISCARD static double cutoff_radius(const bardrix::light& light, double cutoff);
+
+    // GETTERS
+
+    /// \brief Gets the lights that reach a point seen through a pixel
+    /// \param x The x coordinate of the pixel
+    /// \param y The y coordinate of the pixel
+    /// \param point The point, on the primary ray of the pixel
+    /// \return The lights of the cluster of the point, in the order of the lights of the scene
+    NODISCARD light_range lights_at(int x, int y, const bardrix::point3& point) const;
+
+    /// \brief Gets the amount of lights over all clusters, a light is counted for every cluster it reaches
+    NODISCARD std::size_t get_reference_count() const;
+}; // class light_clusters
@@ -0,0 +1,153 @@
+#include "light_tree.h"
+
+#include "light_batch.h"
+
+#include <algorithm>
+#include <numeric>
+
+light_tree::light_tree(const std::vector<bardrix::light>& lights) { build(lights); }
+
+const std::vector<light_node>& light_tree::get_nodes() const { return nodes_; }
+
+void light_tree::build(const std::vector<bardrix::light>& lights) {
+    nodes_.clear();
+    leaf_of_.assign(lights.size(), invalid);
+    if (lights.empty())
+        return;
+
+    std::vector<std::uint32_t> order(lights.size());
+    std::iota(order.begin(), order.end(), 0);
+
+    // A tree with a light per leaf has 2n - 1 nodes, nodes are split in the order they're created
+    nodes_.reserve(2 * lights.size() - 1);
+    nodes_.emplace_back();
+
+    struct task {
+        std::uint32_t node, begin, end;
+    };
+    std::vector<task> stack = { { 0, 0, static_cast<std::uint32_t>(lights.size()) } };
+
+    while (!stack.empty()) {
+        const task current = stack.back();
+        stack.pop_back();
+
+        if (current.end - current.begin == 1) {
+            const std::uint32_t light = order[current.begin];
+            light_node& leaf = nodes_[current.node];
+            leaf.bounds = aabb();
+            leaf.bounds.grow(lights[light].position);
+            leaf.power = std::max(light_batch::unit_falloff(lights[light]), 0.0);
+            leaf.child = light;
+            leaf.leaf = true;
+            leaf_of_[light] = current.node;
+            continue;
+        }
+
+        aabb centers;
+        for (std::uint32_t i = current.begin; i < current.end; i++)
+            centers.grow(lights[order[i]].position);
+
+        const int axis = centers.extent(0) > centers.extent(1) ? (centers.extent(0) > centers.extent(2) ? 0 : 2)
+                                                                : (centers.extent(1) > centers.extent(2) ? 1 : 2);
+        const std::uint32_t middle = current.begin + (current.end - current.begin) / 2;
+        std::nth_element(order.begin() + current.begin, order.begin() + middle, order.begin() + current.end,
+                         [&](std::uint32_t a, std::uint32_t b) {
+                             return aabb::axis_of(lights[a].position, axis) < aabb::axis_of(lights[b].position, axis);
+                         });
+
+        const auto left = static_cast<std::uint32_t>(nodes_.size());
+        nodes_[current.node].child = left;
+        nodes_.emplace_back().parent = current.node;
+        nodes_.emplace_back().parent = current.node;
+
+        stack.push_back({ left, current.begin, middle });
+        stack.push_back({ left + 1, middle, current.end });
+    }
+
+    // Bounds and power bottom up, children always come after their parent
+    for (std::size_t i = nodes_.size(); i-- > 0;) {
+        light_node& node = nodes_[i];
+        if (node.leaf)
+            continue;
+
+        const light_node& left = nodes_[node.child];
+        const light_node& right = nodes_[node.child + 1];
+        node.bounds = left.bounds;
+        node.bounds.grow(right.bounds);
+        node.power = left.power + right.power;
+    }
+}
+
+double light_tree::importance(const light_node& node, const bardrix::point3& point,
+                              const bardrix::vector3& normal) const {
+    // A node whose box lies fully behind the surface only holds lights that add nothing
+    bool in_front = false;
+    for (int corner = 0; corner < 8 && !in_front; corner++) {
+        const bardrix::point3 position((corner & 1 ? node.bounds.max : node.bounds.min).x,
+                                       (corner & 2 ? node.bounds.max : node.bounds.min).y,
+                                       (corner & 4 ? node.bounds.max : node.bounds.min).z);
+        in_front = normal.dot(point.vector_to(position)) >= 0;
+    }
+    if (!in_front)
+        return 0;
+
+    // Power over the squared distance to the center, points inside or near the box use half its diagonal
+    const bardrix::vector3 to_center = point.vector_to(node.bounds.center());
+    const double half_diagonal_squared =
+        0.25 * (node.bounds.extent(0) * node.bounds.extent(0) + node.bounds.extent(1) * node.bounds.extent(1) +
+                node.bounds.extent(2) * node.bounds.extent(2));
+    const double distance_squared = std::max(to_center.dot(to_center), half_diagonal_squared);
+    return node.power / std::max(distance_squared, 1e-12);
+}
+
+std::optional<light_sample> light_tree::sample(const bardrix::point3& point, const bardrix::vector3& normal,
+                                               double u) const {
+    if (nodes_.empty() || importance(nodes_[0], point, normal) <= 0)
+        return std::nullopt;
+
+    // The random number is rescaled at every step, so a single number picks the whole path
+    std::uint32_t index = 0;
+    double pdf = 1;
+    while (!nodes_[index].leaf) {
+        const std::uint32_t left = nodes_[index].child;
+        const double left_importance = importance(nodes_[left], point, normal);
+        const double right_importance = importance(nodes_[left + 1], point, normal);
+        const double total = left_importance + right_importance;
+        if (total <= 0)
+            return std::nullopt;
+
+        const double probability = left_importance / total;
+        if (u < probability) {
+            u /= probability;
+            pdf *= probability;
+            index = left;
+        }
+        else {
+            u = (u - probability) / (1 - probability);
+            pdf *= 1 - probability;
+            index = left + 1;
+        }
+        u = std::min(u, 1 - 1e-12);
+    }
+
+    return light_sample{ nodes_[index].child, pdf };
+}
+
+double light_tree::pdf(const bardrix::point3& point, const bardrix::vector3& normal, std::uint32_t light) const {
+    if (light >= leaf_of_.size() || importance(nodes_[0], point, normal) <= 0)
+        return 0;
+
+    // The product of the probabilities of the steps from the root down to the leaf
+    double pdf = 1;
+    for (std::uint32_t index = leaf_of_[light]; nodes_[index].parent != invalid; index = nodes_[index].parent) {
+        const std::uint32_t left = nodes_[nodes_[index].parent].child;
+        const double left_importance = importance(nodes_[left], point, normal);
+        const double right_importance = importance(nodes_[left + 1], point, normal);
+        const double total = left_importance + right_importance;
+        if (total <= 0)
+            return 0;
+        pdf *= (index == left ? left_importance : right_importance) / total;
+    }
+
+    return pdf;
+}
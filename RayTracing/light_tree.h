@@ -0,0 +1,98 @@
+#pragma once
+
+#include "aabb.h"
+
+#include <bardrix/light.h>
+
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <vector>
+
+/// \brief Node of a light_tree
+struct light_node {
+    /// \brief The bounds of the lights below this node
+    aabb bounds;
+
+    /// \brief The summed falloff at distance 1 of the lights below this node (light_batch::unit_falloff)
+    double power = 0;
+
+    /// \brief The index of the left child, the right child follows it, or the index of the light for a leaf
+    std::uint32_t child = 0;
+
+    /// \brief The index of the parent, light_tree::invalid for the root
+    std::uint32_t parent = std::numeric_limits<std::uint32_t>::max();
+
+    /// \brief If this node is a single light
+    bool leaf = false;
+};
+
+/// \brief A light picked by light_tree::sample
+struct light_sample {
+    /// \brief The index of the light
+    std::uint32_t light = 0;
+
+    /// \brief The probability the light was picked with
+    double pdf = 0;
+};
+
+/// \brief Binary tree over the lights to pick a light per shading point with a probability that follows its
+///        expected contribution (stochastic lightcuts)
+/// \details Every step down the tree picks a child with a probability proportional to its importance: its power over
+///          its squared distance to the point, 0 when the whole child lies behind the surface. Picking a light costs
+///          O(log lights), and dividing its contribution by its pdf gives an unbiased estimate of the sum over all
+///          lights, as every light that can contribute keeps a pdf above 0.
+class light_tree {
+public:
+    /// \brief The index used for "no node"
+    static constexpr std::uint32_t invalid = std::numeric_limits<std::uint32_t>::max();
+
+protected:
+    /// \brief The nodes, the root first, the children of a node are next to each other
+    std::vector<light_node> nodes_;
+
+    /// \brief The leaf of every light
+    std::vector<std::uint32_t> leaf_of_;
+
+public:
+    // CONSTRUCTORS
+
+    /// \brief Default constructor for light_tree (empty)
+    light_tree() = default;
+
+    /// \brief Constructor for light_tree, builds the tree
+    /// \param lights The lights to build over
+    explicit light_tree(const std::vector<bardrix::light>& lights);
+
+    // GETTERS
+    NODISCARD const std::vector<light_node>& get_nodes() const;
+
+    // BUILDING
+
+    /// \brief (Re)builds the tree, splitting the lights at the median of the longest axis
+    /// \param lights The lights to build over
+    void build(const std::vector<bardrix::light>& lights);
+
+    // SAMPLING
+
+    /// \brief Picks a light for a point
+    /// \param point The point to shade
+    /// \param normal The normal at the point, lights behind the surface are never picked
+    /// \param u A uniform random number in [0, 1)
+    /// \return The picked light and its pdf, std::nullopt if no light can reach the point
+    /// \example auto sample = tree.sample(point, hit.normal, random(generator));
+    NODISCARD std::optional<light_sample> sample(const bardrix::point3& point, const bardrix::vector3& normal,
+                                                 double u) const;
+
+    /// \brief Gets the probability sample picks a light with
+    /// \param point The point to shade
+    /// \param normal The normal at the point
+    /// \param light The index of the light
+    /// \return The probability, 0 if the light can't be picked
+    NODISCARD double pdf(const bardrix::point3& point, const bardrix::vector3& normal, std::uint32_t light) const;
+
+protected:
+    /// \brief Gets how much a node is expected to add to a point
+    NODISCARD double importance(const light_node& node, const bardrix::point3& point,
+                                const bardrix::vector3& normal) const;
+}; // class light_tree
@@ -0,0 +1,95 @@
+#include "morton.h"
+
+#include <algorithm>
+
+namespace {
+    /// \brief Spreads the lowest 10 bits so there are two zero bits between every bit
+    std::uint64_t spread10(std::uint64_t value) {
+        value &= 0x3FF;
+        value = (value | value << 16) & 0x030000FF;
+        value = (value | value << 8) & 0x0300F00F;
+        value = (value | value << 4) & 0x030C30C3;
+        value = (value | value << 2) & 0x09249249;
+        return value;
+    }
+
+    /// \brief Spreads the lowest 21 bits so there are two zero bits between every bit
+    std::uint64_t spread21(std::uint64_t value) {
+        value &= 0x1FFFFF;
+        value = (value | value << 32) & 0x001F00000000FFFF;
+        value = (value | value << 16) & 0x001F0000FF0000FF;
+        value = (value | value << 8) & 0x100F00F00F00F00F;
+        value = (value | value << 4) & 0x10C30C30C30C30C3;
+        value = (value | value << 2) & 0x1249249249249249;
+        return value;
+    }
+
+    /// \brief The amount of elements per chunk of the radix sort
+    constexpr std::size_t chunk_size = 1u << 16;
+
+    /// \brief The amount of bits sorted per pass
+    constexpr int radix_bits = 8;
+    constexpr std::size_t radix = 1u << radix_bits;
+} // namespace
+
+std::uint64_t morton::encode30(std::uint32_t x, std::uint32_t y, std::uint32_t z) {
+    return spread10(x) << 2 | spread10(y) << 1 | spread10(z);
+}
+
+std::uint64_t morton::encode63(std::uint32_t x, std::uint32_t y, std::uint32_t z) {
+    return spread21(x) << 2 | spread21(y) << 1 | spread21(z);
+}
+
+void morton::radix_sort(std::vector<std::uint64_t>& keys, std::vector<std::uint32_t>& values, int key_bits,
+                        thread_pool* pool) {
+    const std::size_t size = keys.size();
+    const std::size_t chunks = (size + chunk_size - 1) / chunk_size;
+
+    std::vector<std::uint64_t> key_buffer(size);
+    std::vector<std::uint32_t> value_buffer(size);
+    std::vector<std::size_t> histograms(chunks * radix);
+
+    auto for_each_chunk = [&](const std::function<void(std::size_t, std::size_t, std::size_t)>& function) {
+        auto run = [&](std::size_t first, std::size_t last) {
+            for (std::size_t chunk = first; chunk < last; chunk++)
+                function(chunk, chunk * chunk_size, std::min((chunk + 1) * chunk_size, size));
+        };
+
+        if (pool != nullptr)
+            pool->parallel_for(0, chunks, 1, run);
+        else
+            run(0, chunks);
+    };
+
+    for (int shift = 0; shift < key_bits; shift += radix_bits) {
+        // Count the digits per chunk
+        std::fill(histograms.begin(), histograms.end(), 0);
+        for_each_chunk([&](std::size_t chunk, std::size_t begin, std::size_t end) {
+            std::size_t* histogram = &histograms[chunk * radix];
+            for (std::size_t i = begin; i < end; i++)
+                histogram[keys[i] >> shift & (radix - 1)]++;
+        });
+
+        // Turn the counts into offsets, ordered by digit first and chunk second so the sort stays stable
+        std::size_t offset = 0;
+        for (std::size_t digit = 0; digit < radix; digit++)
+            for (std::size_t chunk = 0; chunk < chunks; chunk++) {
+                const std::size_t count = histograms[chunk * radix + digit];
+                histograms[chunk * radix + digit] = offset;
+                offset += count;
+            }
+
+        // Every chunk scatters into its own offsets
+        for_each_chunk([&](std::size_t chunk, std::size_t begin, std::size_t end) {
+            std::size_t* offsets = &histograms[chunk * radix];
+            for (std::size_t i = begin; i < end; i++) {
+                const std::size_t destination = offsets[keys[i] >> shift & (radix - 1)]++;
+                key_buffer[destination] = keys[i];
+                value_buffer[destination] = values[i];
+            }
+        });
+
+        keys.swap(key_buffer);
+        values.swap(value_buffer);
+    }
+}
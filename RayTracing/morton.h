@@ -0,0 +1,34 @@
+#pragma once
+
+#include "thread_pool.h"
+
+#include <cstdint>
+#include <vector>
+
+/// \brief Morton (Z-order) codes and the radix sort used to order them
+namespace morton {
+
+    /// \brief Interleaves three 10 bit coordinates into a 30 bit code
+    /// \param x The x coordinate, only the lowest 10 bits are used
+    /// \param y The y coordinate, only the lowest 10 bits are used
+    /// \param z The z coordinate, only the lowest 10 bits are used
+    /// \return The code with the bits ordered ...x1y1z1x0y0z0
+    NODISCARD std::uint64_t encode30(std::uint32_t x, std::uint32_t y, std::uint32_t z);
+
+    /// \brief Interleaves three 21 bit coordinates into a 63 bit code
+    /// \param x The x coordinate, only the lowest 21 bits are used
+    /// \param y The y coordinate, only the lowest 21 bits are used
+    /// \param z The z coordinate, only the lowest 21 bits are used
+    /// \return The code with the bits ordered ...x1y1z1x0y0z0
+    NODISCARD std::uint64_t encode63(std::uint32_t x, std::uint32_t y, std::uint32_t z);
+
+    /// \brief Sorts keys ascending together with their values using a stable LSD radix sort (8 bits per pass)
+    /// \param keys The keys to sort
+    /// \param values The values to move along with the keys, same size as keys
+    /// \param key_bits The amount of low bits of the keys that are used, passes over zero bits are skipped
+    /// \param pool The threads to sort on, nullptr to sort on the calling thread only
+    /// \details Every pass builds a histogram per fixed size chunk, so the result doesn't depend on the threads.
+    void radix_sort(std::vector<std::uint64_t>& keys, std::vector<std::uint32_t>& values, int key_bits,
+                    thread_pool* pool = nullptr);
+
+} // namespace morton
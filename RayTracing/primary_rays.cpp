@@ -0,0 +1,68 @@
+#include "primary_rays.h"
+
+namespace {
+    template <typename T>
+    bool same(const T& a, const T& b) { return a.x == b.x && a.y == b.y && a.z == b.z; }
+} // namespace
+
+bool primary_rays::update(const bardrix::camera& camera, int width, int height, double length, thread_pool* pool) {
+    if (width <= 0 || height <= 0)
+        return false;
+
+    // The corner rays change with every move, turn or zoom of the camera
+    const bardrix::ray top_left = *camera.shoot_ray(0, 0, length);
+    const bardrix::vector3 corners[3] = { top_left.get_direction(),
+                                          camera.shoot_ray(width - 1, 0, length)->get_direction(),
+                                          camera.shoot_ray(0, height - 1, length)->get_direction() };
+
+    if (width == width_ && height == height_ && length == length_ && same(top_left.position, origin_) &&
+        same(corners[0], corners_[0]) && same(corners[1], corners_[1]) && same(corners[2], corners_[2]))
+        return false;
+
+    width_ = width;
+    height_ = height;
+    length_ = length;
+    origin_ = top_left.position;
+    std::copy(corners, corners + 3, corners_);
+
+    const std::size_t pixels = static_cast<std::size_t>(width) * height;
+    direction_x_.resize(pixels);
+    direction_y_.resize(pixels);
+    direction_z_.resize(pixels);
+
+    auto build_rows = [&](std::size_t begin, std::size_t end) {
+        for (std::size_t y = begin; y < end; y++) {
+            for (int x = 0; x < width; x++) {
+                const bardrix::vector3 direction = camera.shoot_ray(x, static_cast<int>(y), length)->get_direction();
+                const std::size_t i = y * width + x;
+                direction_x_[i] = direction.x;
+                direction_y_[i] = direction.y;
+                direction_z_[i] = direction.z;
+            }
+        }
+    };
+
+    if (pool != nullptr)
+        pool->parallel_for(0, height, 16, build_rows);
+    else
+        build_rows(0, height);
+
+    return true;
+}
+
+int primary_rays::get_width() const { return width_; }
+
+int primary_rays::get_height() const { return height_; }
+
+bool primary_rays::contains(int x, int y) const { return x >= 0 && y >= 0 && x < width_ && y < height_; }
+
+bardrix::ray primary_rays::ray(int x, int y) const { return { origin_, direction(x, y), length_ }; }
+
+const bardrix::point3& primary_rays::origin() const { return origin_; }
+
+bardrix::vector3 primary_rays::direction(int x, int y) const {
+    const std::size_t i = static_cast<std::size_t>(y) * width_ + x;
+    return { direction_x_[i], direction_y_[i], direction_z_[i] };
+}
+
+double primary_rays::get_length() const { return length_; }
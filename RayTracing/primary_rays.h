@@ -0,0 +1,72 @@
+#pragma once
+
+#include "aligned_allocator.h"
+#include "thread_pool.h"
+
+#include <bardrix/camera.h>
+#include <bardrix/ray.h>
+
+#include <vector>
+
+/// \brief Table of the normalized primary ray directions of every pixel, kept from frame to frame
+/// \details The directions are stored as structure of arrays, row after row. update() compares the size of the
+///          frame and the corner rays of the camera with the ones the table was built from, so the table is only
+///          rebuilt after a resize or when the camera moved, turned or zoomed. Repeated frames of a still camera
+///          then read their primary rays instead of calling camera.shoot_ray for every pixel.
+class primary_rays {
+protected:
+    /// \brief The width of the table in pixels
+    int width_ = 0;
+
+    /// \brief The height of the table in pixels
+    int height_ = 0;
+
+    /// \brief The length of the rays
+    double length_ = 0;
+
+    /// \brief The origin of all rays, the position of the camera
+    bardrix::point3 origin_;
+
+    /// \brief The directions of the rays through the top left, top right and bottom left pixel
+    bardrix::vector3 corners_[3];
+
+    /// \brief The directions of the rays, row after row
+    aligned_vector<double> direction_x_, direction_y_, direction_z_;
+
+public:
+    // BUILDING
+
+    /// \brief Rebuilds the table when the camera or the size of the frame changed since the last update
+    /// \param camera The camera to shoot the rays from
+    /// \param width The width of the frame in pixels
+    /// \param height The height of the frame in pixels
+    /// \param length The length of the rays
+    /// \param pool The threads to build on, may be nullptr
+    /// \return If the table was rebuilt
+    /// \example if (rays.update(camera, width, height, 10, pool)) { ... }
+    bool update(const bardrix::camera& camera, int width, int height, double length, thread_pool* pool = nullptr);
+
+    // GETTERS
+    NODISCARD int get_width() const;
+    NODISCARD int get_height() const;
+
+    /// \brief Checks if the table holds a pixel
+    NODISCARD bool contains(int x, int y) const;
+
+    /// \brief Gets the primary ray of a pixel
+    /// \param x The x coordinate of the pixel, must be in the table
+    /// \param y The y coordinate of the pixel, must be in the table
+    /// \return The ray, as camera.shoot_ray would return it
+    NODISCARD bardrix::ray ray(int x, int y) const;
+
+    /// \brief Gets the origin of all rays
+    NODISCARD const bardrix::point3& origin() const;
+
+    /// \brief Gets the normalized direction of the ray of a pixel
+    /// \param x The x coordinate of the pixel, must be in the table
+    /// \param y The y coordinate of the pixel, must be in the table
+    NODISCARD bardrix::vector3 direction(int x, int y) const;
+
+    /// \brief Gets the length of the rays
+    NODISCARD double get_length() const;
+}; // class primary_rays
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "hit_record.h"
+
+#include <bardrix/ray.h>
+
+#include <array>
+#include <optional>
+
+/// \brief Up to eight rays that are traced together, e.g. the primary rays of an 8x1 or 4x2 block of pixels
+/// \details Packets pay off when the rays are coherent (close origins, similar directions), then a node that is
+///          fetched once is tested against all rays at the same time.
+struct ray_packet {
+    /// \brief The maximum amount of rays in a packet, one per lane of an 8 wide vector
+    static constexpr int max_size = 8;
+
+    /// \brief The origins of the rays
+    bardrix::point3 origins[max_size];
+
+    /// \brief The normalized directions of the rays
+    bardrix::vector3 directions[max_size];
+
+    /// \brief The maximum distance along every ray
+    double t_max[max_size] = {};
+
+    /// \brief The minimum distance along every ray
+    double t_min = 0;
+
+    /// \brief The amount of rays in the packet
+    int size = 0;
+
+    /// \brief Adds a ray to the packet
+    /// \param ray The ray to add
+    /// \param max_distance The maximum distance along the ray
+    /// \example packet.add(ray, ray.get_length());
+    void add(const bardrix::ray& ray, double max_distance) {
+        origins[size] = ray.position;
+        directions[size] = ray.get_direction();
+        t_max[size] = max_distance;
+        size++;
+    }
+
+    /// \brief Adds a ray to the packet
+    /// \param origin The origin of the ray
+    /// \param direction The normalized direction of the ray
+    /// \param max_distance The maximum distance along the ray
+    /// \example packet.add(point, point.vector_to(light.position).normalized(), distance);
+    void add(const bardrix::point3& origin, const bardrix::vector3& direction, double max_distance) {
+        origins[size] = origin;
+        directions[size] = direction;
+        t_max[size] = max_distance;
+        size++;
+    }
+};
+
+/// \brief The nearest hit of every ray of a packet, in the order the rays were added
+using packet_hits = std::array<std::optional<hit_record>, ray_packet::max_size>;
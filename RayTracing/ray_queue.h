@@ -0,0 +1,159 @@
+#pragma once
+
+#include "aligned_allocator.h"
+#include "light_clusters.h"
+
+#include <bardrix/ray.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// \brief Structure-of-arrays queue of rays, the input of a stage of the wavefront renderer
+/// \details Every component lives in its own cache line aligned array, a stage walks the queue front to back so the
+///          next rays are always in the cache. The queues are cleared and refilled, their memory is kept.
+struct ray_queue {
+    /// \brief The origins of the rays
+    aligned_vector<double> origin_x, origin_y, origin_z;
+
+    /// \brief The normalized directions of the rays
+    aligned_vector<double> direction_x, direction_y, direction_z;
+
+    /// \brief The maximum distance along every ray
+    aligned_vector<double> t_max;
+
+    /// \brief What every ray belongs to, e.g. the pixel of a primary ray or the hit and light of a shadow ray
+    std::vector<std::uint32_t> owner;
+
+    /// \brief Gets the amount of rays in the queue
+    NODISCARD std::size_t size() const { return owner.size(); }
+
+    /// \brief Removes all rays, keeps the memory
+    void clear() {
+        origin_x.clear();
+        origin_y.clear();
+        origin_z.clear();
+        direction_x.clear();
+        direction_y.clear();
+        direction_z.clear();
+        t_max.clear();
+        owner.clear();
+    }
+
+    /// \brief Adds a ray to the queue
+    /// \param origin The origin of the ray
+    /// \param direction The normalized direction of the ray
+    /// \param max_distance The maximum distance along the ray
+    /// \param ray_owner What the ray belongs to
+    /// \example queue.push(ray.position, ray.get_direction(), ray.get_length(), y * width + x);
+    void push(const bardrix::point3& origin, const bardrix::vector3& direction, double max_distance,
+              std::uint32_t ray_owner) {
+        origin_x.push_back(origin.x);
+        origin_y.push_back(origin.y);
+        origin_z.push_back(origin.z);
+        direction_x.push_back(direction.x);
+        direction_y.push_back(direction.y);
+        direction_z.push_back(direction.z);
+        t_max.push_back(max_distance);
+        owner.push_back(ray_owner);
+    }
+
+    /// \brief Gets the origin of a ray
+    NODISCARD bardrix::point3 origin(std::size_t i) const { return { origin_x[i], origin_y[i], origin_z[i] }; }
+
+    /// \brief Gets the direction of a ray
+    NODISCARD bardrix::vector3 direction(std::size_t i) const {
+        return { direction_x[i], direction_y[i], direction_z[i] };
+    }
+};
+
+/// \brief Structure-of-arrays queue of hits, the compacted output of the intersect stage of the wavefront renderer
+struct hit_queue {
+    /// \brief The intersection points
+    aligned_vector<double> point_x, point_y, point_z;
+
+    /// \brief The normalized normals at the intersection points
+    aligned_vector<double> normal_x, normal_y, normal_z;
+
+    /// \brief The index of the intersected sphere
+    std::vector<std::uint32_t> id;
+
+    /// \brief The index of the ray that produced the hit in its ray_queue
+    std::vector<std::uint32_t> ray;
+
+    /// \brief The owner of the ray that produced the hit, the pixel for primary rays
+    std::vector<std::uint32_t> owner;
+
+    /// \brief Gets the amount of hits in the queue
+    NODISCARD std::size_t size() const { return id.size(); }
+
+    /// \brief Removes all hits, keeps the memory
+    void clear() {
+        point_x.clear();
+        point_y.clear();
+        point_z.clear();
+        normal_x.clear();
+        normal_y.clear();
+        normal_z.clear();
+        id.clear();
+        ray.clear();
+        owner.clear();
+    }
+
+    /// \brief Adds a hit to the queue
+    /// \param point The intersection point
+    /// \param normal The normalized normal at the intersection point
+    /// \param sphere_id The index of the intersected sphere
+    /// \param rays The queue of the ray that produced the hit
+    /// \param ray_index The index of the ray in rays
+    /// \example hits.push(point, normal, id, rays, i);
+    void push(const bardrix::point3& point, const bardrix::vector3& normal, std::uint32_t sphere_id,
+              const ray_queue& rays, std::size_t ray_index) {
+        point_x.push_back(point.x);
+        point_y.push_back(point.y);
+        point_z.push_back(point.z);
+        normal_x.push_back(normal.x);
+        normal_y.push_back(normal.y);
+        normal_z.push_back(normal.z);
+        id.push_back(sphere_id);
+        ray.push_back(static_cast<std::uint32_t>(ray_index));
+        owner.push_back(rays.owner[ray_index]);
+    }
+
+    /// \brief Replaces the point and normal of a hit, e.g. after refining it in double precision
+    void replace(std::size_t i, const bardrix::point3& point, const bardrix::vector3& normal) {
+        point_x[i] = point.x;
+        point_y[i] = point.y;
+        point_z[i] = point.z;
+        normal_x[i] = normal.x;
+        normal_y[i] = normal.y;
+        normal_z[i] = normal.z;
+    }
+
+    /// \brief Gets an intersection point
+    NODISCARD bardrix::point3 point(std::size_t i) const { return { point_x[i], point_y[i], point_z[i] }; }
+
+    /// \brief Gets a normal
+    NODISCARD bardrix::vector3 normal(std::size_t i) const { return { normal_x[i], normal_y[i], normal_z[i] }; }
+};
+
+/// \brief The queues a thread of the wavefront renderer reuses from tile to tile
+struct wavefront_queues {
+    /// \brief The primary rays of a tile
+    ray_queue primary;
+
+    /// \brief The hits of the primary rays
+    hit_queue hits;
+
+    /// \brief The lights that reach every hit
+    std::vector<light_range> lights;
+
+    /// \brief The shadow rays of the hits, owned by the index of their flag in occluded
+    ray_queue shadows;
+
+    /// \brief The first flag in occluded of every hit, followed by the flags of the other lights of the hit
+    std::vector<std::uint32_t> occluded_first;
+
+    /// \brief Per hit and light if the light is blocked
+    std::vector<std::uint8_t> occluded;
+};
@@ -0,0 +1,92 @@
+#include "render_thread.h"
+
+#include <utility>
+
+render_thread::render_thread(render_function render, std::function<void()> on_frame)
+    : render_(std::move(render)), on_frame_(std::move(on_frame)), thread_([this] { run(); }) {}
+
+render_thread::~render_thread() { stop(); }
+
+void render_thread::request(int width, int height) {
+    {
+        std::lock_guard lock(mutex_);
+        width_ = width;
+        height_ = height;
+        requested_ = true;
+        generation_++;
+    }
+    wake_.notify_one();
+}
+
+void render_thread::post(std::function<void()> change) {
+    {
+        std::lock_guard lock(mutex_);
+        changes_.push_back(std::move(change));
+        requested_ = true;
+        generation_++;
+    }
+    wake_.notify_one();
+}
+
+void render_thread::stop() {
+    {
+        std::lock_guard lock(mutex_);
+        stopping_ = true;
+        generation_++; // The frame in flight stops within a tile
+    }
+    wake_.notify_one();
+
+    if (thread_.joinable())
+        thread_.join();
+}
+
+void render_thread::present(const framebuffer& pixels, int width, int height) {
+    rendered_frame& frame = frames_.back();
+    frame.pixels = pixels;
+    frame.width = width;
+    frame.height = height;
+    frame.number = ++rendered_;
+    frames_.publish();
+
+    if (on_frame_)
+        on_frame_();
+}
+
+const rendered_frame* render_thread::latest() {
+    frames_.update();
+    return frames_.front().number == 0 ? nullptr : &frames_.front();
+}
+
+void render_thread::run() {
+    std::vector<std::function<void()>> changes;
+    framebuffer pixels;
+    while (true) {
+        int width, height;
+        cancel_token token;
+        {
+            std::unique_lock lock(mutex_);
+            wake_.wait(lock, [this] { return requested_ || stopping_; });
+            if (stopping_)
+                return;
+
+            // Requests that arrive from here on are merged into the next frame
+            width = width_;
+            height = height_;
+            requested_ = false;
+            changes.swap(changes_);
+            token = cancel_token(generation_);
+        }
+
+        for (const std::function<void()>& change : changes)
+            change();
+        changes.clear();
+
+        if (width <= 0 || height <= 0)
+            continue; // e.g. a minimized window
+
+        // A superseded frame is never shown, the frame for the newer request follows right away
+        render_(pixels, width, height, token);
+        if (!token.cancelled())
+            present(pixels, width, height);
+    }
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include "cancel_token.h"
+#include "framebuffer.h"
+#include "triple_buffer.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// \brief A complete frame, as handed from the render thread to the presenter
+struct rendered_frame {
+    /// \brief The pixels in the AARRGGBB format, row after row
+    framebuffer pixels;
+
+    /// \brief The width of the frame
+    int width = 0;
+
+    /// \brief The height of the frame
+    int height = 0;
+
+    /// \brief The number of the frame, counting from 1
+    std::uint64_t number = 0;
+};
+
+/// \brief Renders frames on a thread of its own, so a slow frame never blocks the thread that shows them
+/// \details Frames are requested with request() from any thread, requests that arrive during a frame are merged into
+///          the next frame. Every request bumps a generation counter, so the frame in progress is cancelled through
+///          its cancel_token and only the latest state is rendered. Complete frames are handed over through a
+///          lock-free triple_buffer, the presenting thread takes the newest one with latest(). Everything the render
+///          function touches (camera, spheres, lights) must only be changed on the render thread, through post() or
+///          from the render function itself.
+class render_thread {
+public:
+    /// \brief Renders a frame, e.g. through renderer::render
+    /// \param buffer The buffer to render to, resized to width * height when needed. It is owned by the render thread
+    ///        and still holds the last frame, e.g. for renderer::render_dirty; complete frames are copied out of it.
+    /// \param width The width of the frame
+    /// \param height The height of the frame
+    /// \param token Cancelled once a newer frame was requested, pass it on to renderer::render
+    using render_function =
+        std::function<void(framebuffer& buffer, int width, int height, const cancel_token& token)>;
+
+protected:
+    /// \brief Renders the frames
+    render_function render_;
+
+    /// \brief Called on the render thread after every frame, e.g. to make a window repaint
+    std::function<void()> on_frame_;
+
+    /// \brief The frames that are handed to the presenter
+    triple_buffer<rendered_frame> frames_;
+
+    /// \brief Guards the request and stop flags
+    std::mutex mutex_;
+
+    /// \brief Wakes the render thread when a frame is requested or when it has to stop
+    std::condition_variable wake_;
+
+    /// \brief The size of the requested frame
+    int width_ = 0, height_ = 0;
+
+    /// \brief If a frame was requested since the last frame started
+    bool requested_ = false;
+
+    /// \brief The changes posted since the last frame started, applied in order before the next frame
+    std::vector<std::function<void()>> changes_;
+
+    /// \brief Bumped by every request, the frame in progress is cancelled once it moved on
+    std::atomic<std::uint64_t> generation_ = 0;
+
+    /// \brief If the render thread has to stop
+    bool stopping_ = false;
+
+    /// \brief The amount of frames rendered, only used by the render thread
+    std::uint64_t rendered_ = 0;
+
+    /// \brief The render thread, started last so every member exists before it runs
+    std::thread thread_;
+
+    /// \brief The loop of the render thread
+    void run();
+
+public:
+    // CONSTRUCTORS
+
+    /// \brief Constructor for render_thread, starts the thread
+    /// \param render Renders a frame, called on the render thread
+    /// \param on_frame Called on the render thread after a frame was handed over, may be empty
+    /// \example render_thread thread([&](auto& buffer, int w, int h) { renderer.render(buffer, w, h); });
+    explicit render_thread(render_function render, std::function<void()> on_frame = {});
+
+    /// \brief Destructor for render_thread, cancels the current frame and stops the thread
+    ~render_thread();
+
+    render_thread(const render_thread&) = delete;
+    render_thread& operator=(const render_thread&) = delete;
+
+    // RENDERING
+
+    /// \brief Requests a frame, returns right away and cancels the frame in progress
+    /// \param width The width of the frame
+    /// \param height The height of the frame
+    void request(int width, int height);
+
+    /// \brief Changes the scene on the render thread before the next frame and requests that frame, e.g. to move
+    ///        the camera. Returns right away and cancels the frame in progress.
+    /// \param change The change, called on the render thread
+    /// \example thread.post([&camera] { camera.position = position; });
+    void post(std::function<void()> change);
+
+    /// \brief Cancels the current frame and stops the thread, later requests are ignored
+    void stop();
+
+    // PRESENTING
+
+    /// \brief Hands an unfinished image over before the frame is complete, only call this from the render function
+    /// \param pixels The image in the AARRGGBB format, copied
+    /// \param width The width of the image
+    /// \param height The height of the image
+    /// \example renderer.render_progressive(buffer, w, h, [&](auto& image, int) { thread.present(image, w, h); });
+    void present(const framebuffer& pixels, int width, int height);
+
+    /// \brief Gets the newest complete frame, only call this from the one presenting thread
+    /// \return The frame, nullptr before the first frame is complete. It stays valid until the next call.
+    /// \example if (const rendered_frame* frame = thread.latest()) blit(frame->pixels, frame->width, frame->height);
+    NODISCARD const rendered_frame* latest();
+}; // class render_thread
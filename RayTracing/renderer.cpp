@@ -0,0 +1,927 @@
+#include "renderer.h"
+
+#include "bvh.h"
+#include "bvh8.h"
+#include "sphere_batch.h"
+#include "uniform_grid.h"
+
+#include <bardrix/quaternion.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iterator>
+#include <limits>
+
+double calculate_light_intensity(const bardrix::shape& shape, const bardrix::light& light, const bardrix::camera& camera,
+                                 const bardrix::point3& intersection_point) {
+    return calculate_light_intensity(shape.get_material(), shape.normal_at(intersection_point), light, camera,
+                                     intersection_point);
+}
+
+double calculate_light_intensity(const bardrix::material& material, const bardrix::vector3& normal,
+                                 const bardrix::light& light, const bardrix::camera& camera,
+                                 const bardrix::point3& intersection_point) {
+    const bardrix::vector3 light_intersection_vector = intersection_point.vector_to(light.position).normalized();
+
+    // Angle between the normal and the light intersection vector
+    const double angle = normal.dot(light_intersection_vector);
+
+    if (angle < 0) // This means the light is behind the intersection_point
+        return 0;
+
+    // Specular reflection
+    bardrix::vector3 reflection = bardrix::quaternion::mirror(light_intersection_vector, normal);
+    double specular_angle = reflection.dot(camera.position.vector_to(intersection_point).normalized());
+    double specular = std::pow(specular_angle, material.get_shininess());
+
+    // We're calculating phong shading (ambient + diffuse + specular)
+    double intensity = material.get_ambient();
+    intensity += material.get_diffuse() * angle;
+    intensity += material.get_specular() * specular;
+
+    // Max intensity is 1
+    return std::min(1.0, intensity * light.inverse_square_law(intersection_point));
+}
+
+double render_stats::rays_per_second() const {
+    return seconds > 0 ? static_cast<double>(rays) / seconds : 0;
+}
+
+renderer::renderer(const bardrix::camera& camera, const std::vector<sphere>& spheres,
+                   const std::vector<bardrix::light>& lights, const render_options& options)
+    : camera_(camera), spheres_(spheres), lights_(lights), options_(options),
+      pool_(std::make_unique<thread_pool>(options.threads)), light_batch_(lights) {
+    rebuild();
+}
+
+const render_options& renderer::get_options() const { return options_; }
+
+void renderer::set_options(const render_options& options) {
+    const bool threads_changed = options.threads != options_.threads;
+    const bool acceleration_changed =
+        options.acceleration != options_.acceleration || options.morton_bits != options_.morton_bits ||
+        options.grid_cells_per_sphere != options_.grid_cells_per_sphere;
+
+    this->options_ = options;
+    redraw_all_ = true;
+    lights_stale_ = true;
+
+    if (threads_changed)
+        pool_ = std::make_unique<thread_pool>(options_.threads);
+    if (acceleration_changed)
+        rebuild();
+
+    accelerator_->set_collect_statistics(options_.collect_statistics);
+}
+
+const accelerator& renderer::get_accelerator() const { return *accelerator_; }
+
+void renderer::rebuild() {
+    for (frame_view& view : views_)
+        view.hits.valid = false;
+    redraw_all_ = true;
+
+    sphere_bounds_.resize(spheres_.size());
+    for (std::size_t i = 0; i < spheres_.size(); i++)
+        sphere_bounds_[i] = aabb::of_sphere(spheres_[i].get_position(), spheres_[i].get_radius());
+
+    switch (options_.acceleration) {
+    case acceleration_structure::linear:
+        accelerator_ = std::make_unique<sphere_batch>(spheres_);
+        break;
+    case acceleration_structure::bvh:
+        accelerator_ = std::make_unique<bvh>(spheres_, pool_.get());
+        break;
+    case acceleration_structure::lbvh:
+        accelerator_ = std::make_unique<bvh>(spheres_, pool_.get(),
+                                             options_.morton_bits > 30 ? bvh_builder::morton63 : bvh_builder::morton30);
+        break;
+    case acceleration_structure::bvh8:
+        accelerator_ = std::make_unique<bvh8>(spheres_, pool_.get());
+        break;
+    case acceleration_structure::grid:
+        accelerator_ = std::make_unique<uniform_grid>(spheres_, options_.grid_cells_per_sphere);
+        break;
+    }
+
+    accelerator_->set_collect_statistics(options_.collect_statistics);
+}
+
+void renderer::lights_changed() {
+    lights_stale_ = true;
+    redraw_all_ = true; // Every pixel may be lit differently, the primary hits still hold
+}
+
+bool renderer::refit(const std::vector<std::uint32_t>& changed) {
+    for (frame_view& view : views_)
+        view.hits.valid = false;
+
+    // Spheres were added or removed, the structure was built over a different scene
+    if (sphere_bounds_.size() != spheres_.size()) {
+        rebuild();
+        return true;
+    }
+
+    // Indices past the last sphere are dropped once, the structures index their arrays with them
+    const auto in_range = [this](std::uint32_t i) { return i < spheres_.size(); };
+    const bool all_in_range = std::all_of(changed.begin(), changed.end(), in_range);
+    std::vector<std::uint32_t> filtered;
+    if (!all_in_range)
+        std::copy_if(changed.begin(), changed.end(), std::back_inserter(filtered), in_range);
+    const std::vector<std::uint32_t>& moved_ids = all_in_range ? changed : filtered;
+
+    // The pixels of a moved sphere change where it was and where it is now
+    for (std::uint32_t i : moved_ids) {
+        const sphere& moved = spheres_[i];
+        if (!redraw_all_)
+            dirty_bounds_.push_back(sphere_bounds_[i]);
+        sphere_bounds_[i] = aabb::of_sphere(moved.get_position(), moved.get_radius());
+        if (!redraw_all_)
+            dirty_bounds_.push_back(sphere_bounds_[i]);
+    }
+
+    accelerator_->refit(spheres_, moved_ids);
+    if (accelerator_->get_degradation() <= options_.rebuild_threshold)
+        return false;
+
+    // Only the changed spheres moved, the dirty bounds still hold
+    const bool redraw_all = redraw_all_;
+    rebuild();
+    redraw_all_ = redraw_all;
+    return true;
+}
+
+std::optional<hit_record> renderer::closest_hit(const bardrix::ray& ray, double t_min, double t_max) const {
+    std::optional<hit_record> closest = accelerator_->closest_hit(ray, t_min, t_max);
+    if (!closest.has_value() || options_.acceleration != acceleration_structure::linear)
+        return closest;
+
+    // The batch works in single precision, redo the winner in double precision for the shading
+    std::optional<hit_record> exact = spheres_[closest->id].hit(ray, t_min, t_max);
+    if (!exact.has_value())
+        return closest; // Grazing hit that only exists in single precision
+
+    exact->id = closest->id;
+    return exact;
+}
+
+bool renderer::any_hit(const bardrix::ray& ray, double t_min, double t_max) const {
+    return accelerator_->any_hit(ray, t_min, t_max);
+}
+
+bardrix::color renderer::shade(const bardrix::ray& ray, const hit_record& hit) const {
+    return shade(hit, hit.point(ray), { &lights_, &light_batch_, 0, lights_.size() });
+}
+
+bardrix::color renderer::shade(const hit_record& hit, const bardrix::point3& point, const light_range& lights) const {
+    const bardrix::material& material = spheres_[hit.id].get_material();
+
+    // The shadow rays of up to a packet of lights are traced together
+    const std::size_t chunk = options_.shadows ? ray_packet::max_size : std::max<std::size_t>(lights.count, 1);
+
+    double intensity = 0;
+    for (std::size_t first = 0; first < lights.count; first += chunk) {
+        const std::size_t count = std::min(chunk, lights.count - first);
+        const std::uint32_t occluded =
+            options_.shadows ? occluded_lights(point, hit.normal, lights, first, static_cast<int>(count)) : 0;
+        intensity += light_intensity(material, hit.normal, point, lights, first, count, occluded);
+    }
+
+    return blend(material, intensity);
+}
+
+bardrix::color renderer::shade(const hit_record& hit, const bardrix::point3& point, int x, int y) const {
+    if (options_.light_samples <= 0)
+        return shade(hit, point, lights_at(x, y, point));
+
+    const std::uint64_t seed = (static_cast<std::uint64_t>(frame_) << 40) ^ (static_cast<std::uint64_t>(y) << 20) ^
+                               static_cast<std::uint64_t>(x);
+    return shade_sampled(hit, point, seed);
+}
+
+bardrix::color renderer::shade_sampled(const hit_record& hit, const bardrix::point3& point,
+                                       std::uint64_t seed) const {
+    const bardrix::material& material = spheres_[hit.id].get_material();
+
+    double intensity = 0;
+    for (int sample = 0; sample < options_.light_samples; sample++) {
+        // SplitMix64, every sample of every pixel gets its own independent number
+        std::uint64_t z = seed + (static_cast<std::uint64_t>(sample) + 1) * 0x9E3779B97F4A7C15ull;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        const double u = static_cast<double>((z ^ (z >> 31)) >> 11) * 0x1.0p-53;
+
+        const std::optional<light_sample> picked = light_tree_.sample(point, hit.normal, u);
+        if (!picked.has_value())
+            continue; // Only lights behind the surface were left, they add nothing
+
+        const light_range light = { &lights_, &light_batch_, picked->light, 1 };
+        const std::uint32_t occluded = options_.shadows ? occluded_lights(point, hit.normal, light, 0, 1) : 0;
+        intensity += light_intensity(material, hit.normal, point, light, 0, 1, occluded) / picked->pdf;
+    }
+
+    return blend(material, intensity / std::max(options_.light_samples, 1));
+}
+
+light_range renderer::lights_at(int x, int y, const bardrix::point3& point) const {
+    if (options_.light_cutoff > 0 && options_.light_samples <= 0)
+        return light_clusters_.lights_at(x, y, point);
+    return { &lights_, &light_batch_, 0, lights_.size() };
+}
+
+bardrix::color renderer::blend(const bardrix::material& material, double intensity) const {
+    // The color is the last light blended with the material, scaled by the summed intensity of all lights
+    if (lights_.empty())
+        return bardrix::color::green();
+    return lights_.back().color.blended(material.color) * intensity;
+}
+
+double renderer::light_intensity(const bardrix::material& material, const bardrix::vector3& normal,
+                                 const bardrix::point3& point, const light_range& lights, std::size_t first,
+                                 std::size_t count, std::uint32_t occluded) const {
+    if (options_.vectorized_shading)
+        return lights.batch->intensity(material, normal, point, camera_, lights.first + first, count, occluded);
+
+    double intensity = 0;
+    for (std::size_t i = 0; i < count; i++) {
+        const bardrix::light& light = lights[first + i];
+        intensity += i < 32 && (occluded >> i) & 1
+                         ? std::min(1.0, material.get_ambient() * light.inverse_square_law(point))
+                         : calculate_light_intensity(material, normal, light, camera_, point);
+    }
+    return intensity;
+}
+
+std::uint32_t renderer::occluded_lights(const bardrix::point3& point, const bardrix::vector3& normal,
+                                        const light_range& lights, std::size_t first, int count) const {
+    // Lights behind the surface add nothing either way, only the others get a shadow ray
+    ray_packet packet;
+    packet.t_min = shadow_epsilon;
+    int traced[ray_packet::max_size];
+    for (int i = 0; i < count; i++) {
+        const bardrix::vector3 to_light = point.vector_to(lights[first + i].position);
+        const double distance = to_light.length();
+        if (distance <= 2 * shadow_epsilon || normal.dot(to_light) < 0)
+            continue;
+
+        traced[packet.size] = i;
+        packet.add(point, to_light * (1 / distance), distance - shadow_epsilon);
+    }
+
+    if (packet.size == 0)
+        return 0;
+
+    const std::uint32_t blocked = accelerator_->any_hits(packet);
+    std::uint32_t occluded = 0;
+    for (int i = 0; i < packet.size; i++)
+        if (blocked & (1u << i))
+            occluded |= 1u << traced[i];
+
+    return occluded;
+}
+
+renderer::frame_view& renderer::view() const { return views_[view_]; }
+
+bardrix::ray renderer::primary_ray(int x, int y) const {
+    const primary_rays& table = view().rays;
+    if (table.contains(x, y))
+        return table.ray(x, y);
+
+    return *camera_.shoot_ray(x, y, primary_ray_length);
+}
+
+std::uint32_t renderer::trace_pixel(int x, int y) const {
+    // Shoot a ray from the camera to the pixel
+    bardrix::ray ray = primary_ray(x, y);
+
+    std::optional<hit_record> hit = closest_hit(ray, 0, ray.get_length());
+
+    // Default color is green
+    if (!hit.has_value())
+        return bardrix::color::green().argb();
+
+    const bardrix::point3 point = hit->point(ray);
+    return shade(hit.value(), point, x, y).argb(); // ARGB is the format used by Windows API
+}
+
+std::uint32_t renderer::trace_pixel(int x, int y, std::span<const std::uint32_t> candidates) const {
+    bardrix::ray ray = primary_ray(x, y);
+
+    double t_max = ray.get_length();
+    std::optional<hit_record> closest;
+    for (std::uint32_t id : candidates) {
+        std::optional<hit_record> hit = spheres_[id].hit(ray, 0, t_max);
+        if (hit.has_value()) {
+            t_max = hit->t;
+            closest = hit;
+            closest->id = id;
+        }
+    }
+
+    if (!closest.has_value())
+        return bardrix::color::green().argb();
+
+    const bardrix::point3 point = closest->point(ray);
+    return shade(closest.value(), point, x, y).argb();
+}
+
+std::array<std::uint32_t, ray_packet::max_size> renderer::trace_packet(int x, int y, int columns, int rows) const {
+    ray_packet packet;
+    std::optional<bardrix::ray> rays[ray_packet::max_size];
+    for (int row = 0; row < rows; row++) {
+        for (int column = 0; column < columns; column++) {
+            rays[packet.size] = primary_ray(x + column, y + row);
+            packet.add(*rays[packet.size], rays[packet.size]->get_length());
+        }
+    }
+
+    packet_hits hits;
+    accelerator_->closest_hits(packet, hits);
+
+    std::array<std::uint32_t, ray_packet::max_size> colors = {};
+    for (int i = 0; i < packet.size; i++) {
+        if (!hits[i].has_value()) {
+            colors[i] = bardrix::color::green().argb();
+            continue;
+        }
+
+        const bardrix::point3 point = hits[i]->point(*rays[i]);
+        colors[i] = shade(hits[i].value(), point, x + i % columns, y + i / columns).argb();
+    }
+
+    return colors;
+}
+
+void renderer::render_wavefront(wavefront_queues& queues, framebuffer& buffer, int width, int x0,
+                                int y0, int x1, int y1, int columns, int rows) const {
+    queues.primary.clear();
+    queues.hits.clear();
+    queues.occluded.clear();
+
+    generate_rays(queues.primary, width, x0, y0, x1, y1, columns, rows);
+    intersect_rays(queues.primary, queues.hits, buffer);
+
+    // Sampled lights differ per hit, so every hit shades on its own
+    if (options_.light_samples > 0) {
+        for (std::size_t hit = 0; hit < queues.hits.size(); hit++) {
+            hit_record record;
+            record.id = queues.hits.id[hit];
+            record.normal = queues.hits.normal(hit);
+            const std::uint32_t pixel = queues.hits.owner[hit];
+            buffer[pixel] = shade(record, queues.hits.point(hit), static_cast<int>(pixel % width),
+                                  static_cast<int>(pixel / width)).argb();
+        }
+        return;
+    }
+
+    // The lights of every hit, the pixel of a hit is its owner
+    queues.lights.resize(queues.hits.size());
+    for (std::size_t hit = 0; hit < queues.hits.size(); hit++) {
+        const std::uint32_t pixel = queues.hits.owner[hit];
+        queues.lights[hit] = lights_at(static_cast<int>(pixel % width), static_cast<int>(pixel / width),
+                                       queues.hits.point(hit));
+    }
+
+    if (options_.shadows)
+        trace_shadows(queues.hits, queues.lights, queues.shadows, queues.occluded_first, queues.occluded);
+    shade_hits(queues.hits, queues.lights, queues.occluded_first, queues.occluded, buffer);
+}
+
+void renderer::generate_rays(ray_queue& rays, int width, int x0, int y0, int x1, int y1, int columns,
+                             int rows) const {
+    for (int y = y0; y < y1; y += rows) {
+        for (int x = x0; x < x1; x += columns) {
+            for (int row = y; row < std::min(y + rows, y1); row++) {
+                for (int column = x; column < std::min(x + columns, x1); column++) {
+                    // The same directions as primary_ray, so the single precision tests pick the same spheres
+                    const bardrix::ray ray = primary_ray(column, row);
+                    rays.push(ray.position, ray.get_direction(), ray.get_length(),
+                              static_cast<std::uint32_t>(row * width + column));
+                }
+            }
+        }
+    }
+}
+
+void renderer::intersect_rays(const ray_queue& rays, hit_queue& hits, framebuffer& buffer) const {
+    // Every pixel starts as a miss, the shade stage overwrites the pixels that were hit
+    const std::uint32_t miss = bardrix::color::green().argb();
+    for (std::uint32_t owner : rays.owner)
+        buffer[owner] = miss;
+
+    accelerator_->closest_hits(rays, hits);
+    if (options_.acceleration != acceleration_structure::linear)
+        return;
+
+    // The batch works in single precision, redo the winners in double precision like closest_hit
+    for (std::size_t hit = 0; hit < hits.size(); hit++) {
+        const std::uint32_t i = hits.ray[hit];
+        const bardrix::ray ray(rays.origin(i), rays.direction(i), rays.t_max[i]);
+        const std::optional<hit_record> exact = spheres_[hits.id[hit]].hit(ray, 0, rays.t_max[i]);
+        if (exact.has_value()) // Grazing hits only exist in single precision, they keep their point
+            hits.replace(hit, exact->point(ray), exact->normal);
+    }
+}
+
+void renderer::trace_shadows(const hit_queue& hits, const std::vector<light_range>& lights, ray_queue& shadows,
+                             std::vector<std::uint32_t>& occluded_first, std::vector<std::uint8_t>& occluded) const {
+    shadows.clear();
+    occluded_first.resize(hits.size());
+    std::size_t flags = 0;
+    for (std::size_t hit = 0; hit < hits.size(); hit++) {
+        occluded_first[hit] = static_cast<std::uint32_t>(flags);
+        flags += lights[hit].count;
+    }
+    occluded.assign(flags, 0);
+
+    // Lights behind the surface add nothing either way, only the others get a shadow ray
+    for (std::size_t hit = 0; hit < hits.size(); hit++) {
+        const bardrix::point3 point = hits.point(hit);
+        const bardrix::vector3 normal = hits.normal(hit);
+        for (std::size_t light = 0; light < lights[hit].count; light++) {
+            const bardrix::vector3 to_light = point.vector_to(lights[hit][light].position);
+            const double distance = to_light.length();
+            if (distance <= 2 * shadow_epsilon || normal.dot(to_light) < 0)
+                continue;
+
+            shadows.push(point, to_light * (1 / distance), distance - shadow_epsilon,
+                         static_cast<std::uint32_t>(occluded_first[hit] + light));
+        }
+    }
+
+    // The shadow rays of a hit are next to each other, so most packets share their origin
+    for (std::size_t first = 0; first < shadows.size(); first += ray_packet::max_size) {
+        ray_packet packet;
+        packet.t_min = shadow_epsilon;
+        const std::size_t last = std::min(first + ray_packet::max_size, shadows.size());
+        for (std::size_t i = first; i < last; i++)
+            packet.add(shadows.origin(i), shadows.direction(i), shadows.t_max[i]);
+
+        const std::uint32_t blocked = accelerator_->any_hits(packet);
+        for (int lane = 0; lane < packet.size; lane++)
+            occluded[shadows.owner[first + lane]] = (blocked >> lane) & 1;
+    }
+}
+
+void renderer::shade_hits(const hit_queue& hits, const std::vector<light_range>& lights,
+                          const std::vector<std::uint32_t>& occluded_first, const std::vector<std::uint8_t>& occluded,
+                          framebuffer& buffer) const {
+    for (std::size_t first = 0; first < hits.size(); first += light_batch::width) {
+        const std::size_t last = std::min<std::size_t>(first + light_batch::width, hits.size());
+
+        // Hits with the same lights are the lanes of the batch, neighbouring pixels mostly share their cluster
+        bool shared = options_.vectorized_shading;
+        for (std::size_t hit = first; hit < last && shared; hit++)
+            shared = lights[hit].first == lights[first].first && lights[hit].count == lights[first].count &&
+                     light_batch::integer_shininess(spheres_[hits.id[hit]].get_material());
+
+        if (shared) {
+            light_batch::point_lanes lanes;
+            for (std::size_t hit = first; hit < last; hit++)
+                lanes.add(spheres_[hits.id[hit]].get_material(), hits.normal(hit), hits.point(hit), camera_,
+                          occluded.empty() ? nullptr : occluded.data() + occluded_first[hit]);
+
+            const std::array<double, light_batch::width> sums =
+                lights[first].batch->intensities(lanes, lights[first].first, lights[first].count);
+            for (std::size_t hit = first; hit < last; hit++)
+                buffer[hits.owner[hit]] = blend(spheres_[hits.id[hit]].get_material(), sums[hit - first]).argb();
+            continue;
+        }
+
+        for (std::size_t hit = first; hit < last; hit++) {
+            const bardrix::material& material = spheres_[hits.id[hit]].get_material();
+            const bardrix::point3 point = hits.point(hit);
+            const bardrix::vector3 normal = hits.normal(hit);
+
+            // The flags of the lights are packed into a mask per 32 lights
+            double intensity = 0;
+            for (std::size_t light = 0; light < lights[hit].count; light += 32) {
+                const std::size_t count = std::min<std::size_t>(32, lights[hit].count - light);
+                std::uint32_t blocked = 0;
+                for (std::size_t i = 0; i < count && !occluded.empty(); i++)
+                    blocked |= static_cast<std::uint32_t>(occluded[occluded_first[hit] + light + i]) << i;
+                intensity += light_intensity(material, normal, point, lights[hit], light, count, blocked);
+            }
+
+            buffer[hits.owner[hit]] = blend(material, intensity).argb();
+        }
+    }
+}
+
+bool renderer::fill_g_buffer(int columns, const cancel_token& token) const {
+    g_buffer& cache = view().hits;
+    const int width = cache.width;
+    std::atomic<bool> cancelled = false;
+    pool_->parallel_for(0, cache.height, 4, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t y = begin; y < end; y++) {
+            if (token.cancelled()) {
+                cancelled = true;
+                return;
+            }
+
+            const int row = static_cast<int>(y);
+            const std::size_t first = y * width;
+
+            if (columns == 1) {
+                for (int x = 0; x < width; x++) {
+                    const bardrix::ray ray = primary_ray(x, row);
+                    cache.store(first + x, closest_hit(ray, 0, ray.get_length()));
+                }
+                continue;
+            }
+
+            for (int x = 0; x < width; x += columns) {
+                ray_packet packet;
+                for (int column = x; column < std::min(x + columns, width); column++)
+                    packet.add(primary_ray(column, row), primary_ray_length);
+
+                packet_hits hits;
+                accelerator_->closest_hits(packet, hits);
+                for (int i = 0; i < packet.size; i++)
+                    cache.store(first + x + i, hits[i]);
+            }
+        }
+    });
+
+    cache.valid = !cancelled;
+    return cache.valid;
+}
+
+bool renderer::shade_g_buffer(framebuffer& buffer, const cancel_token& token) const {
+    g_buffer& cache = view().hits;
+    const int width = cache.width;
+    std::atomic<bool> cancelled = false;
+    pool_->parallel_for(0, cache.height, 4, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t y = begin; y < end; y++) {
+            if (token.cancelled()) {
+                cancelled = true;
+                return;
+            }
+
+            for (int x = 0; x < width; x++) {
+                const std::size_t pixel = y * width + x;
+                const std::optional<hit_record> hit = cache.hit(pixel);
+                if (!hit.has_value()) {
+                    buffer[pixel] = bardrix::color::green().argb();
+                    continue;
+                }
+
+                const bardrix::point3 point = hit->point(primary_ray(x, static_cast<int>(y)));
+                buffer[pixel] = shade(hit.value(), point, x, static_cast<int>(y)).argb();
+            }
+        }
+    });
+
+    return !cancelled;
+}
+
+render_stats renderer::render(framebuffer& buffer, int width, int height,
+                              const cancel_token& token) const {
+    return render_tiles(buffer, width, height, false, token);
+}
+
+render_stats renderer::render_dirty(framebuffer& buffer, int width, int height,
+                                    const cancel_token& token) const {
+    return render_tiles(buffer, width, height, true, token);
+}
+
+bool renderer::find_dirty_tiles(const screen_projection& projection, int width, int height, int tile_size) const {
+    const int tiles_x = (width + tile_size - 1) / tile_size;
+    const int tiles_y = (height + tile_size - 1) / tile_size;
+    const double infinity = std::numeric_limits<double>::infinity();
+
+    dirty_flags_.assign(static_cast<std::size_t>(tiles_x) * tiles_y, 0);
+    for (const aabb& box : dirty_bounds_) {
+        const auto bounds = projection.bounds(box);
+        if (!bounds.has_value())
+            return false; // Reaches behind the eye
+        auto [x_min, y_min, x_max, y_max] = bounds.value();
+        if (x_min > x_max)
+            continue;
+
+        // A shadow lies behind the box as seen from its light, on screen that is the cone from the projected light
+        // through the projected box, so the rectangle grows to the edges of the screen the cone points to
+        for (std::size_t i = 0; i < lights_.size() && options_.shadows; i++) {
+            const bardrix::vector3 from_eye = projection.get_eye().vector_to(lights_[i].position);
+            if (from_eye.dot(projection.get_forward()) <= 1e-9)
+                return false; // Lights behind the eye flip the cone
+            const auto [light_x, light_y] = projection.project(from_eye);
+            if (light_x > x_min)
+                x_min = -infinity;
+            if (light_x < x_max)
+                x_max = infinity;
+            if (light_y > y_min)
+                y_min = -infinity;
+            if (light_y < y_max)
+                y_max = infinity;
+        }
+
+        // Only the rays through the pixel centers matter, a pixel of margin covers the rounding
+        if (x_max < -1 || y_max < -1 || x_min > width || y_min > height)
+            continue;
+
+        auto tile_of = [&](double pixel, int tiles) {
+            return static_cast<int>(std::clamp(std::floor(pixel / tile_size), 0.0, tiles - 1.0));
+        };
+        for (int y = tile_of(y_min - 1, tiles_y); y <= tile_of(y_max + 1, tiles_y); y++)
+            for (int x = tile_of(x_min - 1, tiles_x); x <= tile_of(x_max + 1, tiles_x); x++)
+                dirty_flags_[static_cast<std::size_t>(y) * tiles_x + x] = 1;
+    }
+
+    dirty_tiles_.clear();
+    for (std::size_t tile = 0; tile < dirty_flags_.size(); tile++)
+        if (dirty_flags_[tile])
+            dirty_tiles_.push_back(static_cast<std::uint32_t>(tile));
+    return true;
+}
+
+bool renderer::prepare_frame(framebuffer& buffer, int width, int height) const {
+    if (options_.collect_statistics)
+        accelerator_->reset_statistics();
+
+    // Frames of a size seen recently keep their view, the other view is taken over by a new size
+    if (views_[view_].rays.get_width() != width || views_[view_].rays.get_height() != height)
+        view_ = 1 - view_;
+
+    // Only a resize or a moved camera changes the primary rays
+    bool changed = false;
+    if (view().rays.update(camera_, width, height, primary_ray_length, pool_.get())) {
+        view().hits.valid = false;
+        changed = true;
+    }
+
+    // Only copied again after the lights changed
+    if (lights_stale_) {
+        if (options_.vectorized_shading)
+            light_batch_.assign(lights_);
+        if (options_.light_samples > 0)
+            light_tree_.build(lights_);
+        lights_stale_ = false;
+    }
+
+    // The clusters depend on the camera as well, they are built every frame
+    frame_++;
+    if (options_.light_cutoff > 0 && options_.light_samples == 0)
+        light_clusters_.build(camera_, lights_, options_.light_cutoff, width, height, options_.light_cluster_size,
+                              options_.light_cluster_slices, primary_ray_length, pool_.get());
+
+    if (buffer.size() != static_cast<std::size_t>(width) * height) {
+        buffer.resize(static_cast<std::size_t>(width) * height);
+        changed = true;
+    }
+
+    return changed;
+}
+
+int renderer::trace_span(framebuffer& buffer, int width, int y, int first, int stride) const {
+    int traced = 0;
+    if (options_.acceleration == acceleration_structure::linear || options_.packets == packet_shape::single) {
+        for (int x = first; x < width; x += stride, traced++)
+            buffer[y * width + x] = trace_pixel(x, y);
+        return traced;
+    }
+
+    // Pixels a stride apart are still close enough to share the traversal
+    for (int x = first; x < width;) {
+        ray_packet packet;
+        std::optional<bardrix::ray> rays[ray_packet::max_size];
+        int columns[ray_packet::max_size];
+        for (; packet.size < ray_packet::max_size && x < width; x += stride) {
+            rays[packet.size] = primary_ray(x, y);
+            columns[packet.size] = x;
+            packet.add(*rays[packet.size], rays[packet.size]->get_length());
+        }
+
+        packet_hits hits;
+        accelerator_->closest_hits(packet, hits);
+        for (int i = 0; i < packet.size; i++) {
+            std::uint32_t& pixel = buffer[y * width + columns[i]];
+            if (!hits[i].has_value()) {
+                pixel = bardrix::color::green().argb();
+                continue;
+            }
+
+            const bardrix::point3 point = hits[i]->point(*rays[i]);
+            pixel = shade(hits[i].value(), point, columns[i], y).argb();
+        }
+        traced += packet.size;
+    }
+
+    return traced;
+}
+
+double renderer::progressive_scale(int pass) {
+    static constexpr double scales[progressive_passes] = { 0.25, 0.5, 0.70710678118654752, 1 };
+    return scales[std::clamp(pass, 0, progressive_passes - 1)];
+}
+
+render_stats renderer::render_progressive(framebuffer& buffer, int width, int height,
+                                          const pass_callback& on_pass, const cancel_token& token) const {
+    const auto start = std::chrono::steady_clock::now();
+
+    render_stats stats;
+    if (token.cancelled()) {
+        stats.cancelled = true;
+        return stats;
+    }
+
+    prepare_frame(buffer, width, height);
+    redraw_all_ = false;
+    dirty_bounds_.clear();
+
+    // The pixels every pass traces per row, as { first, stride } for rows y % 4 == 0, 1, 2 and 3
+    static constexpr int spans[progressive_passes][4][2] = {
+        { { 0, 4 }, { 0, 0 }, { 0, 0 }, { 0, 0 } }, // 1/16
+        { { 2, 4 }, { 0, 0 }, { 0, 2 }, { 0, 0 } }, // 1/4
+        { { 0, 0 }, { 1, 2 }, { 0, 0 }, { 1, 2 } }, // 1/2, the odd pixels of the odd rows
+        { { 1, 2 }, { 0, 2 }, { 1, 2 }, { 0, 2 } }, // The rest
+    };
+
+    std::atomic<std::uint64_t> pixels = 0;
+    std::atomic<bool> cancelled = false;
+    for (int pass = 0; pass < progressive_passes && !cancelled; pass++) {
+        pool_->parallel_for(0, height, 4, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t y = begin; y < end; y++) {
+                if (token.cancelled()) {
+                    cancelled = true;
+                    return;
+                }
+
+                const auto [first, stride] = spans[pass][y % 4];
+                if (stride > 0)
+                    pixels += trace_span(buffer, width, static_cast<int>(y), first, stride);
+            }
+        });
+
+        if (cancelled)
+            break;
+
+        // Fill the pixels that aren't traced yet from the traced pixel of their block, or a traced neighbour
+        if (pass + 1 < progressive_passes) {
+            pool_->parallel_for(0, height, 16, [&](std::size_t begin, std::size_t end) {
+                for (std::size_t row = begin; row < end; row++) {
+                    const int y = static_cast<int>(row);
+                    for (int x = 0; x < width; x++) {
+                        int source_x = x, source_y = y;
+                        if (pass == 0) {
+                            source_x = x & ~3;
+                            source_y = y & ~3;
+                        }
+                        else if (pass == 1) {
+                            source_x = x & ~1;
+                            source_y = y & ~1;
+                        }
+                        else if ((x + y) % 2 == 1) {
+                            // Even rows hold (even, even) pixels, odd rows (odd, odd) pixels
+                            source_x = y % 2 == 0 ? x - 1 : x + 1 < width ? x + 1 : x - 1;
+                            if (source_x < 0) {
+                                source_x = x;
+                                source_y = y - 1;
+                            }
+                        }
+                        if (source_x != x || source_y != y)
+                            buffer[y * width + x] = buffer[source_y * width + source_x];
+                    }
+                }
+            });
+        }
+
+        if (on_pass)
+            on_pass(buffer, pass);
+    }
+
+    // The buffer is only partly up to date, the next dirty frame redraws all of it
+    if (cancelled)
+        redraw_all_ = true;
+
+    stats.rays = pixels;
+    stats.cancelled = cancelled;
+    if (options_.collect_statistics)
+        stats.traversal = accelerator_->get_statistics();
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
+
+render_stats renderer::render_tiles(framebuffer& buffer, int width, int height, bool dirty_only,
+                                    const cancel_token& token) const {
+    const auto start = std::chrono::steady_clock::now();
+
+    // A frame that is superseded before it started leaves everything as it is
+    if (token.cancelled()) {
+        render_stats stats;
+        stats.cancelled = true;
+        return stats;
+    }
+
+    bool redraw_all = prepare_frame(buffer, width, height) || redraw_all_ || !dirty_only;
+
+    const int tile_size = std::max(options_.tile_size, 1);
+    const int tiles_x = (width + tile_size - 1) / tile_size;
+    const int tiles_y = (height + tile_size - 1) / tile_size;
+
+    // The buffer is up to date after this frame
+    if (!redraw_all && !options_.g_buffer)
+        redraw_all = !find_dirty_tiles(screen_projection(camera_, width, height), width, height, tile_size);
+    redraw_all_ = false;
+    dirty_bounds_.clear();
+
+    // Project the spheres onto the tiles first, the tiles of the bins are the tiles of the tasks
+    if (options_.tile_culling)
+        tile_bins_.build(camera_, spheres_, width, height, tile_size, primary_ray_length, pool_.get());
+
+    // The linear batch refines its hits in closest_hit, so it traces single rays
+    const bool packets = options_.acceleration != acceleration_structure::linear;
+    const int columns = !packets || options_.packets == packet_shape::single ? 1
+                        : options_.packets == packet_shape::row ? 8 : 4;
+    const int rows = columns == 4 ? 2 : 1;
+
+    // Only shade when the hits of the last frame still hold
+    if (options_.g_buffer) {
+        g_buffer& cache = view().hits;
+        const bool traced = !cache.valid || cache.width != width || cache.height != height;
+        bool complete = true;
+        if (traced) {
+            cache.resize(width, height);
+            complete = fill_g_buffer(columns == 1 ? 1 : ray_packet::max_size, token);
+        }
+        complete = complete && shade_g_buffer(buffer, token);
+
+        render_stats stats;
+        stats.rays = traced ? static_cast<std::uint64_t>(width) * height : 0;
+        stats.cancelled = !complete;
+        redraw_all_ = !complete;
+        if (options_.collect_statistics)
+            stats.traversal = accelerator_->get_statistics();
+        stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return stats;
+    }
+
+    // Every tile is a task, busy threads give away halves of their tile range to idle threads
+    const std::size_t tile_count = redraw_all ? static_cast<std::size_t>(tiles_x) * tiles_y : dirty_tiles_.size();
+    std::atomic<std::uint64_t> pixels = 0;
+    std::atomic<bool> cancelled = false;
+    pool_->parallel_for(0, tile_count, 1, [&](std::size_t begin, std::size_t end) {
+        // The queues keep their memory for the next tiles and frames of this thread
+        thread_local wavefront_queues queues;
+
+        for (std::size_t task = begin; task < end; task++) {
+            // A superseded frame stops within a tile
+            if (token.cancelled()) {
+                cancelled = true;
+                return;
+            }
+
+            const std::size_t tile = redraw_all ? task : dirty_tiles_[task];
+            const int x0 = static_cast<int>(tile % tiles_x) * tile_size;
+            const int y0 = static_cast<int>(tile / tiles_x) * tile_size;
+            const int x1 = std::min(x0 + tile_size, width);
+            const int y1 = std::min(y0 + tile_size, height);
+            pixels += static_cast<std::uint64_t>(x1 - x0) * (y1 - y0);
+
+            if (options_.tile_culling) {
+                const auto candidates = tile_bins_.candidates(static_cast<int>(tile % tiles_x),
+                                                              static_cast<int>(tile / tiles_x));
+                for (int y = y0; y < y1; y++)
+                    for (int x = x0; x < x1; x++)
+                        buffer[y * width + x] = trace_pixel(x, y, candidates);
+                continue;
+            }
+
+            if (options_.wavefront) {
+                render_wavefront(queues, buffer, width, x0, y0, x1, y1, columns, rows);
+                continue;
+            }
+
+            if (columns == 1) {
+                for (int y = y0; y < y1; y++)
+                    for (int x = x0; x < x1; x++)
+                        buffer[y * width + x] = trace_pixel(x, y);
+                continue;
+            }
+
+            for (int y = y0; y < y1; y += rows) {
+                for (int x = x0; x < x1; x += columns) {
+                    const int packet_columns = std::min(columns, x1 - x), packet_rows = std::min(rows, y1 - y);
+                    const auto colors = trace_packet(x, y, packet_columns, packet_rows);
+                    for (int row = 0; row < packet_rows; row++)
+                        for (int column = 0; column < packet_columns; column++)
+                            buffer[(y + row) * width + x + column] = colors[row * packet_columns + column];
+                }
+            }
+        }
+    });
+
+    // The buffer is only partly up to date, the next frame redraws all of it
+    if (cancelled)
+        redraw_all_ = true;
+
+    render_stats stats;
+    stats.rays = pixels;
+    stats.cancelled = cancelled;
+    if (options_.collect_statistics)
+        stats.traversal = accelerator_->get_statistics();
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
@@ -0,0 +1,547 @@
+#pragma once
+
+#include "accelerator.h"
+#include "cancel_token.h"
+#include "framebuffer.h"
+#include "g_buffer.h"
+#include "light_batch.h"
+#include "light_clusters.h"
+#include "light_tree.h"
+#include "primary_rays.h"
+#include "ray_queue.h"
+#include "screen_projection.h"
+#include "sphere.h"
+#include "thread_pool.h"
+#include "tile_bins.h"
+
+#include <bardrix/camera.h>
+#include <bardrix/light.h>
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+/// \brief Calculates the light intensity at a given intersection point
+/// \param shape The shape that was intersected
+/// \param light The light source
+/// \param camera The camera
+/// \param intersection_point The intersection point of an object
+/// \return The light intensity at the intersection point
+/// \example double intensity = calculate_light_intensity(shape, light, camera, intersection_point);
+double calculate_light_intensity(const bardrix::shape& shape, const bardrix::light& light, const bardrix::camera& camera,
+                                 const bardrix::point3& intersection_point);
+
+/// \brief Calculates the light intensity at a given intersection point with a known normal
+/// \param material The material of the shape that was intersected
+/// \param normal The normalized normal at the intersection point, e.g. hit_record::normal
+/// \param light The light source
+/// \param camera The camera
+/// \param intersection_point The intersection point of an object
+/// \return The light intensity at the intersection point
+/// \example double intensity = calculate_light_intensity(material, hit.normal, light, camera, hit.point(ray));
+double calculate_light_intensity(const bardrix::material& material, const bardrix::vector3& normal,
+                                 const bardrix::light& light, const bardrix::camera& camera,
+                                 const bardrix::point3& intersection_point);
+
+/// \brief The structures the renderer can find the nearest sphere with
+enum class acceleration_structure {
+    /// \brief Tests every sphere, several at a time (sphere_batch)
+    linear,
+
+    /// \brief Bounding volume hierarchy built with the surface area heuristic (bvh)
+    bvh,
+
+    /// \brief Linear bounding volume hierarchy built from Morton codes, see render_options::morton_bits
+    lbvh,
+
+    /// \brief Bounding volume hierarchy with eight children per node, collapsed from the SAH bvh (bvh8)
+    bvh8,
+
+    /// \brief Uniform grid walked with a 3D-DDA, for dense and even fields of similar spheres (uniform_grid)
+    grid,
+};
+
+/// \brief The blocks of pixels whose primary rays are traced together as a ray_packet
+enum class packet_shape {
+    /// \brief Every pixel on its own
+    single,
+
+    /// \brief 8x1 pixels
+    row,
+
+    /// \brief 4x2 pixels
+    block,
+};
+
+/// \brief Options for the renderer
+struct render_options {
+    /// \brief The amount of threads to render with, 0 means one thread per hardware thread
+    unsigned int threads = 0;
+
+    /// \brief The width and height of a tile in pixels, tiles are the units of work that are scheduled on the threads
+    int tile_size = 32;
+
+    /// \brief The structure to find the nearest sphere with
+    acceleration_structure acceleration = acceleration_structure::bvh;
+
+    /// \brief The size of the Morton codes of acceleration_structure::lbvh, 30 or 63
+    int morton_bits = 30;
+
+    /// \brief If primary rays only test the spheres that project onto their tile (tile_bins) instead of asking the
+    ///        acceleration structure, pays off when few spheres cover a small part of the screen each
+    bool tile_culling = false;
+
+    /// \brief The primary rays traced together, ignored by acceleration_structure::linear
+    packet_shape packets = packet_shape::block;
+
+    /// \brief If lights are blocked by spheres, a point a sphere hides from a light only gets its ambient part
+    bool shadows = false;
+
+    /// \brief If tiles are rendered in stages over queues of rays (generate, intersect, shadows, shade) instead of
+    ///        pixel by pixel, every stage runs a tight loop over structure-of-arrays queues. Ignored with tile_culling
+    /// \details The queues hold one tile (tile_size^2 rays) per thread and live in the cache, they are not frame
+    ///          wide queues. Intersect hands the whole ray queue to accelerator::closest_hits, the BVH loads packets
+    ///          of consecutive rays straight from the arrays and sphere_batch tests every ray against several
+    ///          spheres at once. Shade runs light_batch::intensities over hits that share their lights, so the
+    ///          hits are the SIMD lanes. The packet shape only sets the order in which the rays are queued.
+    bool wavefront = false;
+
+    /// \brief If the lights are shaded several at a time (light_batch) in single precision instead of one by one
+    bool vectorized_shading = true;
+
+    /// \brief The falloff (light::inverse_square_law) below which a light is left out of the shading, 0 shades every
+    ///        point with every light. Above 0 the lights are culled per cluster (light_clusters).
+    double light_cutoff = 0;
+
+    /// \brief The width and height of a light cluster in pixels, see light_cutoff
+    int light_cluster_size = 16;
+
+    /// \brief The amount of depth slices of the light clusters, see light_cutoff
+    int light_cluster_slices = 16;
+
+    /// \brief The amount of lights picked per point from a light_tree, 0 shades with every light (or cluster).
+    ///        Above 0 the sum over the lights is estimated without bias from the picked lights, so the cost grows
+    ///        with the log of the amount of lights at the price of noise. Takes precedence over light_cutoff.
+    int light_samples = 0;
+
+    /// \brief If the primary hits are kept in a g_buffer and reused while the spheres and the camera stay the same,
+    ///        so editing lights or materials only shades. Call rebuild() or refit() after spheres changed.
+    ///        Takes precedence over tile_culling and wavefront.
+    bool g_buffer = false;
+
+    /// \brief The amount of cells per sphere of acceleration_structure::grid, sets the cell size
+    double grid_cells_per_sphere = 2;
+
+    /// \brief refit() rebuilds the acceleration structure once its SAH cost grew by this factor since the last build
+    double rebuild_threshold = 1.5;
+
+    /// \brief If the traversal counters of the acceleration structure are collected into render_stats
+    bool collect_statistics = false;
+};
+
+/// \brief Statistics of a single rendered frame
+struct render_stats {
+    /// \brief The amount of rays that were traced
+    std::uint64_t rays = 0;
+
+    /// \brief The time it took to render the frame in seconds
+    double seconds = 0;
+
+    /// \brief The work done by the acceleration structure, only filled when render_options::collect_statistics is set
+    traversal_stats traversal;
+
+    /// \brief If the frame was cancelled through its cancel_token before every tile was rendered, part of the buffer
+    ///        then still holds an older frame
+    bool cancelled = false;
+
+    /// \brief The fraction of the width and height the frame was rendered at before it was upscaled, see
+    ///        frame_scheduler
+    double resolution_scale = 1;
+
+    /// \brief Gets the throughput of the frame
+    /// \return The amount of rays traced per second, 0 if no time was measured
+    NODISCARD double rays_per_second() const;
+};
+
+/// \brief Platform independent renderer, traces the spheres and lights as seen by the camera into a buffer
+/// \details The renderer only keeps references, the camera, spheres and lights must outlive it.
+///          Call refit() after moving a few spheres, rebuild() after adding or removing spheres.
+class renderer {
+protected:
+    /// \brief The camera to shoot the rays from
+    const bardrix::camera& camera_;
+
+    /// \brief The spheres in the scene
+    const std::vector<sphere>& spheres_;
+
+    /// \brief The lights in the scene
+    const std::vector<bardrix::light>& lights_;
+
+    /// \brief The options to render with
+    render_options options_;
+
+    /// \brief The structure that finds the nearest sphere
+    std::unique_ptr<accelerator> accelerator_;
+
+    /// \brief The threads the tiles are rendered on
+    std::unique_ptr<thread_pool> pool_;
+
+    /// \brief The spheres per tile when render_options::tile_culling is set, rebuilt every frame
+    mutable tile_bins tile_bins_;
+
+    /// \brief The lights as structure of arrays when render_options::vectorized_shading is set, copied when the
+    ///        lights changed
+    mutable light_batch light_batch_;
+
+    /// \brief The lights per cluster when render_options::light_cutoff is set, rebuilt every frame
+    mutable light_clusters light_clusters_;
+
+    /// \brief The lights as a tree when render_options::light_samples is set, rebuilt when the lights changed
+    mutable light_tree light_tree_;
+
+    /// \brief If light_batch_ and light_tree_ are out of date, set by lights_changed() and set_options()
+    mutable bool lights_stale_ = true;
+
+    /// \brief The caches that hold for one size of the frame
+    struct frame_view {
+        /// \brief The primary ray of every pixel, only rebuilt when the camera or the size of the frame changed
+        primary_rays rays;
+
+        /// \brief The primary hits when render_options::g_buffer is set, retraced when the spheres or the camera
+        ///        changed
+        g_buffer hits;
+    };
+
+    /// \brief A view per recent frame size, e.g. a scaled frame of the frame_scheduler and the full frame after it
+    ///        each keep their primary rays and hits
+    mutable std::array<frame_view, 2> views_;
+
+    /// \brief The index of the view of the current frame in views_
+    mutable std::size_t view_ = 0;
+
+    /// \brief The bounds of every sphere as of the last rebuild() or refit()
+    std::vector<aabb> sphere_bounds_;
+
+    /// \brief The old and new bounds of the spheres refit() moved since the last frame, see render_dirty
+    mutable std::vector<aabb> dirty_bounds_;
+
+    /// \brief If the next render_dirty redraws the whole frame, e.g. after rebuild() or set_options()
+    mutable bool redraw_all_ = true;
+
+    /// \brief The tiles render_dirty redraws, kept for the next frame
+    mutable std::vector<std::uint32_t> dirty_tiles_;
+
+    /// \brief Per tile if render_dirty redraws it, kept for the next frame
+    mutable std::vector<std::uint8_t> dirty_flags_;
+
+    /// \brief The amount of frames rendered, seeds the light sampling so the noise changes every frame
+    mutable std::uint32_t frame_ = 0;
+
+public:
+    /// \brief The length of the primary rays
+    static constexpr double primary_ray_length = 10;
+
+    /// \brief The amount of passes of render_progressive
+    static constexpr int progressive_passes = 4;
+
+    /// \brief Called after every pass of render_progressive
+    /// \param buffer The frame so far, pixels that aren't traced yet copy a traced neighbour
+    /// \param pass The pass that finished, counting from 0, progressive_passes - 1 is the full frame
+    using pass_callback = std::function<void(const framebuffer& buffer, int pass)>;
+
+    /// \brief Gets the fraction of the width and height the image after a pass of render_progressive resolves
+    /// \param pass The pass, counting from 0
+    /// \return 1/4, 1/2, about 0.71 (a checkerboard holds half of the pixels) and 1
+    NODISCARD static double progressive_scale(int pass);
+
+    /// \brief The distance shadow rays keep from the point they leave and the light they go to, so the surface the
+    ///        point lies on doesn't shadow itself
+    static constexpr double shadow_epsilon = 1e-4;
+
+    /// \brief Constructor for the renderer
+    /// \param camera The camera to shoot the rays from
+    /// \param spheres The spheres in the scene
+    /// \param lights The lights in the scene
+    /// \param options The options to render with
+    renderer(const bardrix::camera& camera, const std::vector<sphere>& spheres,
+             const std::vector<bardrix::light>& lights, const render_options& options = {});
+
+    // GETTERS/SETTERS
+    NODISCARD const render_options& get_options() const;
+
+    /// \brief Sets the options, the threads and the acceleration structure are only recreated when they change
+    /// \param options The options to render with
+    void set_options(const render_options& options);
+
+    /// \brief Gets the acceleration structure, e.g. to inspect its quality
+    NODISCARD const accelerator& get_accelerator() const;
+
+    /// \brief Rebuilds the acceleration structure, call this after spheres were added, removed or changed
+    void rebuild();
+
+    /// \brief Copies the lights again before the next frame, call this after lights were added, removed or changed
+    /// \details The light tree costs O(n log n) to build, so it is only rebuilt after this call instead of every frame
+    /// \example lights[0].position = position; renderer.lights_changed();
+    void lights_changed();
+
+    /// \brief Updates the acceleration structure after a few spheres moved or changed radius, e.g. through
+    ///        sphere::set_position, much cheaper than rebuild() for small changes
+    /// \param changed The indices of the spheres that changed, indices past the last sphere are ignored
+    /// \return If the structure was rebuilt instead, because it degraded past render_options::rebuild_threshold or
+    ///         because spheres were added or removed since the last rebuild
+    /// \example spheres[0].set_position(position); renderer.refit({ 0 });
+    bool refit(const std::vector<std::uint32_t>& changed);
+
+    // RAYTRACING
+
+    /// \brief Finds the nearest intersection of a ray with the spheres
+    /// \param ray The ray to trace
+    /// \param t_min The minimum distance along the ray
+    /// \param t_max The maximum distance along the ray
+    /// \return The nearest hit, with the index of the sphere as id, otherwise std::nullopt
+    /// \example std::optional<hit_record> hit = renderer.closest_hit(ray, 0, ray.get_length());
+    NODISCARD std::optional<hit_record> closest_hit(const bardrix::ray& ray, double t_min, double t_max) const;
+
+    /// \brief Checks if a ray hits any sphere, cheaper than closest_hit as the first blocker ends the search
+    /// \param ray The ray to trace
+    /// \param t_min The minimum distance along the ray
+    /// \param t_max The maximum distance along the ray
+    /// \return If a sphere is hit between t_min and t_max
+    /// \example bool shadowed = renderer.any_hit(shadow_ray, renderer::shadow_epsilon, distance_to_light);
+    NODISCARD bool any_hit(const bardrix::ray& ray, double t_min, double t_max) const;
+
+    /// \brief Shades a hit with all lights
+    /// \param ray The ray that produced the hit
+    /// \param hit The hit to shade
+    /// \return The color of the hit
+    NODISCARD bardrix::color shade(const bardrix::ray& ray, const hit_record& hit) const;
+
+    // RENDERING
+
+    /// \brief Traces a single pixel
+    /// \param x The x coordinate of the pixel
+    /// \param y The y coordinate of the pixel
+    /// \return The color of the pixel in the AARRGGBB format
+    /// \example uint32_t pixel = renderer.trace_pixel(10, 20);
+    NODISCARD std::uint32_t trace_pixel(int x, int y) const;
+
+    /// \brief Traces a single pixel against a subset of the spheres
+    /// \param x The x coordinate of the pixel
+    /// \param y The y coordinate of the pixel
+    /// \param candidates The indices of the spheres to test, e.g. tile_bins::candidates of the tile of the pixel
+    /// \return The color of the pixel in the AARRGGBB format
+    NODISCARD std::uint32_t trace_pixel(int x, int y, std::span<const std::uint32_t> candidates) const;
+
+    /// \brief Traces a block of pixels as a single ray packet
+    /// \param x The x coordinate of the top left pixel
+    /// \param y The y coordinate of the top left pixel
+    /// \param columns The width of the block
+    /// \param rows The height of the block, columns * rows is at most ray_packet::max_size
+    /// \return The colors of the pixels row after row in the AARRGGBB format
+    /// \example auto pixels = renderer.trace_packet(0, 0, 4, 2);
+    NODISCARD std::array<std::uint32_t, ray_packet::max_size> trace_packet(int x, int y, int columns, int rows) const;
+
+    /// \brief Renders a full frame, split in tiles that are spread over the threads
+    /// \param buffer The buffer to render to in the AARRGGBB format, resized to width * height when needed
+    /// \param width The width of the frame
+    /// \param height The height of the frame
+    /// \param token Stops the frame before the next tile once a newer frame was requested
+    /// \return The statistics of the rendered frame
+    /// \example render_stats stats = renderer.render(buffer, camera.get_width(), camera.get_height());
+    render_stats render(framebuffer& buffer, int width, int height,
+                        const cancel_token& token = {}) const;
+
+    /// \brief Redraws only the tiles the spheres passed to refit() since the last frame may have changed, their old
+    ///        and new projection plus the shadows they cast when render_options::shadows is set
+    /// \details The rest of the buffer keeps the last frame. A resize, a moved camera, rebuild() and set_options()
+    ///          redraw the whole frame. Changed lights or materials aren't tracked, render() after changing those.
+    ///          render_options::g_buffer always shades the whole frame.
+    /// \param buffer The buffer the last frame was rendered to in the AARRGGBB format
+    /// \param width The width of the frame
+    /// \param height The height of the frame
+    /// \param token Stops the frame before the next tile once a newer frame was requested, the next frame then
+    ///        redraws everything
+    /// \return The statistics of the redrawn part of the frame
+    /// \example spheres[0].set_position(position); renderer.refit({ 0 }); renderer.render_dirty(buffer, w, h);
+    render_stats render_dirty(framebuffer& buffer, int width, int height,
+                              const cancel_token& token = {}) const;
+
+    /// \brief Renders a frame coarse to fine, so a preview is ready long before the frame
+    /// \details The passes trace 1/16 (every 4th pixel of every 4th row), 1/4 (every 2nd pixel of every 2nd row), 1/2
+    ///          (a checkerboard) and finally all pixels. Every pass only traces the pixels the earlier passes left
+    ///          out, so the full frame costs as much as render(). render_options::tile_culling, wavefront and
+    ///          g_buffer are ignored.
+    /// \param buffer The buffer to render to in the AARRGGBB format, resized to width * height when needed
+    /// \param width The width of the frame
+    /// \param height The height of the frame
+    /// \param on_pass Called on this thread after every pass, e.g. to show or save the preview, may be empty
+    /// \param token Stops the frame before the next row once a newer frame was requested
+    /// \return The statistics of the frame
+    /// \example renderer.render_progressive(buffer, w, h, [&](const auto& pixels, int pass) { show(pixels); });
+    render_stats render_progressive(framebuffer& buffer, int width, int height,
+                                    const pass_callback& on_pass, const cancel_token& token = {}) const;
+
+protected:
+    /// \brief Prepares the per frame state: the primary rays, the lights and the size of the buffer
+    /// \param buffer The buffer to render to, resized to width * height when needed
+    /// \param width The width of the frame
+    /// \param height The height of the frame
+    /// \return If the camera or the size changed, so no pixel of the last frame still holds
+    bool prepare_frame(framebuffer& buffer, int width, int height) const;
+
+    /// \brief Traces every stride-th pixel of a row, in packets of ray_packet::max_size unless packets are off
+    /// \param buffer The buffer to write the colors to
+    /// \param width The width of the frame
+    /// \param y The row
+    /// \param first The first pixel of the row
+    /// \param stride The distance between the pixels
+    /// \return The amount of pixels traced
+    int trace_span(framebuffer& buffer, int width, int y, int first, int stride) const;
+
+    /// \brief Renders all tiles of a frame, or the tiles dirty_bounds_ touch
+    /// \param buffer The buffer to render to in the AARRGGBB format, resized to width * height when needed
+    /// \param width The width of the frame
+    /// \param height The height of the frame
+    /// \param dirty_only If only the changed tiles are redrawn, see render_dirty
+    /// \param token Stops the frame before the next tile once a newer frame was requested
+    /// \return The statistics of the rendered tiles
+    render_stats render_tiles(framebuffer& buffer, int width, int height, bool dirty_only,
+                              const cancel_token& token) const;
+
+    /// \brief Fills dirty_tiles_ with the tiles dirty_bounds_ and their shadows project onto
+    /// \param projection The projection onto the frame
+    /// \param width The width of the frame
+    /// \param height The height of the frame
+    /// \param tile_size The width and height of a tile in pixels
+    /// \return If the tiles are bounded, otherwise the whole frame has to be redrawn
+    bool find_dirty_tiles(const screen_projection& projection, int width, int height, int tile_size) const;
+
+    /// \brief Gets the primary ray of a pixel
+    /// \param x The x coordinate of the pixel
+    /// \param y The y coordinate of the pixel
+    /// \return The ray from the table refreshed by render, or from the camera for pixels outside it
+    NODISCARD bardrix::ray primary_ray(int x, int y) const;
+
+    /// \brief Gets the view of the current frame, chosen by prepare_frame
+    NODISCARD frame_view& view() const;
+
+    /// \brief Traces the primary ray of every pixel into the g_buffer of the view
+    /// \param columns The amount of pixels of a row that are traced together as a ray_packet
+    /// \param token Stops before the next row once a newer frame was requested
+    /// \return If every row was traced, only then the g_buffer of the view is valid
+    bool fill_g_buffer(int columns, const cancel_token& token) const;
+
+    /// \brief Shades every pixel from the hits in the g_buffer of the view
+    /// \param buffer The buffer to write the colors to, as big as the g_buffer of the view
+    /// \param token Stops before the next row once a newer frame was requested
+    /// \return If every row was shaded
+    bool shade_g_buffer(framebuffer& buffer, const cancel_token& token) const;
+
+    /// \brief Shades a hit with a range of lights
+    /// \param hit The hit to shade
+    /// \param point The intersection point of the hit
+    /// \param lights The lights to shade with, e.g. lights_at the point
+    /// \return The color of the hit
+    NODISCARD bardrix::color shade(const hit_record& hit, const bardrix::point3& point, const light_range& lights) const;
+
+    /// \brief Shades a hit seen through a pixel, with the lights of its cluster or with sampled lights
+    /// \param hit The hit to shade
+    /// \param point The intersection point of the hit
+    /// \param x The x coordinate of the pixel
+    /// \param y The y coordinate of the pixel
+    /// \return The color of the hit
+    NODISCARD bardrix::color shade(const hit_record& hit, const bardrix::point3& point, int x, int y) const;
+
+    /// \brief Shades a hit with render_options::light_samples lights picked from the light_tree
+    /// \param hit The hit to shade
+    /// \param point The intersection point of the hit
+    /// \param seed Seeds the random numbers, e.g. from the pixel and the frame
+    /// \return The color of the hit
+    NODISCARD bardrix::color shade_sampled(const hit_record& hit, const bardrix::point3& point,
+                                           std::uint64_t seed) const;
+
+    /// \brief Gets the lights to shade a point seen through a pixel with
+    /// \param x The x coordinate of the pixel
+    /// \param y The y coordinate of the pixel
+    /// \param point The point, on the primary ray of the pixel
+    /// \return The lights of the cluster of the point when render_options::light_cutoff is set, otherwise all lights
+    NODISCARD light_range lights_at(int x, int y, const bardrix::point3& point) const;
+
+    /// \brief Sums the intensity of lights at a point
+    /// \param material The material of the sphere the point lies on
+    /// \param normal The normal at the point
+    /// \param point The point
+    /// \param lights The lights
+    /// \param first The index within lights of the first light to sum
+    /// \param count The amount of lights to sum
+    /// \param occluded Bit i is set if light first + i is blocked, then only its ambient part remains
+    /// \return The summed light intensity at the point
+    NODISCARD double light_intensity(const bardrix::material& material, const bardrix::vector3& normal,
+                                     const bardrix::point3& point, const light_range& lights, std::size_t first,
+                                     std::size_t count, std::uint32_t occluded) const;
+
+    /// \brief Gets the color of a point from its summed light intensity
+    /// \param material The material of the sphere the point lies on
+    /// \param intensity The summed intensity of all lights
+    /// \return The last light blended with the material, scaled by the intensity
+    NODISCARD bardrix::color blend(const bardrix::material& material, double intensity) const;
+
+    /// \brief Finds the lights that are blocked from a point, the shadow rays are traced together as a ray_packet
+    /// \param point The point on a surface
+    /// \param normal The normal of the surface, lights behind the surface aren't traced
+    /// \param lights The lights
+    /// \param first The index within lights of the first light to trace
+    /// \param count The amount of lights, at most ray_packet::max_size
+    /// \return Bit i is set if light first + i is blocked
+    NODISCARD std::uint32_t occluded_lights(const bardrix::point3& point, const bardrix::vector3& normal,
+                                            const light_range& lights, std::size_t first, int count) const;
+
+    // WAVEFRONT
+
+    /// \brief Renders a tile in stages over the queues, see render_options::wavefront
+    /// \param queues The queues of the calling thread
+    /// \param buffer The buffer to render to
+    /// \param width The width of the frame
+    /// \param x0 The first column of the tile
+    /// \param y0 The first row of the tile
+    /// \param x1 The column after the tile
+    /// \param y1 The row after the tile
+    /// \param columns The width of the blocks of pixels that are traced as a packet
+    /// \param rows The height of the blocks of pixels that are traced as a packet
+    void render_wavefront(wavefront_queues& queues, framebuffer& buffer, int width, int x0, int y0,
+                          int x1, int y1, int columns, int rows) const;
+
+    /// \brief Generate stage, queues the primary rays of a tile block by block so packets stay coherent
+    void generate_rays(ray_queue& rays, int width, int x0, int y0, int x1, int y1, int columns, int rows) const;
+
+    /// \brief Intersect stage, finds the nearest hit of every ray and compacts the hits into a queue
+    /// \details The queue goes to accelerator::closest_hits as a whole, the hits of the single precision batch
+    ///          (acceleration_structure::linear) are refined in double precision afterwards like closest_hit
+    /// \param rays The rays to trace, owned by their pixels
+    /// \param hits The queue the hits are appended to
+    /// \param buffer The buffer the misses are written to
+    void intersect_rays(const ray_queue& rays, hit_queue& hits, framebuffer& buffer) const;
+
+    /// \brief Shadow stage, spawns a shadow ray per hit and light and traces them in packets
+    /// \param hits The hits to spawn the shadow rays from
+    /// \param lights The lights of every hit
+    /// \param shadows The queue for the shadow rays
+    /// \param occluded_first Filled with the first flag in occluded of every hit
+    /// \param occluded Filled per hit and light with if the light is blocked
+    void trace_shadows(const hit_queue& hits, const std::vector<light_range>& lights, ray_queue& shadows,
+                       std::vector<std::uint32_t>& occluded_first, std::vector<std::uint8_t>& occluded) const;
+
+    /// \brief Shade stage, shades every hit with its lights and writes it to its pixel
+    /// \details Runs of light_batch::width hits with the same lights are shaded together by
+    ///          light_batch::intensities, the other hits (and all with vectorized_shading off) one by one
+    /// \param hits The hits to shade, owned by their pixels
+    /// \param lights The lights of every hit
+    /// \param occluded_first The first flag in occluded of every hit
+    /// \param occluded The result of trace_shadows, may be empty when shadows are off
+    /// \param buffer The buffer to write to
+    void shade_hits(const hit_queue& hits, const std::vector<light_range>& lights,
+                    const std::vector<std::uint32_t>& occluded_first, const std::vector<std::uint8_t>& occluded,
+                    framebuffer& buffer) const;
+}; // class renderer
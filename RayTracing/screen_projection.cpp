@@ -0,0 +1,91 @@
+#include "screen_projection.h"
+
+#include <algorithm>
+#include <limits>
+
+screen_projection::screen_projection(const bardrix::camera& camera, int width, int height) {
+    const auto corner_00 = camera.shoot_ray(0, 0, 1);
+    const auto corner_10 = camera.shoot_ray(width - 1, 0, 1);
+    const auto corner_01 = camera.shoot_ray(0, height - 1, 1);
+    const auto corner_11 = camera.shoot_ray(width - 1, height - 1, 1);
+    if (width <= 1 || height <= 1 || !corner_00 || !corner_10 || !corner_01 || !corner_11)
+        return;
+
+    eye_ = corner_00->position;
+    forward_ = (corner_00->get_direction() + corner_10->get_direction() + corner_01->get_direction() +
+                corner_11->get_direction()).normalized();
+
+    auto on_plane = [&](const bardrix::vector3& direction) { return direction * (1 / direction.dot(forward_)); };
+    corner_ = on_plane(corner_00->get_direction());
+    step_x_ = (on_plane(corner_10->get_direction()) - corner_) * (1.0 / (width - 1));
+    step_y_ = (on_plane(corner_01->get_direction()) - corner_) * (1.0 / (height - 1));
+
+    gram_xx_ = step_x_.dot(step_x_);
+    gram_xy_ = step_x_.dot(step_y_);
+    gram_yy_ = step_y_.dot(step_y_);
+    determinant_ = gram_xx_ * gram_yy_ - gram_xy_ * gram_xy_;
+
+    right_ = step_x_.normalized();
+    up_ = forward_.cross(right_);
+    valid_ = determinant_ > 0;
+}
+
+bool screen_projection::is_valid() const { return valid_; }
+
+const bardrix::point3& screen_projection::get_eye() const { return eye_; }
+
+const bardrix::vector3& screen_projection::get_forward() const { return forward_; }
+
+std::array<double, 2> screen_projection::project(const bardrix::vector3& from_eye) const {
+    const bardrix::vector3 offset = from_eye * (1 / from_eye.dot(forward_)) - corner_;
+    const double along_x = offset.dot(step_x_), along_y = offset.dot(step_y_);
+    return { (gram_yy_ * along_x - gram_xy_ * along_y) / determinant_,
+             (gram_xx_ * along_y - gram_xy_ * along_x) / determinant_ };
+}
+
+std::optional<std::array<double, 4>> screen_projection::bounds(const bardrix::point3& center, double radius) const {
+    const bardrix::vector3 to_center = eye_.vector_to(center);
+    if (!valid_ || to_center.dot(forward_) - radius <= 1e-9)
+        return std::nullopt;
+
+    // The projection of the box around the sphere (aligned with the camera) lies within its projected corners
+    std::array<double, 4> result = { std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity(),
+                                     -std::numeric_limits<double>::infinity(),
+                                     -std::numeric_limits<double>::infinity() };
+    for (int i = 0; i < 8; i++) {
+        const bardrix::vector3 point = to_center + right_ * (i & 1 ? radius : -radius) +
+                                       up_ * (i & 2 ? radius : -radius) + forward_ * (i & 4 ? radius : -radius);
+        const auto [x, y] = project(point);
+        result[0] = std::min(result[0], x);
+        result[1] = std::min(result[1], y);
+        result[2] = std::max(result[2], x);
+        result[3] = std::max(result[3], y);
+    }
+
+    return result;
+}
+
+std::optional<std::array<double, 4>> screen_projection::bounds(const aabb& box) const {
+    if (!valid_)
+        return std::nullopt;
+
+    // An empty box keeps the empty bounds, x_min > x_max
+    std::array<double, 4> result = { std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity(),
+                                     -std::numeric_limits<double>::infinity(),
+                                     -std::numeric_limits<double>::infinity() };
+    for (int i = 0; i < 8 && !box.empty(); i++) {
+        const bardrix::point3 point(i & 1 ? box.max.x : box.min.x, i & 2 ? box.max.y : box.min.y,
+                                    i & 4 ? box.max.z : box.min.z);
+        const bardrix::vector3 from_eye = eye_.vector_to(point);
+        if (from_eye.dot(forward_) <= 1e-9)
+            return std::nullopt;
+
+        const auto [x, y] = project(from_eye);
+        result[0] = std::min(result[0], x);
+        result[1] = std::min(result[1], y);
+        result[2] = std::max(result[2], x);
+        result[3] = std::max(result[3], y);
+    }
+
+    return result;
+}
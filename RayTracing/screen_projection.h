@@ -0,0 +1,74 @@
+#pragma once
+
+#include "aabb.h"
+
+#include <bardrix/camera.h>
+
+#include <array>
+#include <optional>
+
+/// \brief Projects points through a camera onto the pixels of a frame
+/// \details The projection is derived from camera.shoot_ray, so it matches the primary rays of the renderer for any
+///          pinhole camera: pixel (x, y) lies at corner + x * step_x + y * step_y on the plane at distance 1 along
+///          forward.
+class screen_projection {
+protected:
+    /// \brief If the corner rays span the frame, only then points can be projected
+    bool valid_ = false;
+
+    /// \brief The position of the camera
+    bardrix::point3 eye_;
+
+    /// \brief The view direction, the average of the corner rays
+    bardrix::vector3 forward_;
+
+    /// \brief Pixel (0, 0) on the plane at distance 1 along forward, relative to the eye
+    bardrix::vector3 corner_;
+
+    /// \brief The distance between two pixels on the plane along x and y
+    bardrix::vector3 step_x_, step_y_;
+
+    /// \brief The screen axes, normalized and perpendicular to forward
+    bardrix::vector3 right_, up_;
+
+    /// \brief The dot products of the steps, to solve for the pixel coordinates
+    double gram_xx_ = 0, gram_xy_ = 0, gram_yy_ = 0, determinant_ = 0;
+
+public:
+    // CONSTRUCTORS
+
+    /// \brief Default constructor for screen_projection (invalid)
+    screen_projection() = default;
+
+    /// \brief Constructor for screen_projection
+    /// \param camera The camera the primary rays are shot from
+    /// \param width The width of the frame in pixels
+    /// \param height The height of the frame in pixels
+    screen_projection(const bardrix::camera& camera, int width, int height);
+
+    // GETTERS
+    NODISCARD bool is_valid() const;
+    NODISCARD const bardrix::point3& get_eye() const;
+    NODISCARD const bardrix::vector3& get_forward() const;
+
+    // PROJECTION
+
+    /// \brief Projects a point in front of the eye onto the frame
+    /// \param from_eye The vector from the eye to the point, its depth along forward must be positive
+    /// \return The pixel coordinates { x, y }, may lie outside the frame
+    NODISCARD std::array<double, 2> project(const bardrix::vector3& from_eye) const;
+
+    /// \brief Projects the bounds of a sphere onto the frame
+    /// \param center The center of the sphere
+    /// \param radius The radius of the sphere
+    /// \return The pixel bounds { x_min, y_min, x_max, y_max }, may lie outside the frame.
+    ///         std::nullopt when the sphere reaches behind the eye, then its projection is unbounded.
+    /// \example auto bounds = projection.bounds(sphere.get_position(), sphere.get_radius());
+    NODISCARD std::optional<std::array<double, 4>> bounds(const bardrix::point3& center, double radius) const;
+
+    /// \brief Projects a box onto the frame
+    /// \param box The box
+    /// \return The pixel bounds { x_min, y_min, x_max, y_max }, may lie outside the frame.
+    ///         std::nullopt when the box reaches behind the eye, then its projection is unbounded.
+    NODISCARD std::optional<std::array<double, 4>> bounds(const aabb& box) const;
+}; // class screen_projection
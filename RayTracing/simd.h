@@ -0,0 +1,293 @@
+#pragma once
+
+#include <bardrix/bardrix.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#if defined(__AVX512F__) || defined(__AVX__) || defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <immintrin.h>
+#define SIMD_SSE 1
+#endif
+
+#if defined(__AVX__)
+#define SIMD_AVX 1
+#endif
+
+#if defined(__AVX512F__)
+#define SIMD_AVX512 1
+#endif
+
+/// \brief Thin wrappers around the SIMD registers of the compiled instruction set
+/// \details vfloat<N> holds N float lanes and vmask<N> the result of a lane wise comparison. Widths without a
+///          matching instruction set fall back to plain arrays, so every width compiles everywhere.
+///          Enable AVX (/arch:AVX2) or AVX-512 (/arch:AVX512) to get the 8 and 16 wide registers.
+namespace simd {
+
+    /// \brief The widest vfloat the compiled instruction set supports natively
+#if defined(SIMD_AVX512)
+    constexpr int native_width = 16;
+#elif defined(SIMD_AVX)
+    constexpr int native_width = 8;
+#elif defined(SIMD_SSE)
+    constexpr int native_width = 4;
+#else
+    constexpr int native_width = 1;
+#endif
+
+    // GENERIC
+
+    /// \brief Result of a lane wise comparison, bit i is set when lane i passed
+    template<int N>
+    struct vmask {
+        std::uint32_t value;
+
+        NODISCARD std::uint32_t bits() const { return value; }
+        NODISCARD bool any() const { return value != 0; }
+        NODISCARD bool none() const { return value == 0; }
+
+        vmask operator&(vmask other) const { return { value & other.value }; }
+        vmask operator|(vmask other) const { return { value | other.value }; }
+        vmask operator~() const { return { ~value & ((N == 32 ? 0u : 1u << N) - 1u) }; }
+    };
+
+    /// \brief N float lanes
+    template<int N>
+    struct vfloat {
+        float lanes[N];
+
+        vfloat() = default;
+        vfloat(float value) { std::fill(lanes, lanes + N, value); }
+
+        /// \brief Loads N floats, pointer must be aligned to the vector size
+        static vfloat load(const float* pointer) { return loadu(pointer); }
+        static vfloat loadu(const float* pointer) { vfloat v; std::copy(pointer, pointer + N, v.lanes); return v; }
+        /// \brief Loads N bytes and converts them to floats, e.g. quantized bounds
+        static vfloat from_bytes(const std::uint8_t* pointer) { vfloat v; std::copy(pointer, pointer + N, v.lanes); return v; }
+        void store(float* pointer) const { std::copy(lanes, lanes + N, pointer); }
+
+        /// \brief Gets the lane indices {0, 1, ..., N - 1}
+        static vfloat iota() { vfloat v; for (int i = 0; i < N; i++) v.lanes[i] = static_cast<float>(i); return v; }
+
+        NODISCARD float operator[](int lane) const { return lanes[lane]; }
+    };
+
+    template<int N> vfloat<N> operator+(const vfloat<N>& a, const vfloat<N>& b) { vfloat<N> r; for (int i = 0; i < N; i++) r.lanes[i] = a.lanes[i] + b.lanes[i]; return r; }
+    template<int N> vfloat<N> operator-(const vfloat<N>& a, const vfloat<N>& b) { vfloat<N> r; for (int i = 0; i < N; i++) r.lanes[i] = a.lanes[i] - b.lanes[i]; return r; }
+    template<int N> vfloat<N> operator*(const vfloat<N>& a, const vfloat<N>& b) { vfloat<N> r; for (int i = 0; i < N; i++) r.lanes[i] = a.lanes[i] * b.lanes[i]; return r; }
+    template<int N> vfloat<N> operator/(const vfloat<N>& a, const vfloat<N>& b) { vfloat<N> r; for (int i = 0; i < N; i++) r.lanes[i] = a.lanes[i] / b.lanes[i]; return r; }
+    template<int N> vfloat<N> min(const vfloat<N>& a, const vfloat<N>& b) { vfloat<N> r; for (int i = 0; i < N; i++) r.lanes[i] = std::min(a.lanes[i], b.lanes[i]); return r; }
+    template<int N> vfloat<N> max(const vfloat<N>& a, const vfloat<N>& b) { vfloat<N> r; for (int i = 0; i < N; i++) r.lanes[i] = std::max(a.lanes[i], b.lanes[i]); return r; }
+    template<int N> vfloat<N> sqrt(const vfloat<N>& a) { vfloat<N> r; for (int i = 0; i < N; i++) r.lanes[i] = std::sqrt(a.lanes[i]); return r; }
+
+    template<int N> vmask<N> operator<(const vfloat<N>& a, const vfloat<N>& b) { std::uint32_t m = 0; for (int i = 0; i < N; i++) m |= static_cast<std::uint32_t>(a.lanes[i] < b.lanes[i]) << i; return { m }; }
+    template<int N> vmask<N> operator<=(const vfloat<N>& a, const vfloat<N>& b) { std::uint32_t m = 0; for (int i = 0; i < N; i++) m |= static_cast<std::uint32_t>(a.lanes[i] <= b.lanes[i]) << i; return { m }; }
+    template<int N> vmask<N> operator>(const vfloat<N>& a, const vfloat<N>& b) { return b < a; }
+    template<int N> vmask<N> operator>=(const vfloat<N>& a, const vfloat<N>& b) { return b <= a; }
+
+    /// \brief Picks the lanes of a where the mask is set and the lanes of b elsewhere
+    template<int N> vfloat<N> select(const vmask<N>& mask, const vfloat<N>& a, const vfloat<N>& b) { vfloat<N> r; for (int i = 0; i < N; i++) r.lanes[i] = (mask.value >> i & 1u) ? a.lanes[i] : b.lanes[i]; return r; }
+
+    // SSE
+
+#if defined(SIMD_SSE)
+    template<>
+    struct vmask<4> {
+        __m128 value;
+
+        NODISCARD std::uint32_t bits() const { return static_cast<std::uint32_t>(_mm_movemask_ps(value)); }
+        NODISCARD bool any() const { return bits() != 0; }
+        NODISCARD bool none() const { return bits() == 0; }
+
+        vmask operator&(vmask other) const { return { _mm_and_ps(value, other.value) }; }
+        vmask operator|(vmask other) const { return { _mm_or_ps(value, other.value) }; }
+        vmask operator~() const { return { _mm_xor_ps(value, _mm_castsi128_ps(_mm_set1_epi32(-1))) }; }
+    };
+
+    template<>
+    struct vfloat<4> {
+        __m128 value;
+
+        vfloat() = default;
+        vfloat(__m128 value) : value(value) {}
+        vfloat(float value) : value(_mm_set1_ps(value)) {}
+
+        static vfloat load(const float* pointer) { return _mm_load_ps(pointer); }
+        static vfloat loadu(const float* pointer) { return _mm_loadu_ps(pointer); }
+        static vfloat from_bytes(const std::uint8_t* pointer) { return _mm_setr_ps(pointer[0], pointer[1], pointer[2], pointer[3]); }
+        void store(float* pointer) const { _mm_storeu_ps(pointer, value); }
+        static vfloat iota() { return _mm_setr_ps(0, 1, 2, 3); }
+
+        NODISCARD float operator[](int lane) const { alignas(16) float lanes[4]; _mm_store_ps(lanes, value); return lanes[lane]; }
+    };
+
+    inline vfloat<4> operator+(const vfloat<4>& a, const vfloat<4>& b) { return _mm_add_ps(a.value, b.value); }
+    inline vfloat<4> operator-(const vfloat<4>& a, const vfloat<4>& b) { return _mm_sub_ps(a.value, b.value); }
+    inline vfloat<4> operator*(const vfloat<4>& a, const vfloat<4>& b) { return _mm_mul_ps(a.value, b.value); }
+    inline vfloat<4> operator/(const vfloat<4>& a, const vfloat<4>& b) { return _mm_div_ps(a.value, b.value); }
+    inline vfloat<4> min(const vfloat<4>& a, const vfloat<4>& b) { return _mm_min_ps(a.value, b.value); }
+    inline vfloat<4> max(const vfloat<4>& a, const vfloat<4>& b) { return _mm_max_ps(a.value, b.value); }
+    inline vfloat<4> sqrt(const vfloat<4>& a) { return _mm_sqrt_ps(a.value); }
+
+    inline vmask<4> operator<(const vfloat<4>& a, const vfloat<4>& b) { return { _mm_cmplt_ps(a.value, b.value) }; }
+    inline vmask<4> operator<=(const vfloat<4>& a, const vfloat<4>& b) { return { _mm_cmple_ps(a.value, b.value) }; }
+    inline vmask<4> operator>(const vfloat<4>& a, const vfloat<4>& b) { return { _mm_cmpgt_ps(a.value, b.value) }; }
+    inline vmask<4> operator>=(const vfloat<4>& a, const vfloat<4>& b) { return { _mm_cmpge_ps(a.value, b.value) }; }
+
+    inline vfloat<4> select(const vmask<4>& mask, const vfloat<4>& a, const vfloat<4>& b) {
+        return _mm_or_ps(_mm_and_ps(mask.value, a.value), _mm_andnot_ps(mask.value, b.value));
+    }
+#endif // SIMD_SSE
+
+    // AVX
+
+#if defined(SIMD_AVX)
+    template<>
+    struct vmask<8> {
+        __m256 value;
+
+        NODISCARD std::uint32_t bits() const { return static_cast<std::uint32_t>(_mm256_movemask_ps(value)); }
+        NODISCARD bool any() const { return _mm256_testz_ps(value, value) == 0; }
+        NODISCARD bool none() const { return _mm256_testz_ps(value, value) != 0; }
+
+        vmask operator&(vmask other) const { return { _mm256_and_ps(value, other.value) }; }
+        vmask operator|(vmask other) const { return { _mm256_or_ps(value, other.value) }; }
+        vmask operator~() const { return { _mm256_xor_ps(value, _mm256_castsi256_ps(_mm256_set1_epi32(-1))) }; }
+    };
+
+    template<>
+    struct vfloat<8> {
+        __m256 value;
+
+        vfloat() = default;
+        vfloat(__m256 value) : value(value) {}
+        vfloat(float value) : value(_mm256_set1_ps(value)) {}
+
+        static vfloat load(const float* pointer) { return _mm256_load_ps(pointer); }
+        static vfloat loadu(const float* pointer) { return _mm256_loadu_ps(pointer); }
+#if defined(__AVX2__)
+        static vfloat from_bytes(const std::uint8_t* pointer) {
+            return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pointer))));
+        }
+#else
+        static vfloat from_bytes(const std::uint8_t* pointer) {
+            return _mm256_setr_ps(pointer[0], pointer[1], pointer[2], pointer[3], pointer[4], pointer[5], pointer[6], pointer[7]);
+        }
+#endif
+        void store(float* pointer) const { _mm256_storeu_ps(pointer, value); }
+        static vfloat iota() { return _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7); }
+
+        NODISCARD float operator[](int lane) const { alignas(32) float lanes[8]; _mm256_store_ps(lanes, value); return lanes[lane]; }
+    };
+
+    inline vfloat<8> operator+(const vfloat<8>& a, const vfloat<8>& b) { return _mm256_add_ps(a.value, b.value); }
+    inline vfloat<8> operator-(const vfloat<8>& a, const vfloat<8>& b) { return _mm256_sub_ps(a.value, b.value); }
+    inline vfloat<8> operator*(const vfloat<8>& a, const vfloat<8>& b) { return _mm256_mul_ps(a.value, b.value); }
+    inline vfloat<8> operator/(const vfloat<8>& a, const vfloat<8>& b) { return _mm256_div_ps(a.value, b.value); }
+    inline vfloat<8> min(const vfloat<8>& a, const vfloat<8>& b) { return _mm256_min_ps(a.value, b.value); }
+    inline vfloat<8> max(const vfloat<8>& a, const vfloat<8>& b) { return _mm256_max_ps(a.value, b.value); }
+    inline vfloat<8> sqrt(const vfloat<8>& a) { return _mm256_sqrt_ps(a.value); }
+
+    inline vmask<8> operator<(const vfloat<8>& a, const vfloat<8>& b) { return { _mm256_cmp_ps(a.value, b.value, _CMP_LT_OQ) }; }
+    inline vmask<8> operator<=(const vfloat<8>& a, const vfloat<8>& b) { return { _mm256_cmp_ps(a.value, b.value, _CMP_LE_OQ) }; }
+    inline vmask<8> operator>(const vfloat<8>& a, const vfloat<8>& b) { return { _mm256_cmp_ps(a.value, b.value, _CMP_GT_OQ) }; }
+    inline vmask<8> operator>=(const vfloat<8>& a, const vfloat<8>& b) { return { _mm256_cmp_ps(a.value, b.value, _CMP_GE_OQ) }; }
+
+    inline vfloat<8> select(const vmask<8>& mask, const vfloat<8>& a, const vfloat<8>& b) {
+        return _mm256_blendv_ps(b.value, a.value, mask.value);
+    }
+#endif // SIMD_AVX
+
+    // AVX-512
+
+#if defined(SIMD_AVX512)
+    template<>
+    struct vmask<16> {
+        __mmask16 value;
+
+        NODISCARD std::uint32_t bits() const { return value; }
+        NODISCARD bool any() const { return value != 0; }
+        NODISCARD bool none() const { return value == 0; }
+
+        vmask operator&(vmask other) const { return { static_cast<__mmask16>(value & other.value) }; }
+        vmask operator|(vmask other) const { return { static_cast<__mmask16>(value | other.value) }; }
+        vmask operator~() const { return { static_cast<__mmask16>(~value) }; }
+    };
+
+    template<>
+    struct vfloat<16> {
+        __m512 value;
+
+        vfloat() = default;
+        vfloat(__m512 value) : value(value) {}
+        vfloat(float value) : value(_mm512_set1_ps(value)) {}
+
+        static vfloat load(const float* pointer) { return _mm512_load_ps(pointer); }
+        static vfloat loadu(const float* pointer) { return _mm512_loadu_ps(pointer); }
+        static vfloat from_bytes(const std::uint8_t* pointer) {
+            return _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pointer))));
+        }
+        void store(float* pointer) const { _mm512_storeu_ps(pointer, value); }
+        static vfloat iota() { return _mm512_setr_ps(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15); }
+
+        NODISCARD float operator[](int lane) const { alignas(64) float lanes[16]; _mm512_store_ps(lanes, value); return lanes[lane]; }
+    };
+
+    inline vfloat<16> operator+(const vfloat<16>& a, const vfloat<16>& b) { return _mm512_add_ps(a.value, b.value); }
+    inline vfloat<16> operator-(const vfloat<16>& a, const vfloat<16>& b) { return _mm512_sub_ps(a.value, b.value); }
+    inline vfloat<16> operator*(const vfloat<16>& a, const vfloat<16>& b) { return _mm512_mul_ps(a.value, b.value); }
+    inline vfloat<16> operator/(const vfloat<16>& a, const vfloat<16>& b) { return _mm512_div_ps(a.value, b.value); }
+    inline vfloat<16> min(const vfloat<16>& a, const vfloat<16>& b) { return _mm512_min_ps(a.value, b.value); }
+    inline vfloat<16> max(const vfloat<16>& a, const vfloat<16>& b) { return _mm512_max_ps(a.value, b.value); }
+    inline vfloat<16> sqrt(const vfloat<16>& a) { return _mm512_sqrt_ps(a.value); }
+
+    inline vmask<16> operator<(const vfloat<16>& a, const vfloat<16>& b) { return { _mm512_cmp_ps_mask(a.value, b.value, _CMP_LT_OQ) }; }
+    inline vmask<16> operator<=(const vfloat<16>& a, const vfloat<16>& b) { return { _mm512_cmp_ps_mask(a.value, b.value, _CMP_LE_OQ) }; }
+    inline vmask<16> operator>(const vfloat<16>& a, const vfloat<16>& b) { return { _mm512_cmp_ps_mask(a.value, b.value, _CMP_GT_OQ) }; }
+    inline vmask<16> operator>=(const vfloat<16>& a, const vfloat<16>& b) { return { _mm512_cmp_ps_mask(a.value, b.value, _CMP_GE_OQ) }; }
+
+    inline vfloat<16> select(const vmask<16>& mask, const vfloat<16>& a, const vfloat<16>& b) {
+        return _mm512_mask_blend_ps(mask.value, b.value, a.value);
+    }
+#endif // SIMD_AVX512
+
+    // HELPERS
+
+    /// \brief Gets the smallest lane
+    /// \param v The vector to reduce
+    /// \return The smallest value over all lanes
+    template<int N>
+    float reduce_min(const vfloat<N>& v) {
+        float lanes[N];
+        v.store(lanes);
+        return *std::min_element(lanes, lanes + N);
+    }
+
+    /// \brief Gets the sum of all lanes
+    /// \param v The vector to reduce
+    /// \return The sum over all lanes, added in lane order
+    template<int N>
+    float reduce_add(const vfloat<N>& v) {
+        float lanes[N];
+        v.store(lanes);
+        float sum = 0;
+        for (int i = 0; i < N; i++)
+            sum += lanes[i];
+        return sum;
+    }
+
+    /// \brief Gets the index of the lowest set bit
+    /// \param bits The bits, must not be 0
+    /// \return The index of the lowest set bit
+    inline int first_bit(std::uint32_t bits) {
+        int index = 0;
+        while ((bits & 1u) == 0) {
+            bits >>= 1;
+            index++;
+        }
+        return index;
+    }
+
+} // namespace simd
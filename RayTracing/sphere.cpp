@@ -13,6 +13,8 @@ sphere::sphere(double radius, const bardrix::point3& position) : sphere(radius,
 
 sphere::sphere(double radius, const bardrix::point3& position, const bardrix::material& material) : radius_(radius), position_(position), material_(material) {}
 
+double sphere::get_radius() const { return radius_; }
+
 void sphere::set_material(const bardrix::material& material) { this->material_ = material; }
 
 const bardrix::material& sphere::get_material() const { return material_; }
@@ -57,4 +59,45 @@ std::optional<bardrix::point3> sphere::intersection(const bardrix::ray& ray) con
     return (distance < ray.get_length() && distance > 0)
         ? std::optional(ray.position + ray.get_direction() * distance)
         : std::nullopt;
-}
\ No newline at end of file
+}
+
+std::optional<hit_record> sphere::hit(const bardrix::ray& ray, double t_min, double t_max) const {
+    const bardrix::vector3& direction = ray.get_direction();
+
+    // Solve |origin + t * direction - center|^2 = radius^2, direction is normalized so a = 1
+    const bardrix::vector3 ray_to_sphere_vector = ray.position.vector_to(position_);
+    const double b = ray_to_sphere_vector.dot(direction);
+    const double c = ray_to_sphere_vector.dot(ray_to_sphere_vector) - radius_ * radius_;
+
+    const double discriminant = b * b - c;
+    if (discriminant < 0)
+        return std::nullopt;
+
+    // Take the near root, or the far root when the near one lies before t_min (e.g. the origin is inside)
+    const double root = std::sqrt(discriminant);
+    double t = b - root;
+    if (t < t_min)
+        t = b + root;
+
+    if (t < t_min || t > t_max)
+        return std::nullopt;
+
+    hit_record record;
+    record.t = t;
+    record.normal = (direction * t - ray_to_sphere_vector) * (1 / radius_);
+    return record;
+}
+
+bool sphere::occludes(const bardrix::ray& ray, double t_min, double t_max) const {
+    const bardrix::vector3 ray_to_sphere_vector = ray.position.vector_to(position_);
+    const double b = ray_to_sphere_vector.dot(ray.get_direction());
+    const double c = ray_to_sphere_vector.dot(ray_to_sphere_vector) - radius_ * radius_;
+
+    const double discriminant = b * b - c;
+    if (discriminant < 0)
+        return false;
+
+    // The ray is inside the sphere between the roots, any overlap with [t_min, t_max] blocks it
+    const double root = std::sqrt(discriminant);
+    return b - root <= t_max && b + root >= t_min;
+}
@@ -3,6 +3,8 @@
 // Created by Bardio on 22/05/2024.
 //
 
+#include "hit_record.h"
+
 #include <bardrix/objects.h>
 
 /// \brief Sphere shape
@@ -39,6 +41,7 @@ public:
     sphere(double radius, const bardrix::point3& position, const bardrix::material& material);
 
     // GETTERS/SETTERS
+    NODISCARD double get_radius() const;
     NODISCARD const bardrix::material& get_material() const override;
     NODISCARD const bardrix::point3& get_position() const override;
     void set_material(const bardrix::material& material) override;
@@ -58,4 +61,20 @@ public:
     /// \example std::optional<bardrix::point3> intersection = sphere.intersection(ray);
     /// \example if (intersection.has_value()) { /* Do something with the intersection point */ }
     NODISCARD std::optional<bardrix::point3> intersection(const bardrix::ray& ray) const override;
+
+    /// \brief Get the nearest intersection of a ray with the sphere within a distance interval
+    /// \param ray The ray to check for intersection
+    /// \param t_min The minimum distance along the ray
+    /// \param t_max The maximum distance along the ray, pass the distance of the nearest hit so far to shrink the search
+    /// \return The hit (with id 0) if it exists within [t_min, t_max], otherwise std::nullopt
+    /// \example std::optional<hit_record> hit = sphere.hit(ray, 0, ray.get_length());
+    NODISCARD std::optional<hit_record> hit(const bardrix::ray& ray, double t_min, double t_max) const;
+
+    /// \brief Checks if the sphere blocks a ray within a distance interval, cheaper than hit as nothing is built
+    /// \param ray The ray to check, e.g. a shadow ray towards a light
+    /// \param t_min The minimum distance along the ray, a small epsilon to not block on the surface the ray starts at
+    /// \param t_max The maximum distance along the ray, e.g. the distance to the light
+    /// \return If the part of the ray inside the sphere overlaps [t_min, t_max]
+    /// \example bool shadowed = sphere.occludes(shadow_ray, 1e-4, distance_to_light);
+    NODISCARD bool occludes(const bardrix::ray& ray, double t_min, double t_max) const;
 }; // class sphere
\ No newline at end of file
@@ -0,0 +1,181 @@
+#include "sphere_batch.h"
+
+#include <map>
+#include <tuple>
+
+using lane = simd::vfloat<sphere_batch::width>;
+using lane_mask = simd::vmask<sphere_batch::width>;
+
+sphere_batch::sphere_batch(const std::vector<sphere>& spheres) { assign(spheres); }
+
+std::size_t sphere_batch::size() const { return size_; }
+
+std::uint32_t sphere_batch::get_material_index(std::size_t index) const { return material_index_[index]; }
+
+const std::vector<bardrix::material>& sphere_batch::get_materials() const { return materials_; }
+
+void sphere_batch::assign(const std::vector<sphere>& spheres) {
+    size_ = spheres.size();
+    const std::size_t padded = (size_ + padding - 1) / padding * padding;
+
+    center_x_.assign(padded, 0);
+    center_y_.assign(padded, 0);
+    center_z_.assign(padded, 0);
+    radius_squared_.assign(padded, -1);
+    material_index_.assign(size_, 0);
+    materials_.clear();
+
+    // Spheres with equal materials share an index
+    using material_key = std::tuple<double, double, double, double, std::uint32_t>;
+    std::map<material_key, std::uint32_t> indices;
+
+    for (std::size_t i = 0; i < size_; i++) {
+        update(i, spheres[i]);
+
+        const bardrix::material& material = spheres[i].get_material();
+        const material_key key(material.get_ambient(), material.get_diffuse(), material.get_specular(),
+                               material.get_shininess(), material.color.argb());
+        auto [it, inserted] = indices.try_emplace(key, static_cast<std::uint32_t>(materials_.size()));
+        if (inserted)
+            materials_.push_back(material);
+        material_index_[i] = it->second;
+    }
+}
+
+void sphere_batch::update(std::size_t index, const sphere& sphere) {
+    const bardrix::point3& position = sphere.get_position();
+    center_x_[index] = static_cast<float>(position.x);
+    center_y_[index] = static_cast<float>(position.y);
+    center_z_[index] = static_cast<float>(position.z);
+    radius_squared_[index] = static_cast<float>(sphere.get_radius() * sphere.get_radius());
+}
+
+void sphere_batch::refit(const std::vector<sphere>& spheres, const std::vector<std::uint32_t>& changed) {
+    for (std::uint32_t index : changed)
+        update(index, spheres[index]);
+}
+
+std::optional<hit_record> sphere_batch::closest_hit(const bardrix::ray& ray, double t_min, double t_max) const {
+    float t;
+    const std::size_t id = nearest(ray.position, ray.get_direction(), t_min, t_max, t);
+    if (id == size_)
+        return std::nullopt;
+
+    hit_record record;
+    record.t = t;
+    record.id = id;
+    const bardrix::point3 center(center_x_[id], center_y_[id], center_z_[id]);
+    record.normal = center.vector_to(record.point(ray)).normalized();
+    return record;
+}
+
+void sphere_batch::closest_hits(const ray_queue& rays, hit_queue& hits) const {
+    for (std::size_t i = 0; i < rays.size(); i++) {
+        const bardrix::point3 origin(rays.origin_x[i], rays.origin_y[i], rays.origin_z[i]);
+        const bardrix::vector3 direction(rays.direction_x[i], rays.direction_y[i], rays.direction_z[i]);
+        float t;
+        const std::size_t id = nearest(origin, direction, 0, rays.t_max[i], t);
+        if (id == size_)
+            continue;
+
+        const bardrix::point3 point = origin + direction * static_cast<double>(t);
+        const bardrix::point3 center(center_x_[id], center_y_[id], center_z_[id]);
+        hits.push(point, center.vector_to(point).normalized(), static_cast<std::uint32_t>(id), rays, i);
+    }
+}
+
+std::size_t sphere_batch::nearest(const bardrix::point3& origin, const bardrix::vector3& direction, double t_min,
+                                  double t_max, float& distance) const {
+    const lane origin_x(static_cast<float>(origin.x));
+    const lane origin_y(static_cast<float>(origin.y));
+    const lane origin_z(static_cast<float>(origin.z));
+    const lane direction_x(static_cast<float>(direction.x));
+    const lane direction_y(static_cast<float>(direction.y));
+    const lane direction_z(static_cast<float>(direction.z));
+    const lane minimum(static_cast<float>(t_min));
+    const lane zero(0.0f);
+    const lane step(static_cast<float>(width));
+
+    // Every lane keeps its own nearest hit, they're reduced once at the end
+    lane best_t(static_cast<float>(t_max));
+    lane best_index(-1.0f);
+    lane index = lane::iota();
+
+    const std::size_t padded = center_x_.size();
+    for (std::size_t i = 0; i < padded; i += width, index = index + step) {
+        const lane to_center_x = lane::load(&center_x_[i]) - origin_x;
+        const lane to_center_y = lane::load(&center_y_[i]) - origin_y;
+        const lane to_center_z = lane::load(&center_z_[i]) - origin_z;
+
+        // Distance along the ray to the point closest to the center
+        const lane b = to_center_x * direction_x + to_center_y * direction_y + to_center_z * direction_z;
+
+        // Squared distance from that point to the center, more precise than |oc|^2 - b^2 for far spheres
+        const lane perpendicular_x = to_center_x - direction_x * b;
+        const lane perpendicular_y = to_center_y - direction_y * b;
+        const lane perpendicular_z = to_center_z - direction_z * b;
+        const lane discriminant = lane::load(&radius_squared_[i]) - (perpendicular_x * perpendicular_x +
+                                  perpendicular_y * perpendicular_y + perpendicular_z * perpendicular_z);
+
+        lane_mask hit = discriminant >= zero;
+        if (hit.none())
+            continue;
+
+        // Near root, or the far root when the near one lies before t_min
+        const lane root = simd::sqrt(simd::max(discriminant, zero));
+        const lane near_t = b - root;
+        const lane t = simd::select(near_t >= minimum, near_t, b + root);
+
+        hit = hit & (t >= minimum) & (t < best_t);
+        best_t = simd::select(hit, t, best_t);
+        best_index = simd::select(hit, index, best_index);
+    }
+
+    count_traversal(0, size_);
+
+    const float closest = simd::reduce_min(best_t);
+    const lane_mask winner = (best_t <= lane(closest)) & (best_index >= zero);
+    if (winner.none())
+        return size_;
+
+    distance = closest;
+    return static_cast<std::size_t>(best_index[simd::first_bit(winner.bits())]);
+}
+
+bool sphere_batch::any_hit(const bardrix::ray& ray, double t_min, double t_max) const {
+    const bardrix::vector3& direction = ray.get_direction();
+    const lane origin_x(static_cast<float>(ray.position.x));
+    const lane origin_y(static_cast<float>(ray.position.y));
+    const lane origin_z(static_cast<float>(ray.position.z));
+    const lane direction_x(static_cast<float>(direction.x));
+    const lane direction_y(static_cast<float>(direction.y));
+    const lane direction_z(static_cast<float>(direction.z));
+    const lane minimum(static_cast<float>(t_min));
+    const lane maximum(static_cast<float>(t_max));
+    const lane zero(0.0f);
+
+    // Same test as closest_hit, but the first block with a blocker ends the search
+    const std::size_t padded = center_x_.size();
+    for (std::size_t i = 0; i < padded; i += width) {
+        const lane to_center_x = lane::load(&center_x_[i]) - origin_x;
+        const lane to_center_y = lane::load(&center_y_[i]) - origin_y;
+        const lane to_center_z = lane::load(&center_z_[i]) - origin_z;
+
+        const lane b = to_center_x * direction_x + to_center_y * direction_y + to_center_z * direction_z;
+        const lane perpendicular_x = to_center_x - direction_x * b;
+        const lane perpendicular_y = to_center_y - direction_y * b;
+        const lane perpendicular_z = to_center_z - direction_z * b;
+        const lane discriminant = lane::load(&radius_squared_[i]) - (perpendicular_x * perpendicular_x +
+                                  perpendicular_y * perpendicular_y + perpendicular_z * perpendicular_z);
+
+        const lane root = simd::sqrt(simd::max(discriminant, zero));
+        const lane_mask blocked = (discriminant >= zero) & (b - root <= maximum) & (b + root >= minimum);
+        if (blocked.any()) {
+            count_traversal(0, std::min(i + width, size_));
+            return true;
+        }
+    }
+
+    count_traversal(0, size_);
+    return false;
+}
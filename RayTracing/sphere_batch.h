@@ -0,0 +1,96 @@
+#pragma once
+
+#include "accelerator.h"
+#include "aligned_allocator.h"
+#include "hit_record.h"
+#include "simd.h"
+#include "sphere.h"
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+/// \brief Structure-of-arrays copy of a list of spheres, tests one ray against simd::native_width spheres at once
+/// \details Every component lives in its own cache line aligned array (single precision), the arrays are padded
+///          with spheres that can never be hit so the kernel never needs a scalar tail. Hit distances are accurate
+///          to float precision and sphere indices are exact up to 2^24 spheres.
+class sphere_batch : public accelerator {
+public:
+    /// \brief The amount of spheres that are tested per instruction
+    static constexpr int width = simd::native_width < 4 ? 4 : simd::native_width;
+
+    /// \brief The arrays are padded to a multiple of this, so they fit every width
+    static constexpr std::size_t padding = 16;
+
+protected:
+    /// \brief Centers of the spheres
+    aligned_vector<float> center_x_, center_y_, center_z_;
+
+    /// \brief Squared radii of the spheres, padding uses -1 so the discriminant is always negative
+    aligned_vector<float> radius_squared_;
+
+    /// \brief Index into materials_ per sphere
+    aligned_vector<std::uint32_t> material_index_;
+
+    /// \brief The distinct materials of the spheres
+    std::vector<bardrix::material> materials_;
+
+    /// \brief The amount of spheres, without padding
+    std::size_t size_ = 0;
+
+public:
+    // CONSTRUCTORS
+
+    /// \brief Default constructor for sphere_batch (empty)
+    sphere_batch() = default;
+
+    /// \brief Constructor for sphere_batch
+    /// \param spheres The spheres to copy, the index of a sphere in this vector is its id in the hit records
+    explicit sphere_batch(const std::vector<sphere>& spheres);
+
+    // GETTERS/SETTERS
+    NODISCARD std::size_t size() const;
+    NODISCARD std::uint32_t get_material_index(std::size_t index) const;
+    NODISCARD const std::vector<bardrix::material>& get_materials() const;
+
+    /// \brief Replaces all spheres
+    /// \param spheres The spheres to copy
+    void assign(const std::vector<sphere>& spheres);
+
+    /// \brief Updates the position and radius of a single sphere, e.g. after sphere::set_position
+    /// \param index The index of the sphere
+    /// \param sphere The new state of the sphere
+    void update(std::size_t index, const sphere& sphere);
+
+    void refit(const std::vector<sphere>& spheres, const std::vector<std::uint32_t>& changed) override;
+
+    // RAYTRACING
+
+    /// \brief Finds the nearest intersection of a ray with all spheres in the batch
+    /// \param ray The ray to check for intersection
+    /// \param t_min The minimum distance along the ray
+    /// \param t_max The maximum distance along the ray
+    /// \return The nearest hit with the index of the sphere as id, otherwise std::nullopt
+    /// \example std::optional<hit_record> hit = batch.closest_hit(ray, 0, ray.get_length());
+    NODISCARD std::optional<hit_record> closest_hit(const bardrix::ray& ray, double t_min, double t_max) const override;
+
+    using accelerator::closest_hits;
+
+    /// \brief Finds the nearest intersection of every ray of a queue, each ray is tested against width spheres at once
+    /// \details The rays are read straight from the arrays of the queue, the hits are accurate to float precision
+    ///          like closest_hit
+    void closest_hits(const ray_queue& rays, hit_queue& hits) const override;
+
+    NODISCARD bool any_hit(const bardrix::ray& ray, double t_min, double t_max) const override;
+
+protected:
+    /// \brief Finds the nearest sphere along a ray in single precision, the kernel of closest_hit and closest_hits
+    /// \param origin The origin of the ray
+    /// \param direction The normalized direction of the ray
+    /// \param t_min The minimum distance along the ray
+    /// \param t_max The maximum distance along the ray
+    /// \param distance Set to the distance to the nearest sphere
+    /// \return The index of the nearest sphere, otherwise size()
+    NODISCARD std::size_t nearest(const bardrix::point3& origin, const bardrix::vector3& direction, double t_min,
+                                  double t_max, float& distance) const;
+}; // class sphere_batch
@@ -0,0 +1,144 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+namespace {
+    /// \brief The pool the calling thread is a worker of, nullptr for threads outside any pool
+    thread_local const thread_pool* current_pool = nullptr;
+
+    /// \brief The queue index of the calling thread within current_pool
+    thread_local std::size_t current_index = 0;
+} // namespace
+
+bool task_group::done() const { return pending_.load(std::memory_order_acquire) == 0; }
+
+thread_pool::thread_pool(unsigned int threads) {
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    for (unsigned int i = 0; i < threads; i++)
+        queues_.push_back(std::make_unique<worker_queue>());
+
+    // The thread that waits is the first thread, so we only need threads - 1 workers
+    workers_.reserve(threads - 1);
+    for (std::size_t i = 1; i < threads; i++)
+        workers_.emplace_back([this, i] { worker_loop(i); });
+}
+
+thread_pool::~thread_pool() {
+    {
+        std::lock_guard lock(sleep_mutex_);
+        stopping_ = true;
+    }
+    sleep_condition_.notify_all();
+
+    for (std::thread& worker : workers_)
+        worker.join();
+}
+
+unsigned int thread_pool::get_thread_count() const { return static_cast<unsigned int>(queues_.size()); }
+
+void thread_pool::run(task_group& group, std::function<void()> function) {
+    group.pending_.fetch_add(1, std::memory_order_relaxed);
+
+    worker_queue& queue = *queues_[current_queue()];
+    {
+        std::lock_guard lock(queue.mutex);
+        queue.tasks.push_back({ std::move(function), &group });
+    }
+
+    queued_.fetch_add(1, std::memory_order_release);
+
+    // Locking makes sure a worker that is about to sleep sees the new task
+    { std::lock_guard lock(sleep_mutex_); }
+    sleep_condition_.notify_one();
+}
+
+void thread_pool::wait(task_group& group) {
+    const std::size_t own = current_queue();
+
+    task task;
+    while (!group.done()) {
+        if (take(own, task))
+            execute(task);
+        else
+            std::this_thread::yield(); // The remaining tasks are running on other threads
+    }
+}
+
+void thread_pool::parallel_for(std::size_t begin, std::size_t end, std::size_t grain,
+                               const std::function<void(std::size_t, std::size_t)>& function) {
+    if (begin >= end)
+        return;
+
+    task_group group;
+    split(group, begin, end, std::max<std::size_t>(grain, 1), function);
+    wait(group);
+}
+
+std::size_t thread_pool::current_queue() const { return current_pool == this ? current_index : 0; }
+
+bool thread_pool::take(std::size_t own, task& result) {
+    if (queued_.load(std::memory_order_acquire) == 0)
+        return false;
+
+    // Newest task of our own queue first, it's likely still in cache
+    {
+        worker_queue& queue = *queues_[own];
+        std::lock_guard lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            result = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+            queued_.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    // Steal the oldest task of another queue, these are the largest pieces of work
+    for (std::size_t i = 1; i < queues_.size(); i++) {
+        worker_queue& queue = *queues_[(own + i) % queues_.size()];
+        std::lock_guard lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            result = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            queued_.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void thread_pool::execute(task& task) {
+    task.function();
+    task.function = nullptr;
+    task.group->pending_.fetch_sub(1, std::memory_order_release);
+}
+
+void thread_pool::worker_loop(std::size_t own) {
+    current_pool = this;
+    current_index = own;
+
+    task task;
+    while (!stopping_) {
+        if (take(own, task)) {
+            execute(task);
+            continue;
+        }
+
+        std::unique_lock lock(sleep_mutex_);
+        sleep_condition_.wait(lock, [this] { return stopping_ || queued_.load(std::memory_order_acquire) > 0; });
+    }
+}
+
+void thread_pool::split(task_group& group, std::size_t begin, std::size_t end, std::size_t grain,
+                        const std::function<void(std::size_t, std::size_t)>& function) {
+    // Give away the upper half until the range is small enough
+    while (end - begin > grain) {
+        const std::size_t middle = begin + (end - begin) / 2;
+        run(group, [this, &group, middle, end, grain, &function] { split(group, middle, end, grain, function); });
+        end = middle;
+    }
+
+    function(begin, end);
+}
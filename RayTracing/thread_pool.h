@@ -0,0 +1,124 @@
+#pragma once
+
+#include <bardrix/bardrix.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// \brief A group of tasks that can be waited on together
+/// \example task_group group; pool.run(group, [] { /* work */ }); pool.wait(group);
+class task_group {
+    friend class thread_pool;
+
+    /// \brief The amount of tasks in this group that haven't finished yet
+    std::atomic<std::size_t> pending_ = 0;
+
+public:
+    /// \brief Checks if all tasks of this group have finished
+    /// \return True if no task of this group is queued or running
+    NODISCARD bool done() const;
+};
+
+/// \brief Work-stealing thread pool, every thread owns a deque of tasks
+/// \details A thread pushes and pops tasks at the back of its own deque, idle threads steal from the front of the
+///          other deques. The thread that waits on a task_group helps out executing tasks, so tasks may spawn and
+///          wait on other tasks without deadlocking.
+class thread_pool {
+protected:
+    /// \brief A queued task
+    struct task {
+        /// \brief The function to run
+        std::function<void()> function;
+
+        /// \brief The group the task belongs to
+        task_group* group;
+    };
+
+    /// \brief A deque of tasks owned by a single thread
+    struct worker_queue {
+        std::mutex mutex;
+        std::deque<task> tasks;
+    };
+
+    /// \brief The queues, index 0 is shared by all threads outside the pool (e.g. the main thread)
+    std::vector<std::unique_ptr<worker_queue>> queues_;
+
+    /// \brief The worker threads, worker i owns queue i + 1
+    std::vector<std::thread> workers_;
+
+    /// \brief The amount of tasks that are queued but not yet taken
+    std::atomic<std::size_t> queued_ = 0;
+
+    /// \brief Set when the pool is destroyed
+    std::atomic<bool> stopping_ = false;
+
+    /// \brief Used to put idle workers to sleep
+    std::mutex sleep_mutex_;
+    std::condition_variable sleep_condition_;
+
+public:
+    /// \brief Constructor for the thread pool
+    /// \param threads The amount of threads that execute tasks including the waiting thread,
+    ///                0 means one per hardware thread
+    explicit thread_pool(unsigned int threads = 0);
+
+    /// \brief Destructor for the thread pool, waits for the workers to finish their current task
+    ~thread_pool();
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    /// \brief Gets the amount of threads that execute tasks, including the thread that waits
+    /// \return The amount of threads
+    NODISCARD unsigned int get_thread_count() const;
+
+    /// \brief Queues a task on the deque of the calling thread
+    /// \param group The group the task belongs to
+    /// \param function The function to run
+    void run(task_group& group, std::function<void()> function);
+
+    /// \brief Waits until all tasks of the group have finished, executing queued tasks in the meantime
+    /// \param group The group to wait on
+    void wait(task_group& group);
+
+    /// \brief Calls function(begin, end) for sub ranges of [begin, end) in parallel and waits for them
+    /// \param begin The first index
+    /// \param end One past the last index
+    /// \param grain The maximum size of a sub range
+    /// \param function The function to call for every sub range
+    /// \details The range is split in halves, the calling thread keeps one half and queues the other, so thieves
+    ///          take large ranges and rarely need to come back.
+    /// \example pool.parallel_for(0, n, 64, [&](std::size_t begin, std::size_t end) { /* work */ });
+    void parallel_for(std::size_t begin, std::size_t end, std::size_t grain,
+                      const std::function<void(std::size_t, std::size_t)>& function);
+
+protected:
+    /// \brief Gets the index of the queue the calling thread owns
+    /// \return The queue index, 0 for threads that are not part of this pool
+    NODISCARD std::size_t current_queue() const;
+
+    /// \brief Takes a task, first from the back of the own queue, then from the front of the other queues
+    /// \param own The index of the queue of the calling thread
+    /// \param result The task that was taken
+    /// \return If a task was taken
+    bool take(std::size_t own, task& result);
+
+    /// \brief Runs a task and marks it as finished in its group
+    /// \param task The task to run
+    static void execute(task& task);
+
+    /// \brief The loop of a worker thread
+    /// \param own The index of the queue of the worker
+    void worker_loop(std::size_t own);
+
+    /// \brief Splits [begin, end) in halves until grain is reached, see parallel_for
+    void split(task_group& group, std::size_t begin, std::size_t end, std::size_t grain,
+               const std::function<void(std::size_t, std::size_t)>& function);
+}; // class thread_pool
@@ -0,0 +1,77 @@
+#include "tile_bins.h"
+
+#include <algorithm>
+#include <cmath>
+
+void tile_bins::build(const bardrix::camera& camera, const std::vector<sphere>& spheres, int width, int height,
+                      int tile_size, double max_distance, thread_pool* pool) {
+    tile_size_ = std::max(tile_size, 1);
+    tiles_x_ = (width + tile_size_ - 1) / tile_size_;
+    tiles_y_ = (height + tile_size_ - 1) / tile_size_;
+    rectangles_.resize(spheres.size());
+
+    const std::array<int, 4> everywhere = { 0, 0, tiles_x_ - 1, tiles_y_ - 1 };
+    const std::array<int, 4> nowhere = { 1, 0, 0, 0 };
+
+    const screen_projection projection(camera, width, height);
+
+    auto rectangle_of = [&](const sphere& s) -> std::array<int, 4> {
+        if (!projection.is_valid())
+            return everywhere;
+
+        const bardrix::vector3 to_center = projection.get_eye().vector_to(s.get_position());
+        const double radius = s.get_radius();
+        const double depth = to_center.dot(projection.get_forward());
+
+        if (depth + radius <= 0 || to_center.length() - radius > max_distance)
+            return nowhere; // Behind the camera or out of reach of the primary rays
+
+        const auto bounds = projection.bounds(s.get_position(), radius);
+        if (!bounds.has_value())
+            return everywhere; // Reaches behind the eye, the projection is unbounded
+        const auto [x_min, y_min, x_max, y_max] = bounds.value();
+
+        // Only the rays through the pixel centers matter, a pixel of margin covers the rounding
+        if (x_max < -1 || y_max < -1 || x_min > width || y_min > height)
+            return nowhere;
+
+        auto tile_of = [&](double pixel, int tiles) {
+            return std::clamp(static_cast<int>(std::floor(pixel / tile_size_)), 0, tiles - 1);
+        };
+        return { tile_of(x_min - 1, tiles_x_), tile_of(y_min - 1, tiles_y_), tile_of(x_max + 1, tiles_x_),
+                 tile_of(y_max + 1, tiles_y_) };
+    };
+
+    if (pool != nullptr)
+        pool->parallel_for(0, spheres.size(), 4096, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i < end; i++)
+                rectangles_[i] = rectangle_of(spheres[i]);
+        });
+    else
+        for (std::size_t i = 0; i < spheres.size(); i++)
+            rectangles_[i] = rectangle_of(spheres[i]);
+
+    // Count the spheres per tile, turn the counts into offsets and fill the tiles in a second pass
+    offsets_.assign(static_cast<std::size_t>(tiles_x_) * tiles_y_ + 1, 0);
+    for (const std::array<int, 4>& rectangle : rectangles_)
+        for (int y = rectangle[1]; y <= rectangle[3]; y++)
+            for (int x = rectangle[0]; x <= rectangle[2]; x++)
+                offsets_[static_cast<std::size_t>(y) * tiles_x_ + x + 1]++;
+
+    for (std::size_t i = 1; i < offsets_.size(); i++)
+        offsets_[i] += offsets_[i - 1];
+
+    references_.resize(offsets_.back());
+    std::vector<std::uint32_t> cursors(offsets_.begin(), offsets_.end() - 1);
+    for (std::size_t i = 0; i < rectangles_.size(); i++)
+        for (int y = rectangles_[i][1]; y <= rectangles_[i][3]; y++)
+            for (int x = rectangles_[i][0]; x <= rectangles_[i][2]; x++)
+                references_[cursors[static_cast<std::size_t>(y) * tiles_x_ + x]++] = static_cast<std::uint32_t>(i);
+}
+
+std::span<const std::uint32_t> tile_bins::candidates(int tile_x, int tile_y) const {
+    const std::size_t tile = static_cast<std::size_t>(tile_y) * tiles_x_ + tile_x;
+    return { references_.data() + offsets_[tile], references_.data() + offsets_[tile + 1] };
+}
+
+std::size_t tile_bins::get_reference_count() const { return references_.size(); }
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "screen_projection.h"
+#include "sphere.h"
+#include "thread_pool.h"
+
+#include <bardrix/camera.h>
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+/// \brief Lists of the spheres that can be seen through every screen tile
+/// \details Every sphere is projected through the camera onto the screen, and added to every tile its projection
+///          overlaps. A primary ray then only tests the spheres of its tile, so a frame costs
+///          O(spheres + overlaps) instead of O(pixels * spheres).
+///          The projection (screen_projection) matches the primary rays of the renderer for any pinhole camera. The
+///          lists are stored compressed (CSR) and reused from frame to frame.
+class tile_bins {
+protected:
+    /// \brief The width and height of a tile in pixels
+    int tile_size_ = 1;
+
+    /// \brief The amount of tiles along x
+    int tiles_x_ = 0;
+
+    /// \brief The amount of tiles along y
+    int tiles_y_ = 0;
+
+    /// \brief The first position in references_ of every tile, one extra entry marks the end of the last tile
+    std::vector<std::uint32_t> offsets_;
+
+    /// \brief The indices of the spheres of the tiles, tile after tile and ascending within a tile
+    std::vector<std::uint32_t> references_;
+
+    /// \brief The tiles every sphere covers as { x0, y0, x1, y1 } (inclusive), x0 > x1 for a sphere that can't be seen
+    std::vector<std::array<int, 4>> rectangles_;
+
+public:
+    // BUILDING
+
+    /// \brief Projects the spheres and fills the lists of all tiles
+    /// \param camera The camera the primary rays are shot from
+    /// \param spheres The spheres to project
+    /// \param width The width of the frame in pixels
+    /// \param height The height of the frame in pixels
+    /// \param tile_size The width and height of a tile in pixels
+    /// \param max_distance The length of the primary rays, spheres further away are left out
+    /// \param pool The threads to project on, may be nullptr
+    void build(const bardrix::camera& camera, const std::vector<sphere>& spheres, int width, int height,
+               int tile_size, double max_distance, thread_pool* pool = nullptr);
+
+    // GETTERS
+
+    /// \brief Gets the spheres that can be seen through a tile
+    /// \param tile_x The x coordinate of the tile
+    /// \param tile_y The y coordinate of the tile
+    /// \return The ascending indices of the spheres
+    /// \example for (std::uint32_t id : bins.candidates(x / tile_size, y / tile_size)) { ... }
+    NODISCARD std::span<const std::uint32_t> candidates(int tile_x, int tile_y) const;
+
+    /// \brief Gets the amount of sphere references over all tiles
+    NODISCARD std::size_t get_reference_count() const;
+}; // class tile_bins
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <bardrix/bardrix.h>
+
+#include <atomic>
+#include <cstdint>
+
+/// \brief Lock-free hand-off of values from one writer thread to one reader thread
+/// \details The writer fills the back slot and publishes it, the reader picks up the latest published slot as its
+///          front. The third slot sits in between, so neither side ever waits on the other: the writer never
+///          overwrites the front the reader is using, and the reader always gets the newest complete value.
+///          Values that are published while the reader doesn't look are skipped.
+/// \example buffer.back() = value; buffer.publish(); ... if (buffer.update()) use(buffer.front());
+template <typename T>
+class triple_buffer {
+protected:
+    /// \brief The bits of middle_ that hold the index of the slot
+    static constexpr std::uint8_t index_mask = 3;
+
+    /// \brief The bit of middle_ that is set when the middle slot holds a value the reader hasn't seen
+    static constexpr std::uint8_t fresh = 4;
+
+    /// \brief The slots
+    T slots_[3] = {};
+
+    /// \brief The slot the writer fills, only used by the writer
+    std::uint8_t back_ = 0;
+
+    /// \brief The slot in between, with the fresh bit
+    std::atomic<std::uint8_t> middle_ = 1;
+
+    /// \brief The slot the reader uses, only used by the reader
+    std::uint8_t front_ = 2;
+
+public:
+    // WRITER
+
+    /// \brief Gets the slot to write the next value into
+    NODISCARD T& back() { return slots_[back_]; }
+
+    /// \brief Hands the back slot to the reader and takes the middle slot as the new back
+    void publish() {
+        back_ = middle_.exchange(static_cast<std::uint8_t>(back_ | fresh), std::memory_order_acq_rel) & index_mask;
+    }
+
+    // READER
+
+    /// \brief Takes the latest published value as the front, when there is one
+    /// \return If the front changed
+    bool update() {
+        if ((middle_.load(std::memory_order_acquire) & fresh) == 0)
+            return false;
+
+        front_ = middle_.exchange(front_, std::memory_order_acq_rel) & index_mask;
+        return true;
+    }
+
+    /// \brief Gets the value the reader took with the last update()
+    NODISCARD const T& front() const { return slots_[front_]; }
+}; // class triple_buffer
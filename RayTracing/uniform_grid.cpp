@@ -0,0 +1,184 @@
+#include "uniform_grid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+uniform_grid::uniform_grid(const std::vector<sphere>& spheres, double cells_per_sphere)
+    : cells_per_sphere_(cells_per_sphere) {
+    build(spheres);
+}
+
+const aabb& uniform_grid::get_bounds() const { return bounds_; }
+
+int uniform_grid::get_resolution(int axis) const { return resolution_[axis]; }
+
+std::size_t uniform_grid::get_reference_count() const { return references_.size(); }
+
+void uniform_grid::build(const std::vector<sphere>& spheres) {
+    bounds_ = aabb();
+    offsets_.clear();
+    references_.clear();
+    primitives_.resize(spheres.size());
+
+    for (std::size_t i = 0; i < spheres.size(); i++) {
+        primitives_[i] = { spheres[i].get_position(), spheres[i].get_radius(), static_cast<std::uint32_t>(i) };
+        bounds_.grow(aabb::of_sphere(primitives_[i].center, primitives_[i].radius));
+    }
+
+    if (spheres.empty())
+        return;
+
+    // Cubic cells, as many as cells_per_sphere times the amount of spheres
+    const double volume = std::max(bounds_.extent(0), 1e-12) * std::max(bounds_.extent(1), 1e-12) *
+                          std::max(bounds_.extent(2), 1e-12);
+    const double cell = std::cbrt(volume / (cells_per_sphere_ * static_cast<double>(spheres.size())));
+    for (int axis = 0; axis < 3; axis++) {
+        resolution_[axis] = std::clamp(static_cast<int>(std::ceil(bounds_.extent(axis) / cell)), 1, max_resolution);
+        cell_size_[axis] = bounds_.extent(axis) / resolution_[axis];
+    }
+
+    // Count the spheres per cell, turn the counts into offsets and fill the cells in a second pass
+    offsets_.assign(static_cast<std::size_t>(resolution_[0]) * resolution_[1] * resolution_[2] + 1, 0);
+
+    auto for_each_cell = [&](const bvh_primitive& primitive, auto&& function) {
+        const aabb box = aabb::of_sphere(primitive.center, primitive.radius);
+        const int x0 = cell_of(box.min.x, 0), x1 = cell_of(box.max.x, 0);
+        const int y0 = cell_of(box.min.y, 1), y1 = cell_of(box.max.y, 1);
+        const int z0 = cell_of(box.min.z, 2), z1 = cell_of(box.max.z, 2);
+        for (int z = z0; z <= z1; z++)
+            for (int y = y0; y <= y1; y++)
+                for (int x = x0; x <= x1; x++)
+                    function(index_of(x, y, z));
+    };
+
+    for (const bvh_primitive& primitive : primitives_)
+        for_each_cell(primitive, [&](std::size_t cell_index) { offsets_[cell_index + 1]++; });
+
+    for (std::size_t i = 1; i < offsets_.size(); i++)
+        offsets_[i] += offsets_[i - 1];
+
+    references_.resize(offsets_.back());
+    std::vector<std::uint32_t> cursors(offsets_.begin(), offsets_.end() - 1);
+    for (const bvh_primitive& primitive : primitives_)
+        for_each_cell(primitive, [&](std::size_t cell_index) { references_[cursors[cell_index]++] = primitive.id; });
+}
+
+void uniform_grid::refit(const std::vector<sphere>& spheres, const std::vector<std::uint32_t>&) { build(spheres); }
+
+int uniform_grid::cell_of(double value, int axis) const {
+    const double offset = value - aabb::axis_of(bounds_.min, axis);
+    const int cell = cell_size_[axis] > 0 ? static_cast<int>(offset / cell_size_[axis]) : 0;
+    return std::clamp(cell, 0, resolution_[axis] - 1);
+}
+
+std::size_t uniform_grid::index_of(int x, int y, int z) const {
+    return (static_cast<std::size_t>(z) * resolution_[1] + y) * resolution_[0] + x;
+}
+
+template<typename CellFunction>
+void uniform_grid::walk(const bardrix::ray& ray, double t_min, const double& t_max, CellFunction&& function) const {
+    const bardrix::point3& origin = ray.position;
+    const bardrix::vector3& direction = ray.get_direction();
+    const bardrix::vector3 inverse_direction(1 / direction.x, 1 / direction.y, 1 / direction.z);
+
+    double entry;
+    if (primitives_.empty() || !bounds_.intersect(origin, inverse_direction, t_min, t_max, entry))
+        return;
+
+    // The cell the ray enters the grid in, and per axis the distance to the next cell boundary and between boundaries
+    const bardrix::point3 start = origin + direction * entry;
+    const double directions[3] = { direction.x, direction.y, direction.z };
+    const double inverses[3] = { inverse_direction.x, inverse_direction.y, inverse_direction.z };
+
+    int cell[3], step[3];
+    double next[3], delta[3];
+    for (int axis = 0; axis < 3; axis++) {
+        cell[axis] = cell_of(aabb::axis_of(start, axis), axis);
+        if (directions[axis] == 0) {
+            step[axis] = 0;
+            next[axis] = delta[axis] = std::numeric_limits<double>::infinity();
+            continue;
+        }
+
+        step[axis] = directions[axis] > 0 ? 1 : -1;
+        const double boundary = aabb::axis_of(bounds_.min, axis) + (cell[axis] + (step[axis] > 0 ? 1 : 0)) *
+                                cell_size_[axis];
+        next[axis] = (boundary - aabb::axis_of(origin, axis)) * inverses[axis];
+        delta[axis] = cell_size_[axis] * std::abs(inverses[axis]);
+    }
+
+    while (true) {
+        if (function(index_of(cell[0], cell[1], cell[2])))
+            return;
+
+        // A hit inside this cell can't be beaten by the cells after it
+        const int axis = next[0] < next[1] ? (next[0] < next[2] ? 0 : 2) : (next[1] < next[2] ? 1 : 2);
+        if (t_max <= next[axis])
+            return;
+
+        cell[axis] += step[axis];
+        if (cell[axis] < 0 || cell[axis] >= resolution_[axis])
+            return;
+        next[axis] += delta[axis];
+    }
+}
+
+std::optional<hit_record> uniform_grid::closest_hit(const bardrix::ray& ray, double t_min, double t_max) const {
+    const bardrix::point3& origin = ray.position;
+    const bardrix::vector3& direction = ray.get_direction();
+
+    std::uint32_t mailbox[mailbox_size];
+    std::fill(mailbox, mailbox + mailbox_size, invalid);
+
+    std::uint64_t visited = 0, tested = 0;
+    std::uint32_t closest = invalid;
+
+    walk(ray, t_min, t_max, [&](std::size_t index) {
+        visited++;
+        for (std::uint32_t i = offsets_[index]; i < offsets_[index + 1]; i++) {
+            const std::uint32_t id = references_[i];
+            if (mailbox[id & (mailbox_size - 1)] == id)
+                continue; // Already tested in a previous cell
+            mailbox[id & (mailbox_size - 1)] = id;
+
+            double t;
+            tested++;
+            if (primitives_[id].intersect(origin, direction, t_min, t_max, t)) {
+                t_max = t;
+                closest = id;
+            }
+        }
+        return false;
+    });
+
+    count_traversal(visited, tested);
+
+    if (closest == invalid)
+        return std::nullopt;
+
+    const bvh_primitive& primitive = primitives_[closest];
+    hit_record record;
+    record.t = t_max;
+    record.id = primitive.id;
+    record.normal = primitive.center.vector_to(record.point(ray)) * (1 / primitive.radius);
+    return record;
+}
+
+bool uniform_grid::any_hit(const bardrix::ray& ray, double t_min, double t_max) const {
+    std::uint64_t visited = 0, tested = 0;
+    bool blocked = false;
+
+    // No mailbox, a sphere in several cells is rarely tested twice before the first blocker ends the walk
+    walk(ray, t_min, t_max, [&](std::size_t index) {
+        visited++;
+        for (std::uint32_t i = offsets_[index]; i < offsets_[index + 1] && !blocked; i++) {
+            tested++;
+            blocked = primitives_[references_[i]].occludes(ray.position, ray.get_direction(), t_min, t_max);
+        }
+        return blocked;
+    });
+
+    count_traversal(visited, tested);
+    return blocked;
+}
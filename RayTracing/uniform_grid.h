@@ -0,0 +1,103 @@
+#pragma once
+
+#include "aabb.h"
+#include "accelerator.h"
+#include "bvh.h"
+#include "sphere.h"
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+/// \brief Uniform grid over spheres, walked cell by cell along the ray with a 3D-DDA (Amanatides and Woo)
+/// \details Made for dense fields of similarly sized spheres spread evenly through a box, e.g. granular media, where
+///          stepping from cell to cell is cheaper than descending a tree. The cell size follows from the amount of
+///          spheres per volume, see cells_per_sphere.
+///          The cells are stored compressed (CSR): offsets_[c] up to offsets_[c + 1] are the positions in
+///          references_ of the spheres overlapping cell c.
+class uniform_grid : public accelerator {
+public:
+    /// \brief The index used for "no sphere"
+    static constexpr std::uint32_t invalid = bvh::invalid;
+
+    /// \brief The maximum amount of cells along an axis
+    static constexpr int max_resolution = 1024;
+
+    /// \brief The amount of spheres a ray remembers to not test a sphere again in the next cells, a power of two
+    static constexpr std::uint32_t mailbox_size = 16;
+
+protected:
+    /// \brief The bounds of all spheres
+    aabb bounds_;
+
+    /// \brief The amount of cells along every axis
+    int resolution_[3] = { 0, 0, 0 };
+
+    /// \brief The size of a cell along every axis
+    double cell_size_[3] = { 0, 0, 0 };
+
+    /// \brief The amount of cells per sphere the grid aims for
+    double cells_per_sphere_ = 2;
+
+    /// \brief The first position in references_ of every cell, one extra entry marks the end of the last cell
+    std::vector<std::uint32_t> offsets_;
+
+    /// \brief The indices of the spheres overlapping the cells, cell after cell
+    std::vector<std::uint32_t> references_;
+
+    /// \brief The spheres, indexed by the index of the sphere
+    std::vector<bvh_primitive> primitives_;
+
+public:
+    // CONSTRUCTORS
+
+    /// \brief Default constructor for uniform_grid (empty)
+    uniform_grid() = default;
+
+    /// \brief Constructor for uniform_grid, builds the grid
+    /// \param spheres The spheres to build over, the index of a sphere is its id in the hit records
+    /// \param cells_per_sphere The amount of cells per sphere, the cell size is chosen so the grid has about
+    ///        cells_per_sphere * spheres.size() cells. 2 makes cells about as large as the spheres of an even field.
+    explicit uniform_grid(const std::vector<sphere>& spheres, double cells_per_sphere = 2);
+
+    // GETTERS
+    NODISCARD const aabb& get_bounds() const;
+
+    /// \brief Gets the amount of cells along an axis
+    /// \param axis 0 for x, 1 for y, 2 for z
+    NODISCARD int get_resolution(int axis) const;
+
+    /// \brief Gets the amount of sphere references over all cells, a sphere is referenced by every cell it overlaps
+    NODISCARD std::size_t get_reference_count() const;
+
+    // BUILDING
+
+    /// \brief (Re)builds the grid, the cell size is chosen again
+    /// \param spheres The spheres to build over
+    void build(const std::vector<sphere>& spheres);
+
+    /// \brief Rebuilds the grid, moving a sphere between cells costs as much as rebuilding the compressed cells
+    void refit(const std::vector<sphere>& spheres, const std::vector<std::uint32_t>& changed) override;
+
+    // RAYTRACING
+
+    NODISCARD std::optional<hit_record> closest_hit(const bardrix::ray& ray, double t_min,
+                                                    double t_max) const override;
+
+    NODISCARD bool any_hit(const bardrix::ray& ray, double t_min, double t_max) const override;
+
+protected:
+    /// \brief Gets the cell of a coordinate along an axis, clamped to the grid
+    NODISCARD int cell_of(double value, int axis) const;
+
+    /// \brief Gets the index of a cell in offsets_
+    NODISCARD std::size_t index_of(int x, int y, int z) const;
+
+    /// \brief Walks the cells along a ray with a 3D-DDA, front to back
+    /// \param ray The ray to walk along
+    /// \param t_min The minimum distance along the ray
+    /// \param t_max The maximum distance along the ray, may shrink during the walk to end it early
+    /// \param function Called with the index of every cell, returns true to end the walk
+    template<typename CellFunction>
+    void walk(const bardrix::ray& ray, double t_min, const double& t_max, CellFunction&& function) const;
+}; // class uniform_grid
@@ -14,8 +14,6 @@ bardrix::window::window(const char* title, int width, int height) {
 
     width_ = width > 0 ? width : -width;
     height_ = height > 0 ? height : -height;
-    back_buffer_.resize(width_ * height_);
-    front_buffer_.resize(width_ * height_);
 
     bmi_.bmiHeader.biSize = sizeof(bmi_.bmiHeader);
     bmi_.bmiHeader.biWidth = width_;
@@ -100,15 +98,14 @@ LRESULT CALLBACK bardrix::window::window_proc(HWND hwnd, UINT msg, WPARAM wparam
         PAINTSTRUCT ps;
         HDC hdc = BeginPaint(hwnd, &ps);
 
-        if (p_window->on_paint) // Call the on_paint function
-            p_window->on_paint(p_window, p_window->back_buffer_);
-
-        std::swap(p_window->front_buffer_, p_window->back_buffer_);
-
-        // Draw the front buffer to the screen
-        StretchDIBits(hdc, 0, 0, p_window->width_, p_window->height_, 0, 0, p_window->width_,
-            p_window->height_, p_window->front_buffer_.data(), &p_window->bmi_, DIB_RGB_COLORS,
-            SRCCOPY);
+        // Only blit the frame, it may still have the size from before a resize
+        const rendered_frame* frame = p_window->on_paint ? p_window->on_paint(p_window) : nullptr;
+        if (frame != nullptr && frame->width > 0 && frame->height > 0) {
+            p_window->bmi_.bmiHeader.biWidth = frame->width;
+            p_window->bmi_.bmiHeader.biHeight = -frame->height; // top-down
+            StretchDIBits(hdc, 0, 0, p_window->width_, p_window->height_, 0, 0, frame->width,
+                frame->height, frame->pixels.data(), &p_window->bmi_, DIB_RGB_COLORS, SRCCOPY);
+        }
 
         EndPaint(hwnd, &ps);
         break;
@@ -116,10 +113,6 @@ LRESULT CALLBACK bardrix::window::window_proc(HWND hwnd, UINT msg, WPARAM wparam
     case WM_SIZE:
         p_window->width_ = LOWORD(lparam);
         p_window->height_ = HIWORD(lparam);
-        p_window->bmi_.bmiHeader.biWidth = p_window->width_;
-        p_window->bmi_.bmiHeader.biHeight = -p_window->height_; // top-down
-        p_window->back_buffer_.resize(p_window->width_ * p_window->height_);
-        p_window->front_buffer_.resize(p_window->width_ * p_window->height_);
         if (p_window->on_resize)
             p_window->on_resize(p_window, p_window->width_, p_window->height_);
         break;
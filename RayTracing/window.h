@@ -6,6 +6,8 @@
 #pragma once
 #ifdef _WIN32
 
+#include "render_thread.h"
+
 #include <bardrix/bardrix.h>
 #include <bardrix/color.h>
 
@@ -32,14 +34,10 @@ namespace bardrix {
 
         /// \brief The on_paint function, called when the window needs to be painted.
         /// \param window The original window that needs to be painted.
-        /// \param buffer The buffer to paint to where the format used is AARRGGBB.
-        /// \example window.on_paint = [](bardrix::window* window, std::vector<uint32_t>& buffer) {    \n
-        ///         for (unsigned int & i : buffer) {                                                           \n
-        ///             bardrix::color red = bardrix::color::magenta();                                         \n
-        ///             i = red.a() << 24 | red.r() << 16 | red.g() << 8 | red.b();                             \n
-        ///         }                                                                                           \n
-        ///     };
-        std::function<void(bardrix::window* window, std::vector<uint32_t>& buffer)> on_paint;
+        /// \return The frame to show, stretched to the window, or nullptr to leave the window as it is.
+        /// \note This runs inside the message pump, render on another thread (render_thread) and return quickly.
+        /// \example window.on_paint = [&thread](bardrix::window* window) { return thread.latest(); };
+        std::function<const rendered_frame*(bardrix::window* window)> on_paint;
 
         /// \brief The on_close function, called when the window is closed.
         /// \param window The window that was closed.
@@ -55,9 +53,7 @@ namespace bardrix {
         /// \brief The handle to the window.
         HWND hwnd_{};
 
-        /// \brief Buffers for swapping between displaying and drawing.
-        std::vector<uint32_t> back_buffer_, front_buffer_;
-        /// \brief The bitmap info for the window.
+        /// \brief The bitmap info of the frame that is shown.
         BITMAPINFO bmi_ = {};
 
     public:
@@ -93,7 +89,7 @@ namespace bardrix {
         /// \brief Hides the window.
         void hide() const;
 
-        /// \brief Refreshes this specific window.
+        /// \brief Refreshes this specific window, can be called from any thread.
         /// \note This will call the on_paint function.
         void redraw() const;
 
@@ -1,5 +1,30 @@
 #include "pch.h"
 #include <sphere.h>
+#include <bvh.h>
+#include <bvh8.h>
+#include <frame_scheduler.h>
+#include <framebuffer.h>
+#include <light_batch.h>
+#include <light_clusters.h>
+#include <light_tree.h>
+#include <morton.h>
+#include <primary_rays.h>
+#include <render_thread.h>
+#include <renderer.h>
+#include <sphere_batch.h>
+#include <uniform_grid.h>
+#include <thread_pool.h>
+#include <tile_bins.h>
+#include <triple_buffer.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <thread>
+#include <vector>
+
 TEST(SphereTest, Intersection) {
 	sphere s = sphere(1, { 0,0,3 }); bardrix::ray ray({ 0,0,0 }, { 0,0,1 }, 5);
 	auto intersection = s.intersection(ray);
@@ -7,4 +32,935 @@ TEST(SphereTest, Intersection) {
   EXPECT_EQ(1, 1);
   EXPECT_TRUE(true);
 
-}
\ No newline at end of file
+}
+
+TEST(SphereTest, HitRecord) {
+	sphere s = sphere(1, { 0,0,3 }); bardrix::ray ray({ 0,0,0 }, { 0,0,1 }, 5);
+	auto hit = s.hit(ray, 0, ray.get_length());
+	ASSERT_TRUE(hit.has_value());
+	EXPECT_DOUBLE_EQ(2, hit->t);
+	EXPECT_DOUBLE_EQ(-1, hit->normal.z);
+
+	// The interval limits the search, the far side is found when the near side lies before t_min
+	EXPECT_FALSE(s.hit(ray, 0, 1.5).has_value());
+	auto far = s.hit(ray, 2.5, ray.get_length());
+	ASSERT_TRUE(far.has_value());
+	EXPECT_DOUBLE_EQ(4, far->t);
+}
+
+TEST(SphereTest, Occludes) {
+	sphere s = sphere(1, { 0,0,3 }); bardrix::ray ray({ 0,0,0 }, { 0,0,1 }, 5);
+	EXPECT_TRUE(s.occludes(ray, 0, 5));
+	EXPECT_TRUE(s.occludes(ray, 3, 5)); // Starting inside still leaves through the far side
+	EXPECT_FALSE(s.occludes(ray, 0, 1.5));
+	EXPECT_FALSE(s.occludes(ray, 4.5, 5));
+	EXPECT_FALSE(s.occludes(bardrix::ray({ 0,2,0 }, { 0,0,1 }, 5), 0, 5));
+}
+
+// Spheres scattered in front of the origin
+static std::vector<sphere> random_spheres(int count, unsigned int seed) {
+	std::mt19937 random(seed);
+	std::uniform_real_distribution<double> position(-5, 5), radius(0.1, 0.5);
+	std::vector<sphere> spheres;
+	for (int i = 0; i < count; i++)
+		spheres.emplace_back(radius(random), bardrix::point3(position(random), position(random), position(random) + 10));
+	return spheres;
+}
+
+// Nearest hit by testing every sphere
+static std::optional<hit_record> brute_force_closest_hit(const std::vector<sphere>& spheres, const bardrix::ray& ray) {
+	std::optional<hit_record> closest;
+	for (std::size_t i = 0; i < spheres.size(); i++) {
+		auto hit = spheres[i].hit(ray, 0, closest.has_value() ? closest->t : ray.get_length());
+		if (hit.has_value()) {
+			closest = hit;
+			closest->id = i;
+		}
+	}
+	return closest;
+}
+
+// Compares the nearest hits of an accelerator with the brute force ones
+static void expect_same_hits(const accelerator& accelerator, const std::vector<sphere>& spheres, double tolerance) {
+	std::mt19937 random(7);
+	std::uniform_real_distribution<double> target(-5, 5);
+	for (int i = 0; i < 500; i++) {
+		bardrix::ray ray({ 0,0,0 }, { target(random), target(random), 10 }, 100);
+		auto expected = brute_force_closest_hit(spheres, ray);
+		auto actual = accelerator.closest_hit(ray, 0, ray.get_length());
+		ASSERT_EQ(expected.has_value(), actual.has_value());
+		if (expected.has_value()) {
+			EXPECT_EQ(expected->id, actual->id);
+			EXPECT_NEAR(expected->t, actual->t, tolerance);
+		}
+	}
+}
+
+TEST(SphereBatchTest, MatchesBruteForce) {
+	auto spheres = random_spheres(37, 42); // Not a multiple of any SIMD width
+	expect_same_hits(sphere_batch(spheres), spheres, 1e-4);
+}
+
+TEST(BvhTest, MatchesBruteForce) {
+	auto spheres = random_spheres(1000, 42);
+	bvh hierarchy(spheres);
+	expect_same_hits(hierarchy, spheres, 1e-9);
+	EXPECT_LT(hierarchy.sah_cost(), 1000);
+}
+
+TEST(BvhTest, SameTreeForAnyThreadCount) {
+	auto spheres = random_spheres(200000, 3); // Large enough for the chunked and parallel paths
+	bvh sequential(spheres);
+	for (unsigned int threads : { 1u, 3u, 8u }) {
+		thread_pool pool(threads);
+		bvh parallel(spheres, &pool);
+		ASSERT_EQ(sequential.get_nodes().size(), parallel.get_nodes().size());
+		for (std::size_t i = 0; i < sequential.get_nodes().size(); i++) {
+			const bvh_node& a = sequential.get_nodes()[i];
+			const bvh_node& b = parallel.get_nodes()[i];
+			ASSERT_EQ(a.left, b.left);
+			ASSERT_EQ(a.right, b.right);
+			ASSERT_EQ(a.count, b.count);
+			ASSERT_EQ(a.bounds.min, b.bounds.min);
+			ASSERT_EQ(a.bounds.max, b.bounds.max);
+		}
+		for (std::size_t i = 0; i < spheres.size(); i++)
+			ASSERT_EQ(sequential.get_primitives()[i].id, parallel.get_primitives()[i].id);
+	}
+	expect_same_hits(sequential, spheres, 1e-9);
+}
+
+TEST(BvhTest, LinearMatchesBruteForce) {
+	auto spheres = random_spheres(1000, 7);
+	spheres.push_back(spheres[10]); // Equal Morton codes
+	spheres.push_back(spheres[10]);
+	thread_pool pool(4);
+	for (bvh_builder builder : { bvh_builder::morton30, bvh_builder::morton63 }) {
+		bvh hierarchy(spheres, &pool, builder);
+		EXPECT_EQ(2 * spheres.size() - 1, hierarchy.get_nodes().size());
+		EXPECT_LT(hierarchy.get_depth(), 64u);
+		expect_same_hits(hierarchy, spheres, 1e-9);
+	}
+}
+
+TEST(BvhTest, RefitMatchesBruteForce) {
+	auto spheres = random_spheres(2000, 11);
+	for (bvh_builder builder : { bvh_builder::sah, bvh_builder::morton30 }) {
+		bvh hierarchy(spheres, nullptr, builder);
+		EXPECT_DOUBLE_EQ(1, hierarchy.get_degradation());
+
+		std::mt19937 random(5);
+		std::uniform_int_distribution<std::uint32_t> pick(0, static_cast<std::uint32_t>(spheres.size() - 1));
+		std::uniform_real_distribution<double> offset(-1, 1);
+		std::vector<std::uint32_t> changed;
+		for (int i = 0; i < 50; i++) {
+			const std::uint32_t index = pick(random);
+			spheres[index].set_position(spheres[index].get_position() + bardrix::vector3(offset(random), offset(random), offset(random)));
+			changed.push_back(index);
+		}
+
+		hierarchy.refit(spheres, changed);
+		expect_same_hits(hierarchy, spheres, 1e-9);
+		EXPECT_GT(hierarchy.get_degradation(), 1);
+	}
+}
+
+TEST(Bvh8Test, MatchesBruteForce) {
+	auto spheres = random_spheres(5000, 13);
+	spheres.push_back(sphere(0.5, bardrix::point3(1000, -2000, 3000))); // Far away, coarse grid
+	bvh8 hierarchy(spheres);
+	EXPECT_LT(hierarchy.get_nodes().size(), spheres.size() / 2);
+	expect_same_hits(hierarchy, spheres, 1e-9);
+
+	std::vector<std::uint32_t> changed;
+	for (std::uint32_t i = 0; i < spheres.size(); i += 97) {
+		spheres[i].set_position(spheres[i].get_position() + bardrix::vector3(0.5, -0.25, 1));
+		changed.push_back(i);
+	}
+	hierarchy.refit(spheres, changed);
+	expect_same_hits(hierarchy, spheres, 1e-9);
+}
+
+TEST(UniformGridTest, MatchesBruteForce) {
+	auto spheres = random_spheres(3000, 17);
+	for (double cells_per_sphere : { 0.01, 2.0, 20.0 }) {
+		uniform_grid grid(spheres, cells_per_sphere);
+		EXPECT_GE(grid.get_reference_count(), spheres.size());
+		expect_same_hits(grid, spheres, 1e-9);
+	}
+}
+
+TEST(BvhTest, PacketsMatchBruteForce) {
+	auto spheres = random_spheres(2000, 19);
+	bvh hierarchy(spheres);
+	std::mt19937 random(3);
+	std::uniform_real_distribution<double> target(-5, 5), jitter(-0.05, 0.05);
+	for (int p = 0; p < 200; p++) {
+		// Coherent packets alternate with packets whose directions disagree in sign, which skip the frustum test
+		const bool coherent = p % 2 == 0;
+		const double x = target(random), y = target(random);
+		ray_packet packet;
+		std::vector<bardrix::ray> rays;
+		for (int i = 0; i < 1 + p % ray_packet::max_size; i++) {
+			const bardrix::vector3 direction = coherent ? bardrix::vector3(x + jitter(random), y + jitter(random), 10)
+			                                            : bardrix::vector3(target(random), target(random), 10);
+			rays.emplace_back(bardrix::point3(jitter(random), jitter(random), 0), direction, 100);
+			packet.add(rays.back(), rays.back().get_length());
+		}
+
+		packet_hits hits;
+		hierarchy.closest_hits(packet, hits);
+		for (int i = 0; i < packet.size; i++) {
+			auto expected = brute_force_closest_hit(spheres, rays[i]);
+			ASSERT_EQ(expected.has_value(), hits[i].has_value());
+			if (expected.has_value()) {
+				EXPECT_EQ(expected->id, hits[i]->id);
+				EXPECT_NEAR(expected->t, hits[i]->t, 1e-9);
+			}
+		}
+	}
+}
+
+TEST(BvhTest, PacketsKeepGrazingHits) {
+	auto spheres = random_spheres(500, 89);
+	bvh hierarchy(spheres);
+	for (std::size_t s = 0; s < spheres.size(); s += 7) {
+		// Rays that pass the edge of a sphere just inside and just outside, where single precision can't tell
+		const bardrix::point3 center = spheres[s].get_position();
+		const double radius = spheres[s].get_radius();
+		const double offsets[ray_packet::max_size] = { -1e-3, -1e-5, -1e-7, -1e-9, 1e-9, 1e-7, 1e-5, 1e-3 };
+		ray_packet packet;
+		std::vector<bardrix::ray> rays;
+		const bardrix::vector3 to_center = bardrix::point3(0, 0, 0).vector_to(center);
+		const bardrix::vector3 side = to_center.cross(bardrix::vector3(0, 1, 0)).normalized();
+		const double distance = to_center.length();
+		for (double offset : offsets) {
+			// Aim beside the center so the ray passes it at radius * (1 + offset)
+			const double passing = radius * (1 + offset);
+			const bardrix::vector3 direction = to_center + side * (passing * distance /
+			                                                        std::sqrt(distance * distance - passing * passing));
+			rays.emplace_back(bardrix::point3(0, 0, 0), direction, 100);
+			packet.add(rays.back(), rays.back().get_length());
+		}
+
+		packet_hits hits;
+		hierarchy.closest_hits(packet, hits);
+		for (int i = 0; i < packet.size; i++) {
+			auto expected = hierarchy.closest_hit(rays[i], 0, rays[i].get_length());
+			ASSERT_EQ(expected.has_value(), hits[i].has_value()) << s << " " << offsets[i];
+			if (expected.has_value()) {
+				EXPECT_EQ(expected->id, hits[i]->id);
+				EXPECT_NEAR(expected->t, hits[i]->t, 1e-9);
+			}
+		}
+	}
+}
+
+TEST(AcceleratorTest, AnyHitMatchesBruteForce) {
+	auto spheres = random_spheres(2000, 29);
+	sphere_batch batch(spheres);
+	bvh hierarchy(spheres);
+	bvh8 wide(spheres);
+	uniform_grid grid(spheres);
+	const accelerator* accelerators[] = { &batch, &hierarchy, &wide, &grid };
+
+	std::mt19937 random(5);
+	std::uniform_real_distribution<double> position(-6, 6), length(1, 20);
+	for (int p = 0; p < 100; p++) {
+		// Shadow rays from points between the spheres towards lights at random distances
+		ray_packet packet;
+		packet.t_min = 1e-4;
+		std::vector<bardrix::ray> rays;
+		const bardrix::point3 origin(position(random), position(random), position(random) + 10);
+		for (int i = 0; i < ray_packet::max_size; i++) {
+			const bardrix::vector3 direction = bardrix::vector3(position(random), position(random), position(random)).normalized();
+			rays.emplace_back(origin, direction, length(random));
+			packet.add(origin, direction, rays.back().get_length());
+		}
+
+		std::uint32_t expected_bits = 0;
+		for (int i = 0; i < packet.size; i++) {
+			bool expected = false;
+			for (const sphere& s : spheres)
+				expected = expected || s.occludes(rays[i], packet.t_min, rays[i].get_length());
+			if (expected)
+				expected_bits |= 1u << i;
+
+			for (const accelerator* a : accelerators)
+				EXPECT_EQ(expected, a->any_hit(rays[i], packet.t_min, rays[i].get_length()));
+		}
+		EXPECT_EQ(expected_bits, hierarchy.any_hits(packet));
+	}
+}
+
+TEST(TileBinsTest, TilesListEverySphereTheirPixelsHit) {
+	auto spheres = random_spheres(300, 23);
+	spheres.push_back(sphere(0.5, bardrix::point3(0.2, 0.1, 0.3))); // Around the eye
+	spheres.push_back(sphere(0.5, bardrix::point3(0, 0, -5))); // Behind the camera
+	bardrix::camera camera({ 0,0,0 }, { 0.1,-0.05,1 }, 96, 64, 70);
+	tile_bins bins;
+	bins.build(camera, spheres, 96, 64, 16, 100);
+	EXPECT_LT(bins.get_reference_count(), spheres.size() * 24); // Far fewer than every sphere in all 24 tiles
+
+	for (int y = 0; y < 64; y++) {
+		for (int x = 0; x < 96; x++) {
+			bardrix::ray ray = *camera.shoot_ray(x, y, 100);
+			const auto candidates = bins.candidates(x / 16, y / 16);
+			for (std::uint32_t id = 0; id < spheres.size(); id++)
+				if (spheres[id].hit(ray, 0, 100).has_value()) {
+					ASSERT_TRUE(std::binary_search(candidates.begin(), candidates.end(), id)) << x << "," << y;
+				}
+		}
+	}
+}
+
+TEST(RendererTest, WavefrontMatchesPixelLoop) {
+	auto spheres = random_spheres(500, 31);
+	std::vector<bardrix::light> lights = { bardrix::light({ 0,5,0 }, 1, bardrix::color::cyan()),
+	                                       bardrix::light({ -4,-2,6 }, 2, bardrix::color::cyan()) };
+	bardrix::camera camera({ 0,0,0 }, { 0,0,1 }, 70, 45, 70);
+
+	for (bool shadows : { false, true }) {
+		for (packet_shape packets : { packet_shape::single, packet_shape::block }) {
+			// The single precision batch refines its hits, the grid traces the queue in ray_packets
+			for (acceleration_structure acceleration : { acceleration_structure::bvh, acceleration_structure::linear,
+			                                             acceleration_structure::grid }) {
+				render_options options;
+				options.threads = 2;
+				options.tile_size = 16;
+				options.shadows = shadows;
+				options.light_cutoff = shadows ? 0.01 : 0; // Clustered lights with shadows, all lights without
+				options.light_samples = packets == packet_shape::single ? 2 : 0;
+				options.packets = packets;
+				options.acceleration = acceleration;
+				renderer pixels(camera, spheres, lights, options);
+				options.wavefront = true;
+				renderer wavefront(camera, spheres, lights, options);
+
+				framebuffer expected, actual;
+				pixels.render(expected, 70, 45);
+				wavefront.render(actual, 70, 45);
+				EXPECT_EQ(expected, actual);
+			}
+		}
+	}
+}
+
+TEST(RendererTest, GBufferMatchesTracing) {
+	auto spheres = random_spheres(300, 53);
+	std::vector<bardrix::light> lights = { bardrix::light({ 0,5,0 }, 1, bardrix::color::cyan()) };
+	bardrix::camera camera({ 0,0,0 }, { 0,0,1 }, 60, 40, 70);
+
+	render_options options;
+	options.threads = 2;
+	options.shadows = true;
+	renderer traced(camera, spheres, lights, options);
+	options.g_buffer = true;
+	renderer cached(camera, spheres, lights, options);
+
+	framebuffer expected, actual;
+	for (int frame = 0; frame < 4; frame++) {
+		if (frame == 1) {
+			lights[0] = bardrix::light({ 2,-3,1 }, 3, bardrix::color::cyan()); // Only shades again
+			traced.lights_changed();
+			cached.lights_changed();
+		}
+		if (frame == 2) {
+			spheres[0].set_position(bardrix::point3(0, 0, 4)); // Retraces
+			traced.refit({ 0 });
+			cached.refit({ 0 });
+		}
+		if (frame == 3)
+			camera.position = bardrix::point3(0.5, 0, 0); // Retraces
+
+		traced.render(expected, 60, 40);
+		const render_stats stats = cached.render(actual, 60, 40);
+		EXPECT_EQ(frame == 1 ? 0u : 60u * 40u, stats.rays);
+		EXPECT_EQ(expected, actual);
+	}
+}
+
+TEST(RendererTest, CopiesLightsOnlyAfterTheyChanged) {
+	auto spheres = random_spheres(200, 101);
+	std::vector<bardrix::light> lights;
+	for (int i = 0; i < 64; i++)
+		lights.emplace_back(bardrix::point3(i % 8 - 4, i / 8 - 4, 1), 1, bardrix::color::cyan());
+	bardrix::camera camera({ 0,0,0 }, { 0,0,1 }, 40, 30, 70);
+
+	for (int light_samples : { 0, 2 }) {
+		render_options options;
+		options.threads = 2;
+		options.vectorized_shading = true;
+		options.light_samples = light_samples;
+		renderer renderer(camera, spheres, lights, options);
+		framebuffer actual, expected;
+		renderer.render(actual, 40, 30);
+
+		// The light batch and tree are refreshed by lights_changed(), the second frame must see the new lights
+		for (bardrix::light& light : lights)
+			light = bardrix::light(light.position, 3, bardrix::color::cyan());
+		renderer.lights_changed();
+		renderer.render(actual, 40, 30);
+
+		::renderer fresh(camera, spheres, lights, options);
+		fresh.render(expected, 40, 30);
+		fresh.render(expected, 40, 30);
+		EXPECT_EQ(expected, actual);
+	}
+}
+
+TEST(RendererTest, DirtyRectanglesMatchFullFrames) {
+	std::vector<bardrix::light> lights = { bardrix::light({ 0,5,0 }, 1, bardrix::color::cyan()),
+	                                       bardrix::light({ -4,-2,6 }, 2, bardrix::color::cyan()) };
+	bardrix::camera camera({ 0,0,0 }, { 0,0,1 }, 96, 64, 70);
+	std::mt19937 random(59);
+	std::uniform_int_distribution<std::uint32_t> pick(0, 299);
+	std::uniform_real_distribution<double> offset(-0.3, 0.3);
+
+	for (bool shadows : { false, true }) {
+		auto spheres = random_spheres(300, 61);
+		render_options options;
+		options.threads = 2;
+		options.tile_size = 16;
+		options.shadows = shadows;
+		renderer full(camera, spheres, lights, options);
+		renderer dirty(camera, spheres, lights, options);
+
+		framebuffer expected, actual;
+		for (int frame = 0; frame < 6; frame++) {
+			std::vector<std::uint32_t> changed = { pick(random) };
+			if (frame > 0) {
+				const bardrix::point3 position = spheres[changed[0]].get_position();
+				spheres[changed[0]].set_position(position + bardrix::vector3(offset(random), offset(random), 0));
+				full.refit(changed);
+				dirty.refit(changed);
+			}
+
+			full.render(expected, 96, 64);
+			const render_stats stats = dirty.render_dirty(actual, 96, 64);
+			EXPECT_EQ(expected, actual);
+			if (frame > 0 && !shadows) {
+				EXPECT_LT(stats.rays, 96u * 64u); // A small sphere doesn't cover the frame
+			}
+		}
+	}
+}
+
+TEST(RendererTest, RefitRebuildsWhenSpheresWereAdded) {
+	auto spheres = random_spheres(200, 97);
+	std::vector<bardrix::light> lights = { bardrix::light({ 0,5,0 }, 1, bardrix::color::cyan()) };
+	bardrix::camera camera({ 0,0,0 }, { 0,0,1 }, 48, 32, 70);
+	for (acceleration_structure acceleration : { acceleration_structure::linear, acceleration_structure::bvh,
+	                                             acceleration_structure::bvh8 }) {
+		render_options options;
+		options.threads = 2;
+		options.acceleration = acceleration;
+		renderer renderer(camera, spheres, lights, options);
+
+		// Indices past the last sphere are ignored
+		framebuffer expected, actual;
+		EXPECT_FALSE(renderer.refit({ 200, 5000 }));
+
+		// A new sphere right in front of the camera can't be refit into the structure
+		spheres.push_back(sphere(1, { 0,0,3 }));
+		EXPECT_TRUE(renderer.refit({ 200 }));
+		renderer.render(actual, 48, 32);
+		::renderer fresh(camera, spheres, lights, options);
+		fresh.render(expected, 48, 32);
+		EXPECT_EQ(expected, actual);
+
+		spheres.pop_back();
+		EXPECT_TRUE(renderer.refit({}));
+	}
+}
+
+TEST(RendererTest, ProgressivePassesRefineToTheFullFrame) {
+	auto spheres = random_spheres(300, 71);
+	std::vector<bardrix::light> lights = { bardrix::light({ 0,5,0 }, 1, bardrix::color::cyan()) };
+	bardrix::camera camera({ 0,0,0 }, { 0,0,1 }, 37, 22, 70); // Sizes that aren't multiples of the strides
+
+	for (packet_shape packets : { packet_shape::single, packet_shape::block }) {
+		render_options options;
+		options.threads = 2;
+		options.packets = packets;
+		renderer renderer(camera, spheres, lights, options);
+
+		framebuffer expected, actual;
+		renderer.render(expected, 37, 22);
+
+		// Pixels traced in a pass are final, the others copy a traced pixel of their block
+		std::vector<int> passes;
+		const render_stats stats = renderer.render_progressive(actual, 37, 22,
+			[&](const framebuffer& pixels, int pass) {
+				passes.push_back(pass);
+				for (int y = 0; y < 22; y++) {
+					for (int x = 0; x < 37; x++) {
+						const bool traced = pass == 0 ? x % 4 == 0 && y % 4 == 0
+						                    : pass == 1 ? x % 2 == 0 && y % 2 == 0
+						                    : pass == 2 ? (x + y) % 2 == 0 : true;
+						if (traced) {
+							ASSERT_EQ(expected[y * 37 + x], pixels[y * 37 + x]) << pass << " " << x << " " << y;
+						}
+					}
+				}
+				if (pass == 0) {
+					EXPECT_EQ(pixels[0], pixels[3 * 37 + 3]);
+				}
+			});
+
+		EXPECT_EQ(std::vector<int>({ 0, 1, 2, 3 }), passes);
+		EXPECT_EQ(37u * 22u, stats.rays); // Every pixel is traced once
+		EXPECT_EQ(expected, actual);
+	}
+}
+
+TEST(LightBatchTest, MatchesCalculateLightIntensity) {
+	std::mt19937 random(37);
+	std::uniform_real_distribution<double> position(-5, 5), intensity(0.5, 5);
+	std::vector<bardrix::light> lights;
+	for (int i = 0; i < 45; i++)
+		lights.emplace_back(bardrix::point3(position(random), position(random), position(random)), intensity(random),
+		                    bardrix::color::cyan());
+	light_batch batch(lights);
+	bardrix::camera camera({ 0,0,-10 }, { 0,0,1 }, 64, 64, 70);
+
+	// Integer shininess takes the SIMD kernel, the fractional one the fallback
+	for (const bardrix::material& material : { bardrix::material(0.1, 1, 0.5, 50), bardrix::material(0.2, 0.7, 0.3, 7),
+	                                           bardrix::material(0.1, 1, 0.5, 2.5) }) {
+		for (int p = 0; p < 50; p++) {
+			const bardrix::vector3 normal = bardrix::vector3(position(random), position(random), position(random)).normalized();
+			const bardrix::point3 point(position(random), position(random), position(random));
+			const std::size_t first = p % 7, count = lights.size() - first - p % 5;
+			const std::uint32_t occluded = static_cast<std::uint32_t>(random());
+
+			double expected = 0;
+			for (std::size_t i = 0; i < count; i++) {
+				const bardrix::light& light = lights[first + i];
+				expected += i < 32 && (occluded >> i) & 1
+					? std::min(1.0, material.get_ambient() * light.inverse_square_law(point))
+					: calculate_light_intensity(material, normal, light, camera, point);
+			}
+
+			EXPECT_NEAR(expected, batch.intensity(material, normal, point, camera, first, count, occluded), 1e-3 * count);
+		}
+	}
+}
+
+TEST(LightClustersTest, ClustersListEveryLightThatReachesTheirPoints) {
+	auto spheres = random_spheres(200, 41);
+	std::mt19937 random(43);
+	std::uniform_real_distribution<double> x(-5, 5), z(5, 15), intensity(0.01, 0.1);
+	std::vector<bardrix::light> lights;
+	for (int i = 0; i < 300; i++)
+		lights.emplace_back(bardrix::point3(x(random), x(random), z(random)), intensity(random), bardrix::color::cyan());
+	lights.emplace_back(bardrix::point3(0, 0, 0.1), 1, bardrix::color::cyan()); // Around the eye
+
+	const double cutoff = 0.01;
+	bardrix::camera camera({ 0,0,0 }, { 0,0,1 }, 64, 48, 70);
+	light_clusters clusters;
+	clusters.build(camera, lights, cutoff, 64, 48, 8, 8, 100);
+	EXPECT_LT(clusters.get_reference_count(), lights.size() * 8 * 6 * 8);
+
+	for (int y = 0; y < 48; y++) {
+		for (int x = 0; x < 64; x++) {
+			bardrix::ray ray = *camera.shoot_ray(x, y, 100);
+			auto hit = brute_force_closest_hit(spheres, ray);
+			if (!hit.has_value())
+				continue;
+
+			const bardrix::point3 point = hit->point(ray);
+			const light_range range = clusters.lights_at(x, y, point);
+			for (const bardrix::light& light : lights) {
+				if (light.inverse_square_law(point) < cutoff)
+					continue;
+
+				bool listed = false;
+				for (std::size_t i = 0; i < range.count && !listed; i++)
+					listed = range[i].position.x == light.position.x && range[i].position.y == light.position.y &&
+					         range[i].position.z == light.position.z;
+				ASSERT_TRUE(listed) << x << "," << y;
+			}
+		}
+	}
+}
+
+TEST(LightTreeTest, SamplingIsUnbiased) {
+	std::mt19937 random(47);
+	std::uniform_real_distribution<double> position(-5, 5), intensity(0.1, 2), u(0, 1);
+	std::vector<bardrix::light> lights;
+	for (int i = 0; i < 500; i++)
+		lights.emplace_back(bardrix::point3(position(random), position(random), position(random)), intensity(random),
+		                    bardrix::color::cyan());
+	light_tree tree(lights);
+	EXPECT_EQ(2 * lights.size() - 1, tree.get_nodes().size());
+
+	bardrix::camera camera({ 0,0,-10 }, { 0,0,1 }, 64, 64, 70);
+	const bardrix::material material(0.1, 1, 0.5, 50);
+	for (int p = 0; p < 20; p++) {
+		const bardrix::vector3 normal = bardrix::vector3(position(random), position(random), position(random)).normalized();
+		const bardrix::point3 point(position(random), position(random), position(random));
+
+		// The estimate is unbiased when every light that adds something can be picked
+		double exact = 0, total_pdf = 0;
+		for (std::uint32_t i = 0; i < lights.size(); i++) {
+			const double f = calculate_light_intensity(material, normal, lights[i], camera, point);
+			const double pdf = tree.pdf(point, normal, i);
+			exact += f;
+			total_pdf += pdf;
+			if (f > 0) {
+				ASSERT_GT(pdf, 0);
+			}
+		}
+		EXPECT_LE(total_pdf, 1 + 1e-9);
+
+		// The pdf a sample reports is the pdf of its light, and the average of f / pdf converges to the sum
+		double estimate = 0;
+		const int samples = 20000;
+		for (int s = 0; s < samples; s++) {
+			auto sample = tree.sample(point, normal, u(random));
+			if (!sample.has_value())
+				continue;
+			ASSERT_NEAR(tree.pdf(point, normal, sample->light), sample->pdf, 1e-12 + 1e-9 * sample->pdf);
+			estimate += calculate_light_intensity(material, normal, lights[sample->light], camera, point) / sample->pdf;
+		}
+		EXPECT_NEAR(exact, estimate / samples, 0.05 * exact + 1e-9);
+	}
+}
+
+TEST(MortonTest, RadixSortIsStable) {
+	std::vector<std::uint64_t> keys = { morton::encode30(3, 1, 2), 5, morton::encode30(0, 0, 1), 5, 0 };
+	std::vector<std::uint32_t> values = { 0, 1, 2, 3, 4 };
+	morton::radix_sort(keys, values, 30);
+	EXPECT_EQ((std::vector<std::uint64_t>{ 0, 1, 5, 5, 0b101110 }), keys);
+	EXPECT_EQ((std::vector<std::uint32_t>{ 4, 2, 1, 3, 0 }), values);
+}
+
+TEST(ThreadPoolTest, ParallelForVisitsEveryIndexOnce) {
+	thread_pool pool(4);
+	std::vector<std::atomic<int>> visits(10000);
+	pool.parallel_for(0, visits.size(), 7, [&](std::size_t begin, std::size_t end) {
+		for (std::size_t i = begin; i < end; i++)
+			visits[i]++;
+	});
+	for (const std::atomic<int>& v : visits)
+		ASSERT_EQ(1, v.load());
+}
+
+TEST(ThreadPoolTest, NestedTasksDoNotDeadlock) {
+	thread_pool pool(2);
+	std::atomic<int> count = 0;
+	pool.parallel_for(0, 16, 1, [&](std::size_t, std::size_t) {
+		pool.parallel_for(0, 16, 1, [&](std::size_t, std::size_t) { count++; });
+	});
+	EXPECT_EQ(256, count.load());
+}
+
+TEST(PrimaryRaysTest, RebuildsOnlyWhenCameraChanges) {
+	bardrix::camera camera({ 0,0,0 }, { 0,0,1 }, 40, 30, 60);
+	thread_pool pool(4);
+	primary_rays rays;
+	EXPECT_TRUE(rays.update(camera, 40, 30, 10, &pool));
+	EXPECT_FALSE(rays.update(camera, 40, 30, 10, &pool));
+
+	for (int y = 0; y < 30; y++) {
+		for (int x = 0; x < 40; x++) {
+			const bardrix::vector3 expected = camera.shoot_ray(x, y, 10)->get_direction();
+			const bardrix::vector3 direction = rays.direction(x, y);
+			ASSERT_EQ(expected.x, direction.x);
+			ASSERT_EQ(expected.y, direction.y);
+			ASSERT_EQ(expected.z, direction.z);
+		}
+	}
+
+	// A resize and a moved camera both rebuild the table
+	camera.set_width(50);
+	EXPECT_TRUE(rays.update(camera, 50, 30, 10, &pool));
+	EXPECT_FALSE(rays.contains(50, 0));
+	camera.position = bardrix::point3(1, 0, 0);
+	EXPECT_TRUE(rays.update(camera, 50, 30, 10));
+	EXPECT_EQ(1, rays.origin().x);
+	EXPECT_EQ(camera.shoot_ray(49, 29, 10)->get_direction().x, rays.direction(49, 29).x);
+}
+
+TEST(TripleBufferTest, ReaderGetsNewestCompleteValue) {
+	triple_buffer<int> buffer;
+	EXPECT_FALSE(buffer.update());
+	buffer.back() = 1;
+	buffer.publish();
+	buffer.back() = 2;
+	buffer.publish();
+	EXPECT_TRUE(buffer.update());
+	EXPECT_EQ(2, buffer.front());
+	EXPECT_FALSE(buffer.update());
+
+	// The writer never touches the front, so the reader only ever sees complete values in order
+	struct pair { std::uint64_t a = 0, b = 0; };
+	triple_buffer<pair> pairs;
+	std::thread writer([&pairs] {
+		for (std::uint64_t i = 1; i <= 200000; i++) {
+			pairs.back().a = i;
+			pairs.back().b = i;
+			pairs.publish();
+		}
+	});
+
+	std::uint64_t last = 0;
+	while (last < 200000) {
+		if (!pairs.update())
+			continue;
+		ASSERT_EQ(pairs.front().a, pairs.front().b);
+		ASSERT_GT(pairs.front().a, last);
+		last = pairs.front().a;
+	}
+	writer.join();
+}
+
+TEST(RenderThreadTest, HandsOverTheLatestRequestedFrame) {
+	std::atomic<int> frames = 0;
+	render_thread thread([](framebuffer& buffer, int width, int height, const cancel_token&) {
+		buffer.assign(static_cast<std::size_t>(width) * height, static_cast<std::uint32_t>(width));
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	}, [&frames] { frames++; });
+	EXPECT_EQ(nullptr, thread.latest());
+
+	// Requests during a frame are merged, the last one wins
+	for (int width = 1; width <= 20; width++)
+		thread.request(width, 3);
+
+	const rendered_frame* frame = nullptr;
+	const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+	while ((frame == nullptr || frame->width != 20) && std::chrono::steady_clock::now() < deadline)
+		frame = thread.latest();
+
+	ASSERT_NE(nullptr, frame);
+	EXPECT_EQ(20, frame->width);
+	EXPECT_EQ(3, frame->height);
+	EXPECT_EQ(framebuffer(60, 20), frame->pixels);
+	EXPECT_LT(frames.load(), 20);
+
+	thread.stop();
+	thread.request(5, 5); // Ignored after stop
+}
+
+TEST(RenderThreadTest, CancelsSupersededFrames) {
+	std::atomic<int> started = 0, cancelled = 0, frames = 0;
+	int scale = 1; // Only touched on the render thread
+	render_thread thread([&](framebuffer& buffer, int width, int height, const cancel_token& token) {
+		const bool first = started++ == 0;
+		buffer.assign(static_cast<std::size_t>(width) * height, static_cast<std::uint32_t>(width * scale));
+		for (int i = 0; i < 10000 && first && !token.cancelled(); i++)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1)); // A first frame of 10 s unless superseded
+		if (token.cancelled())
+			cancelled++;
+	}, [&frames] { frames++; });
+
+	thread.request(4, 4);
+	while (started == 0)
+		std::this_thread::yield();
+
+	// The slow frame is dropped for the newest state, the changes are applied on the render thread
+	thread.post([&scale] { scale = 2; });
+	thread.request(8, 2);
+
+	const rendered_frame* frame = nullptr;
+	while (frame == nullptr || frame->width != 8)
+		frame = thread.latest();
+	EXPECT_EQ(2, started.load());
+	EXPECT_EQ(1, cancelled.load());
+	EXPECT_EQ(framebuffer(16, 16), frame->pixels);
+	EXPECT_EQ(1, frames.load());
+	EXPECT_EQ(1u, frame->number);
+}
+
+TEST(RenderThreadTest, StopCancelsTheFrameInFlight) {
+	std::atomic<int> started = 0, frames = 0;
+	std::atomic<bool> cancelled = false;
+	render_thread thread([&](framebuffer& buffer, int width, int height, const cancel_token& token) {
+		started++;
+		buffer.assign(static_cast<std::size_t>(width) * height, 0);
+		for (int i = 0; i < 10000 && !token.cancelled(); i++)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		cancelled = token.cancelled();
+	}, [&frames] { frames++; });
+
+	thread.request(4, 4);
+	while (started == 0)
+		std::this_thread::yield();
+
+	// Closing doesn't wait for the slow frame, the frame is dropped
+	thread.stop();
+	EXPECT_TRUE(cancelled.load());
+	EXPECT_EQ(0, frames.load());
+	EXPECT_EQ(nullptr, thread.latest());
+}
+
+TEST(RendererTest, CancelledFrameStopsAndRedrawsLater) {
+	auto spheres = random_spheres(2000, 67);
+	std::vector<bardrix::light> lights = { bardrix::light({ 0,5,0 }, 1, bardrix::color::cyan()) };
+	bardrix::camera camera({ 0,0,0 }, { 0,0,1 }, 256, 256, 70);
+	render_options options;
+	options.threads = 1;
+	options.tile_size = 16;
+	renderer renderer(camera, spheres, lights, options);
+
+	framebuffer expected, actual;
+	renderer.render(expected, 256, 256);
+	actual.assign(expected.size(), 0);
+
+	// A frame that is superseded before it starts leaves the buffer alone
+	std::atomic<std::uint64_t> generation = 0;
+	const cancel_token stale(generation);
+	generation++;
+	const render_stats skipped = renderer.render(actual, 256, 256, stale);
+	EXPECT_TRUE(skipped.cancelled);
+	EXPECT_EQ(0u, skipped.rays);
+	EXPECT_EQ(framebuffer(expected.size(), 0), actual);
+
+	// A frame superseded halfway stops at the next tile, the next dirty frame redraws everything
+	std::thread bump([&generation] {
+		std::this_thread::sleep_for(std::chrono::milliseconds(2));
+		generation++;
+	});
+	const render_stats halfway = renderer.render(actual, 256, 256, cancel_token(generation));
+	bump.join();
+	if (halfway.cancelled) {
+		EXPECT_LT(halfway.rays, 256u * 256u);
+	}
+
+	const render_stats redrawn = renderer.render_dirty(actual, 256, 256, cancel_token(generation));
+	EXPECT_FALSE(redrawn.cancelled);
+	EXPECT_EQ(halfway.cancelled ? 256u * 256u : 0u, redrawn.rays);
+	EXPECT_EQ(expected, actual);
+}
+
+TEST(FrameSchedulerTest, ScalesResolutionToTheBudget) {
+	auto spheres = random_spheres(500, 73);
+	std::vector<bardrix::light> lights = { bardrix::light({ 0,5,0 }, 1, bardrix::color::cyan()) };
+	bardrix::camera camera({ 0,0,0 }, { 0,0,1 }, 128, 96, 70);
+	render_options options;
+	options.threads = 2;
+	renderer renderer(camera, spheres, lights, options);
+
+	framebuffer expected, actual;
+	renderer.render(expected, 128, 96);
+
+	// A generous budget renders at full resolution, the same as rendering directly
+	// The first frame has no measurement yet and renders at the lowest scale
+	frame_scheduler generous(renderer, camera, 10);
+	EXPECT_EQ(0.25, generous.render(actual, 128, 96).resolution_scale);
+	for (int frame = 0; frame < 3; frame++) {
+		const render_stats stats = generous.render(actual, 128, 96);
+		EXPECT_EQ(1, stats.resolution_scale);
+		EXPECT_EQ(expected, actual);
+	}
+	EXPECT_GT(generous.get_seconds_per_pixel(), 0);
+
+	// The scale of the first frame after a resize is fitted to the new size
+	frame_scheduler resized(renderer, camera, 1, 0.01);
+	resized.render(actual, 32, 24);
+	resized.render(actual, 32, 24);
+	const double seconds_per_pixel = resized.get_seconds_per_pixel();
+	resized.set_budget(seconds_per_pixel * 32 * 24 / frame_scheduler::headroom);
+	resized.render(actual, 128, 96);
+	const double fitted = std::sqrt(resized.get_budget() * frame_scheduler::headroom / seconds_per_pixel / (128 * 96));
+	EXPECT_EQ(std::clamp(std::floor(fitted * frame_scheduler::scale_steps) / frame_scheduler::scale_steps, 0.01, 1.0),
+	          resized.get_scale());
+	EXPECT_LT(resized.get_scale(), 0.5);
+
+	// An impossible budget drops to the lowest scale, the frame is still upscaled to the full size
+	frame_scheduler impossible(renderer, camera, 1e-9, 0.25);
+	render_stats stats;
+	for (int frame = 0; frame < 3; frame++)
+		stats = impossible.render(actual, 128, 96);
+	EXPECT_EQ(0.25, stats.resolution_scale);
+	EXPECT_EQ(0.25, impossible.get_scale());
+	EXPECT_EQ(32u * 24u, stats.rays);
+	ASSERT_EQ(128u * 96u, actual.size());
+	EXPECT_EQ(128, camera.get_width());
+	EXPECT_EQ(96, camera.get_height());
+
+	// Every 4x4 block shows one pixel of the scaled frame
+	for (int y = 0; y < 96; y++)
+		for (int x = 0; x < 128; x++)
+			ASSERT_EQ(actual[(y & ~3) * 128 + (x & ~3)], actual[y * 128 + x]);
+
+	// An empty frame, e.g. a minimized window, reports scale 1
+	EXPECT_EQ(1, impossible.render(actual, 0, 0).resolution_scale);
+}
+
+TEST(PagePoolTest, ReusesPageAlignedBlocks) {
+	page_pool& pool = page_pool::instance();
+	pool.trim();
+	const std::uint64_t before = pool.get_allocations();
+	const std::size_t reserved = pool.get_reserved(); // The frame buffers that are still alive
+
+	void* small = pool.allocate(100);
+	void* large = pool.allocate(3 * page_pool::huge_page_size + 1);
+	EXPECT_EQ(0u, reinterpret_cast<std::uintptr_t>(small) % page_pool::page_size);
+	EXPECT_EQ(0u, reinterpret_cast<std::uintptr_t>(large) % page_pool::page_size);
+	EXPECT_EQ(before + 2, pool.get_allocations());
+
+	// Freed blocks are handed out again to anything that fits, the smallest first
+	pool.deallocate(small);
+	pool.deallocate(large);
+	EXPECT_EQ(small, pool.allocate(page_pool::page_size));
+	EXPECT_EQ(large, pool.allocate(2 * page_pool::huge_page_size));
+	EXPECT_EQ(before + 2, pool.get_allocations());
+
+	pool.deallocate(small);
+	pool.deallocate(large);
+	pool.trim();
+	EXPECT_EQ(reserved, pool.get_reserved());
+}
+
+TEST(FrameSchedulerTest, ResizingStopsAllocatingAtThePeakSize) {
+	auto spheres = random_spheres(200, 79);
+	std::vector<bardrix::light> lights = { bardrix::light({ 0,5,0 }, 1, bardrix::color::cyan()) };
+	bardrix::camera camera({ 0,0,0 }, { 0,0,1 }, 96, 64, 70);
+	render_options options;
+	options.threads = 2;
+	renderer renderer(camera, spheres, lights, options);
+	frame_scheduler scheduler(renderer, camera, 10);
+
+	// The render loop of the window: a scheduled frame, a progressive refinement and a copy that is shown
+	framebuffer buffer, shown;
+	const int sizes[][2] = { { 96, 64 }, { 40, 30 }, { 128, 80 }, { 17, 9 }, { 64, 64 } };
+	auto resize_through = [&] {
+		for (const auto& size : sizes) {
+			camera.set_width(size[0]);
+			camera.set_height(size[1]);
+			scheduler.render(buffer, size[0], size[1]);
+			renderer.render_progressive(buffer, size[0], size[1], [&](const framebuffer& pixels, int) {
+				shown = pixels;
+			});
+			ASSERT_EQ(static_cast<std::size_t>(size[0]) * size[1], shown.size());
+		}
+	};
+
+	resize_through();
+	const std::uint64_t warm = page_pool::instance().get_allocations();
+	for (int round = 0; round < 3; round++)
+		resize_through();
+	EXPECT_EQ(warm, page_pool::instance().get_allocations());
+}
+
+TEST(RendererTest, KeepsPrimaryHitsPerFrameSize) {
+	auto spheres = random_spheres(300, 83);
+	std::vector<bardrix::light> lights = { bardrix::light({ 0,5,0 }, 1, bardrix::color::cyan()) };
+	bardrix::camera camera({ 0,0,0 }, { 0,0,1 }, 64, 48, 70);
+	render_options options;
+	options.threads = 2;
+	options.g_buffer = true;
+	renderer renderer(camera, spheres, lights, options);
+	frame_scheduler scheduler(renderer, camera, 1e-9, 0.25);
+
+	// The render loop of the window alternates a scaled frame and the full frame, both only shade after the first
+	framebuffer buffer;
+	for (int frame = 0; frame < 3; frame++) {
+		const render_stats scaled = scheduler.render(buffer, 64, 48);
+		const render_stats full = renderer.render(buffer, 64, 48);
+		EXPECT_EQ(0.25, scaled.resolution_scale);
+		EXPECT_EQ(frame == 0 ? 16u * 12u : 0u, scaled.rays);
+		EXPECT_EQ(frame == 0 ? 64u * 48u : 0u, full.rays);
+	}
+}